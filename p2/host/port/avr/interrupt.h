@@ -0,0 +1,16 @@
+/*
+ * Interrupt handlers become plain functions on the host. host_port.c calls them when the simulated interrupt fires.
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#define TIMER1_COMPA_vect	Host_Timer1_CompA_ISR
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+#define ISR_NAKED
+
+#define sei()	Host_Enable_Interrupt()
+#define cli()	Host_Disable_Interrupt()
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
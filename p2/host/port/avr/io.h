@@ -0,0 +1,44 @@
+/*
+ * The I/O registers used by the kernel and the tests, as plain variables for the host port.
+ * Writes go nowhere and reads return whatever was last written. With HOST_PIN_TRACE, the rising edges on PB1-PB3 are
+ * printed, see Host_PortB() in host_port.c.
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+#include <string.h>
+
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t OCR1A, TCNT1;
+extern volatile uint8_t SPL, SPH;
+
+#ifdef HOST_PIN_TRACE
+volatile uint8_t *Host_PortB(void);
+#define PORTB (*Host_PortB())
+#endif
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define OCIE1A 1
+#define OCF1A 1
+
+#define TIMER1_COMPA_vect_num 17
+
+#endif /* HOST_AVR_IO_H_ */
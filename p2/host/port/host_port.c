@@ -0,0 +1,474 @@
+/*
+ * Runs the kernel as an ordinary Linux program. Used by node_sim.c and the stress tester in host/stress.
+ *
+ * Tasks are ucontext coroutines with a real stack each, switched by Enter_Kernel() and Exit_Kernel() in place of
+ * cswitch.s. The tick interrupt is simulated in virtual time: it fires whenever the kernel idles, and after every
+ * Host_Entries_Per_Tick kernel entries once interrupts are enabled, in the kernel or in a task. Programs may also fire
+ * it with Host_Tick(), or set Host_Tick_Pending to have it fire the next time interrupts are enabled. Interrupts are only
+ * ever taken there, never asynchronously, so a task that spins without enabling interrupts can't be preempted.
+ *
+ * Alternatively, Host_Replay_Load() reads the interrupt arrivals recorded by a kernel built with ISR_TRACE (on the
+ * target or here) and fires each one again at the kernel entry it arrived at, with TCNT1 as it was. Handlers for
+ * vectors other than the tick are registered with Host_Set_Vector(). Once the recording runs out, the virtual time
+ * ticks take over again.
+ *
+ * With HOST_PIN_TRACE, the tests' pulses on PB1-PB3 are printed as "PIN <n>" lines, one per rising edge, which
+ * host/simavr/run_regress.sh -h checks against the pin order of the simavr baselines.
+ *
+ * With HOST_SMP, OS_Start() runs the kernel on Host_CPUs threads at once, each a virtual CPU with its own run queue (see
+ * Kernel_SMP_Pick()). Disabling interrupts takes the kernel lock, a single mutex standing in for disabling them on every
+ * CPU, so the kernel itself runs on one CPU at a time, as do ISRs. Mutex_Lock(), Mutex_Unlock() and Event_Wait() skip it
+ * where they can and only lock the object. The kernel keeps it for as long as it runs, and a task gives it back by
+ * enabling interrupts, i.e. when the kernel returns to it. A task is a ucontext like before, and may be resumed on any CPU's thread. The kernel's per-CPU variables are
+ * __thread, which is only reliable then if they're looked up afresh after a switch: the SMP build must not use -fPIC.
+ * Host_Resched() interrupts another CPU, which takes it before the task running there makes its next request. An idle CPU
+ * waits for one without the kernel lock. The tick fires right away once all of them idle, and every MSECPERTICK of real
+ * time while only some do. Replays need a single CPU.
+ * Build with -DHOST_SMP -pthread in addition to -DHOST_PORT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#ifdef HOST_SMP
+#include <pthread.h>
+#include <time.h>
+#endif
+#include "../../kernel.h"
+
+#ifdef HOST_PIN_TRACE
+#undef PORTB						//The register itself, behind Host_PortB()
+#endif
+
+#define HOST_STACK_SIZE 65536	//Per task. The AVR workspace is far too small for host code
+#define HOST_VECTORS 57			//Interrupt vectors of the ATmega2560
+#define HOST_IDLE_WAIT_NS 1000000	//How long an idle virtual CPU waits to be interrupted before it checks if a tick is due
+
+void TIMER1_COMPA_vect(void);
+
+/*The I/O registers the kernel and the tests touch*/
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A, TCNT1;
+volatile uint8_t SPL, SPH;
+PER_CPU volatile unsigned char SREG;
+
+PER_CPU volatile int Host_In_Kernel = 1;			//The kernel runs on the original context, including before OS_Start()
+PER_CPU volatile int Host_Idling;
+PER_CPU int Host_CPU;
+int Host_CPUs = 1;
+unsigned long Host_Entries_Per_Tick = 100;
+unsigned long Host_Ticks;
+unsigned long Host_Entries;
+unsigned long Host_Switches;
+unsigned long Host_Replay_Diverged;
+volatile sig_atomic_t Host_Tick_Pending;
+
+static PER_CPU ucontext_t Kernel_Ctx;				//Where Enter_Kernel() returns to
+static ucontext_t Task_Ctx[MAXTHREAD];				//Saved context of every task, by process list slot
+static PID Task_Ctx_PID[MAXTHREAD];					//Which task each context was made for. A new PID in a slot needs a new context
+static char Task_Stack[MAXTHREAD][HOST_STACK_SIZE];
+static unsigned long Host_Entries_At_Tick;			//Host_Entries when the last tick fired
+static PER_CPU int Host_Last_Slot = -1;
+static int Host_Idle_CPUs;							//Virtual CPUs waiting in Host_Wait_For_Interrupt()
+
+#ifdef HOST_SMP
+unsigned long Host_Lock_Taken;
+unsigned long Host_Lock_Contended;
+static pthread_mutex_t Host_Lock = PTHREAD_MUTEX_INITIALIZER;	//The kernel lock. Held by whoever has interrupts disabled
+static PER_CPU int Host_Lock_Held;					//Does this virtual CPU hold it?
+static pthread_cond_t Host_Wakeup[HOST_MAX_CPUS];	//Signalled to interrupt an idle virtual CPU
+static volatile int Host_Resched_Pending[HOST_MAX_CPUS];	//Interrupts sent with Host_Resched(), until the kernel runs a task there again
+static int Host_CPU_Idle[HOST_MAX_CPUS];			//Counted in Host_Idle_CPUs until it's interrupted
+static unsigned long long Host_Tick_Ns;				//Real time the last tick fired at
+#endif
+
+static void (*Host_Vector[HOST_VECTORS])(void);		//Handlers of the interrupts a replay may fire, besides the tick
+static TRACE_RECORD *Replay;						//Interrupt arrivals being replayed
+static unsigned int Replay_Count;
+static unsigned int Replay_Next;					//Next arrival to fire
+
+#ifdef HOST_PIN_TRACE
+/*Every use of PORTB goes through here. A write only lands once this returns, so the rising edges it made are printed the
+  next time PORTB is used, which the tests do right away to end the pulse*/
+volatile uint8_t *Host_PortB(void)
+{
+	static uint8_t last;
+	uint8_t up = PORTB & ~last;
+	int pin;
+	
+	for(pin = PB1; pin <= PB3; pin++)
+		if(up & (1 << pin))
+			printf("PIN %d\n", pin);
+	last = PORTB;
+	return &PORTB;
+}
+#endif
+
+/*PIDs encode the task's slot in the process list*/
+static int Host_Slot(void)
+{
+	return (Cp->pid - 1) % MAXTHREAD;
+}
+
+#ifdef HOST_SMP
+static unsigned long long Host_Now_Ns(void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+#endif
+
+/*Runs the tick interrupt with the timer at tcnt*/
+static void Host_Timer_Interrupt(unsigned int tcnt)
+{
+	Host_On_Tick();
+	Host_Tick_Pending = 0;
+	Host_Entries_At_Tick = Host_Entries;
+	++Host_Ticks;
+	#ifdef HOST_SMP
+	Host_Tick_Ns = Host_Now_Ns();
+	#endif
+	
+	TCNT1 = tcnt;
+	TIMER1_COMPA_vect();
+}
+
+/*Runs the tick interrupt. Called with interrupts disabled, like any interrupt handler*/
+void Host_Tick(void)
+{
+	Host_Timer_Interrupt(0);
+}
+
+/*Sets the handler a replay calls for an interrupt vector other than TIMER1_COMPA*/
+void Host_Set_Vector(unsigned char vector, void (*isr)(void))
+{
+	if(vector < HOST_VECTORS)
+		Host_Vector[vector] = isr;
+}
+
+/*Reads the "TRACE entry tick tcnt vector where" lines printed by Kernel_Dump_Trace(), ignoring anything else
+  (so a whole UART log can be used as is). Returns the number of interrupts loaded, or -1 if the file can't be read*/
+int Host_Replay_Load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128];
+	unsigned long entry;
+	unsigned int tick, tcnt, vector, where;
+	unsigned int size = 0;
+	
+	if(f == NULL)
+		return -1;
+	
+	free(Replay);
+	Replay = NULL;
+	Replay_Count = Replay_Next = 0;
+	Host_Replay_Diverged = 0;
+	
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		if(sscanf(line, "TRACE %lu %u %u %u %u", &entry, &tick, &tcnt, &vector, &where) != 5)
+			continue;
+		
+		if(Replay_Count == size)
+		{
+			size = size ? size * 2 : 64;
+			Replay = realloc(Replay, size * sizeof(TRACE_RECORD));
+		}
+		
+		Replay[Replay_Count].entry = entry;
+		Replay[Replay_Count].tick = tick;
+		Replay[Replay_Count].tcnt = tcnt;
+		Replay[Replay_Count].vector = vector;
+		Replay[Replay_Count].where = where;
+		++Replay_Count;
+	}
+	
+	fclose(f);
+	return Replay_Count;
+}
+
+/*Fires the next recorded interrupt if the kernel has got to where it arrived. Returns 0 once the recording runs out.
+  Called with interrupts disabled*/
+int Host_Replay_Poll(void)
+{
+	TRACE_RECORD *r;
+	
+	if(Replay_Next >= Replay_Count)
+		return 0;
+	
+	//Within an entry the kernel runs first, then the task. The kernel may idle in between handling the request and
+	//switching, and an idle kernel can't get anywhere without an interrupt, so it takes the next one regardless of where
+	//it was recorded
+	r = &Replay[Replay_Next];
+	if(!Host_Idling && (Host_Entries < r->entry || (Host_Entries == r->entry && Host_In_Kernel && r->where != TRACE_KERNEL)))
+		return 1;
+	
+	//Different code or a different build doesn't reach the same points. Count it, so the replay isn't trusted blindly
+	if(Host_Entries != r->entry || r->where != (Host_Idling ? TRACE_IDLE : Host_In_Kernel ? TRACE_KERNEL : TRACE_TASK))
+		++Host_Replay_Diverged;
+	
+	++Replay_Next;
+	if(r->vector == TIMER1_COMPA_vect_num)
+	{
+		Host_Timer_Interrupt(r->tcnt);
+	}
+	else if(r->vector < HOST_VECTORS && Host_Vector[r->vector] != NULL)
+	{
+		TCNT1 = r->tcnt;
+		Host_Vector[r->vector]();
+	}
+	
+	return 1;
+}
+
+/*Is the tick due? An idle kernel only waits for the next tick, so there's no point in waiting in real time. With several
+  virtual CPUs, that's once all of them idle*/
+static int Host_Tick_Due(void)
+{
+	#ifdef HOST_SMP
+	//Tasks spinning on the other CPUs don't enter the kernel, so an idle one keeps time for them
+	if(Host_Idling && Host_Now_Ns() - Host_Tick_Ns >= MSECPERTICK * 1000000ULL)
+		return 1;
+	#endif
+	return (Host_Idling && Host_Idle_CPUs == Host_CPUs) || Host_Tick_Pending || (Host_Entries_Per_Tick > 0 && Host_Entries - Host_Entries_At_Tick >= Host_Entries_Per_Tick);
+}
+
+/*Fires the tick interrupt if it's due*/
+static void Host_Poll_Interrupts(void)
+{
+	if(!(SREG & 0x80))
+		return;
+	
+	#ifdef HOST_SMP
+	//A task only takes the kernel lock if there may be an interrupt, so tasks on different CPUs don't fight over it for nothing
+	if(!Host_In_Kernel && !Host_Resched_Pending[Host_CPU] && !Host_Tick_Due() && Replay_Next >= Replay_Count)
+		return;
+	#endif
+	
+	Host_Disable_Interrupt();
+	
+	if(!Host_Replay_Poll() && Host_Tick_Due())
+		Host_Tick();
+	
+	#ifdef HOST_SMP
+	Host_Restore_Interrupt(SREG | 0x80);
+	#else
+	SREG |= 0x80;
+	#endif
+}
+
+/*Called by the idle kernel, with interrupts enabled. Nothing can happen until an interrupt does, so one fires right away.
+  An idle virtual CPU waits for another one to interrupt it instead, unless they're all idle*/
+void Host_Wait_For_Interrupt(void)
+{
+	#ifdef HOST_SMP
+	struct timespec until;
+	
+	Host_CPU_Idle[Host_CPU] = 1;
+	#endif
+	++Host_Idle_CPUs;
+	Host_Idling = 1;
+	
+	#ifdef HOST_SMP
+	if(!Host_Resched_Pending[Host_CPU] && !Host_Tick_Due())
+	{
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_nsec += HOST_IDLE_WAIT_NS;
+		if(until.tv_nsec >= 1000000000)
+		{
+			until.tv_nsec -= 1000000000;
+			++until.tv_sec;
+		}
+		pthread_cond_timedwait(&Host_Wakeup[Host_CPU], &Host_Lock, &until);
+	}
+	
+	//Look at the run queues again before taking a tick if another CPU asked for it
+	if(Host_Resched_Pending[Host_CPU])
+		Host_Resched_Pending[Host_CPU] = 0;
+	else
+		Host_Poll_Interrupts();
+	
+	if(Host_CPU_Idle[Host_CPU])
+	{
+		Host_CPU_Idle[Host_CPU] = 0;
+		--Host_Idle_CPUs;
+	}
+	#else
+	Host_Poll_Interrupts();
+	--Host_Idle_CPUs;
+	#endif
+	Host_Idling = 0;
+}
+
+#ifdef HOST_SMP
+/*Waits for the kernel lock, counting how often another virtual CPU held it*/
+static void Host_Lock_Kernel(void)
+{
+	if(pthread_mutex_trylock(&Host_Lock) != 0)
+	{
+		pthread_mutex_lock(&Host_Lock);
+		++Host_Lock_Contended;
+	}
+	++Host_Lock_Taken;
+	Host_Lock_Held = 1;
+}
+
+/*Puts back the interrupt flag saved from SREG. A task enabling interrupts gives back the kernel lock, the kernel keeps it*/
+void Host_Restore_Interrupt(unsigned char sreg)
+{
+	SREG = sreg;
+	if((sreg & 0x80) && !Host_In_Kernel && Host_Lock_Held)
+	{
+		Host_Lock_Held = 0;
+		pthread_mutex_unlock(&Host_Lock);
+	}
+}
+
+/*Interrupts virtual CPU cpu, which has the kernel look at its task and run queue again, like an inter-processor interrupt.
+  Called by the kernel*/
+void Host_Resched(int cpu)
+{
+	Host_Resched_Pending[cpu] = 1;
+	if(Host_CPU_Idle[cpu])
+	{
+		Host_CPU_Idle[cpu] = 0;		//It isn't idle anymore as far as the tick goes
+		--Host_Idle_CPUs;
+		pthread_cond_signal(&Host_Wakeup[cpu]);
+	}
+}
+
+/*The thread of a virtual CPU started by OS_Start()*/
+static void *Host_CPU_Main(void *cpu)
+{
+	Host_CPU = (intptr_t)cpu;
+	Host_Disable_Interrupt();
+	Kernel_Run_CPU();
+	return NULL;
+}
+
+/*Starts virtual CPUs 1 to Host_CPUs-1. Called by OS_Start() on CPU 0 with the kernel lock held, so they only get to run the
+  kernel once it's done booting*/
+void Host_Start_CPUs(void)
+{
+	pthread_t thread;
+	intptr_t cpu;
+	
+	if(Host_CPUs > HOST_MAX_CPUS)
+		Host_CPUs = HOST_MAX_CPUS;
+	if(Host_CPUs < 1)
+		Host_CPUs = 1;
+	
+	for(cpu = 0; cpu < Host_CPUs; cpu++)
+		pthread_cond_init(&Host_Wakeup[cpu], NULL);
+	
+	for(cpu = 1; cpu < Host_CPUs; cpu++)
+	{
+		if(pthread_create(&thread, NULL, Host_CPU_Main, (void *)cpu) != 0)
+		{
+			Host_CPUs = cpu;		//Make do with the ones that started
+			break;
+		}
+		pthread_detach(thread);
+	}
+}
+#endif
+
+void Host_Disable_Interrupt(void)
+{
+	#ifdef HOST_SMP
+	while(!Host_Lock_Held)
+	{
+		Host_Lock_Kernel();
+		
+		//An interrupt another CPU sent while this one had interrupts enabled comes first, like it would on hardware. A task
+		//that was suspended doesn't get to make the request it's disabling interrupts for until it's resumed. It returns
+		//with interrupts enabled, and the lock given back
+		if((SREG & 0x80) && !Host_In_Kernel && Host_Resched_Pending[Host_CPU])
+		{
+			SREG &= ~0x80;
+			Kernel_Resched_ISR();
+		}
+	}
+	#endif
+	SREG &= ~0x80;
+}
+
+void Host_Enable_Interrupt(void)
+{
+	#ifdef HOST_SMP
+	Host_Restore_Interrupt(SREG | 0x80);
+	#else
+	SREG |= 0x80;
+	#endif
+	Host_Poll_Interrupts();
+}
+
+/*Forgets every task context, so the kernel can be booted again with OS_Init()*/
+void Host_Reset(void)
+{
+	memset(Task_Ctx_PID, 0, sizeof(Task_Ctx_PID));
+	Host_In_Kernel = 1;
+	Host_Idling = 0;
+	Host_Idle_CPUs = 0;
+	Host_Last_Slot = -1;
+	Host_Tick_Pending = 0;
+	Replay_Next = 0;
+	SREG = 0;
+}
+
+/*First thing a new task runs. Returning from the task's function terminates it, as on the target*/
+static void Host_Task_Entry(void)
+{
+	Host_Enable_Interrupt();
+	
+	//Pass the arg like the AVR does in r24:r25, it's ignored by tasks declared without a parameter
+	((void (*)(intptr_t))Cp->code)(Cp->arg);
+	Task_Terminate();
+}
+
+/*Called by a task with interrupts disabled. Returns once the kernel switches back to this task*/
+void Enter_Kernel(void)
+{
+	++Host_Entries;
+	swapcontext(&Task_Ctx[Host_Slot()], &Kernel_Ctx);
+	
+	//Returning to a task enables interrupts again, like the reti in cswitch.s
+	Host_Enable_Interrupt();
+}
+
+/*Called by the kernel to run Cp until its next syscall or preemption*/
+void Exit_Kernel(void)
+{
+	int slot = Host_Slot();
+	
+	if(Task_Ctx_PID[slot] != Cp->pid)
+	{
+		getcontext(&Task_Ctx[slot]);
+		Task_Ctx[slot].uc_stack.ss_sp = Task_Stack[slot];
+		Task_Ctx[slot].uc_stack.ss_size = HOST_STACK_SIZE;
+		Task_Ctx[slot].uc_link = NULL;
+		makecontext(&Task_Ctx[slot], Host_Task_Entry, 0);
+		Task_Ctx_PID[slot] = Cp->pid;
+	}
+	
+	if(slot != Host_Last_Slot)
+		++Host_Switches;
+	Host_Last_Slot = slot;
+	
+	#ifdef HOST_SMP
+	Host_Resched_Pending[Host_CPU] = 0;		//The kernel has just looked at everything
+	#endif
+	
+	Host_In_Kernel = 0;
+	swapcontext(&Kernel_Ctx, &Task_Ctx[slot]);
+	Host_In_Kernel = 1;
+}
+
+/*Never used, the kernel only switches through Enter_Kernel() and Exit_Kernel()*/
+void CSwitch(void)
+{
+}
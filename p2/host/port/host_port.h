@@ -0,0 +1,47 @@
+/***********************************************************************
+  host_port.h stands in for the AVR specific parts of the kernel when it is built for a PC with HOST_PORT defined.
+  Tasks become ucontext coroutines, and the timer interrupt is simulated in virtual time. With HOST_SMP also defined,
+  the kernel runs on Host_CPUs threads at once, each a virtual CPU with its own run queue. See host_port.c.
+  ***********************************************************************/
+
+#ifndef HOST_PORT_H_
+#define HOST_PORT_H_
+
+#include <signal.h>
+
+#define HOST_MAX_CPUS 8
+
+extern PER_CPU volatile unsigned char SREG;
+extern PER_CPU volatile int Host_In_Kernel;		//Is the kernel running, as opposed to a task?
+extern PER_CPU volatile int Host_Idling;		//Is the kernel waiting for an interrupt in its idle loop?
+extern PER_CPU int Host_CPU;					//Which virtual CPU this is, 0 being the one that called OS_Start()
+extern int Host_CPUs;							//Virtual CPUs started by OS_Start(), up to HOST_MAX_CPUS. Only 1 without HOST_SMP
+extern unsigned long Host_Entries_Per_Tick;		//Kernel entries between simulated ticks, 0 = only tick when the kernel idles
+extern unsigned long Host_Ticks;				//Ticks simulated so far
+extern unsigned long Host_Entries;				//Number of kernel entries
+extern unsigned long Host_Switches;				//Number of times the kernel switched to a different task
+extern unsigned long Host_Replay_Diverged;		//Replayed interrupts that couldn't fire where they were recorded
+extern volatile sig_atomic_t Host_Tick_Pending;	//Set by a real time timer, e.g. from a signal handler. The tick fires the next time interrupts are enabled
+#ifdef HOST_SMP
+extern unsigned long Host_Lock_Taken;			//Times the kernel lock was taken, by the kernel or by a task disabling interrupts
+extern unsigned long Host_Lock_Contended;		//Times it had to be waited for, because another virtual CPU held it
+#endif
+
+void Host_Disable_Interrupt(void);
+void Host_Enable_Interrupt(void);
+void Host_Wait_For_Interrupt(void);
+void Host_Tick(void);
+void Host_Reset(void);
+int Host_Replay_Load(const char *path);
+int Host_Replay_Poll(void);
+void Host_Set_Vector(unsigned char vector, void (*isr)(void));
+#ifdef HOST_SMP
+void Host_Restore_Interrupt(unsigned char sreg);
+void Host_Start_CPUs(void);
+void Host_Resched(int cpu);
+#endif
+
+/*Supplied by the program using the port. Called before every simulated tick*/
+void Host_On_Tick(void);
+
+#endif /* HOST_PORT_H_ */
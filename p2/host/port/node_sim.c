@@ -0,0 +1,223 @@
+/*
+ * Runs an unmodified application on the host port, as any number of simulated controller nodes at once.
+ *
+ * Compile using (from p2/):
+ *   gcc -std=gnu99 -O2 -DHOST_PORT -Dmain=Host_Node_Main -Ihost/port -o node_sim \
+ *       host/port/node_sim.c host/port/host_port.c kernel.c os.c sched_analysis.c <application>.c
+ *
+ * Usage:
+ *   ./node_sim [-n nodes] [-j cpus] [-c cpus per node] [-t ticks] [-e entries per tick] [-r trace] [-w trace]
+ *
+ * Each node is a separate process running its own copy of the kernel. -j sets how many nodes run at once (default:
+ * one per online core). Whenever one finishes, the next node that hasn't started takes its place, so a core is never
+ * idle while nodes are left and no node waits behind a slow one. Nodes share no state, so there's nothing to lock
+ * between them. Contention within a node is reported per mutex.
+ *
+ * -c runs each node's kernel on that many virtual CPUs, which needs -DHOST_SMP -pthread in the compile line (see
+ * host_port.c). The node then also reports how often its CPUs stole each other's tasks and waited for the kernel lock.
+ *
+ * Besides the virtual time ticks of host_port.c, SIGALRM marks a tick pending every MSECPERTICK milliseconds. The
+ * handler only sets Host_Tick_Pending, since running the kernel from a signal handler isn't safe, and the tick fires
+ * the next time the running task enables interrupts, e.g. in its next syscall. A task that spins without ever doing
+ * that can't be preempted on the host: if no tick could fire for NODE_STALL_TICKS, the node gives up and fails.
+ * When a node has seen -t ticks it prints its counters, including how often each mutex was contended, and exits.
+ *
+ * -r replays the interrupt arrivals in a trace recorded with ISR_TRACE, e.g. the TRACE lines of a target's UART log,
+ * instead of ticking by itself. Every interrupt still fires at the kernel entry it was recorded at. -w writes the
+ * trace of this run in the same format when the node exits, which needs -DISR_TRACE in the compile line. Both are
+ * for a single node on a single virtual CPU.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../../kernel.h"
+
+#define NODE_STALL_TICKS 100		//SIGALRMs in a row without a tick firing before a node is considered stuck in a spinning task
+
+#undef main						//Only the application's main() is renamed to Host_Node_Main
+
+void Host_Node_Main(void);
+
+static int Node_ID;
+static unsigned long Tick_Limit = 1000;
+static struct timespec Start;
+static const char *Replay_Path;
+static const char *Record_Path;
+static char Stall_Message[64];			//Formatted before the signal handler may need it, which can only write() it
+static int Stall_Length;
+
+/*Writes the interrupts this node recorded, in the format Host_Replay_Load() reads*/
+static void Node_Write_Trace(void)
+{
+	#ifdef ISR_TRACE
+	FILE *f = fopen(Record_Path, "w");
+	unsigned int i;
+	
+	if(f == NULL)
+	{
+		perror(Record_Path);
+		return;
+	}
+	
+	for(i = 0; i < Trace_Count; i++)
+		fprintf(f, "TRACE %lu %u %u %u %u\n", Trace_Buffer[i].entry, Trace_Buffer[i].tick, Trace_Buffer[i].tcnt, Trace_Buffer[i].vector, Trace_Buffer[i].where);
+	fclose(f);
+	
+	if(Trace_Dropped > 0)
+		printf("node %d: %u interrupts didn't fit in the trace, raise TRACE_SIZE\n", Node_ID, Trace_Dropped);
+	#else
+	printf("node %d: no trace written, compile with -DISR_TRACE\n", Node_ID);
+	#endif
+}
+
+/*Prints the node's counters and ends the node*/
+static void Node_Report(void)
+{
+	struct timespec now;
+	double secs;
+	MUTEX m;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = (now.tv_sec - Start.tv_sec) + (now.tv_nsec - Start.tv_nsec) / 1e9;
+	
+	printf("node %d: %lu ticks, %lu kernel entries, %lu task switches, %.0f entries/s\n",
+		Node_ID, Host_Ticks, Host_Entries, Host_Switches, secs > 0 ? Host_Entries / secs : 0.0);
+	#ifdef HOST_SMP
+	printf("node %d: %d virtual CPUs, %lu tasks stolen, kernel lock contended %lu of %lu times\n",
+		Node_ID, Host_CPUs, getSteals(), Host_Lock_Contended, Host_Lock_Taken);
+	#endif
+	for(m = 1; m <= Last_MutexID; m++)
+		printf("node %d: mutex %u contended %u times\n", Node_ID, m, getMutexContention(m));
+	if(Replay_Path != NULL)
+		printf("node %d: %lu replayed interrupts fired away from where they were recorded\n", Node_ID, Host_Replay_Diverged);
+	if(Record_Path != NULL)
+		Node_Write_Trace();
+	
+	fflush(stdout);
+	exit(0);
+}
+
+void Host_On_Tick(void)
+{
+	if(Host_Ticks == Tick_Limit)
+		Node_Report();
+}
+
+/*Asks for a tick once a task has been running without one for a whole tick. Only async-signal-safe calls can be made here*/
+static void Node_Timer_Signal(int sig)
+{
+	static unsigned long last_ticks;
+	static unsigned int stalled;
+	
+	(void)sig;
+	Host_Tick_Pending = 1;
+	
+	if(Host_Ticks != last_ticks)
+	{
+		last_ticks = Host_Ticks;
+		stalled = 0;
+	}
+	else if(++stalled == NODE_STALL_TICKS)
+	{
+		write(STDERR_FILENO, Stall_Message, Stall_Length);
+		_exit(3);
+	}
+}
+
+/*Runs one node. Never returns*/
+static void Node_Run(int id)
+{
+	struct itimerval tick = { { 0, MSECPERTICK * 1000 }, { 0, MSECPERTICK * 1000 } };
+	
+	Node_ID = id;
+	clock_gettime(CLOCK_MONOTONIC, &Start);
+	Stall_Length = snprintf(Stall_Message, sizeof(Stall_Message), "node %d: stuck in a task that never enables interrupts\n", id);
+	
+	//Whatever was printed before a stall is kept
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGALRM, Node_Timer_Signal);
+	setitimer(ITIMER_REAL, &tick, NULL);
+	
+	Host_Node_Main();
+	Node_Report();			//Only reached if the application never calls OS_Start()
+}
+
+int main(int argc, char **argv)
+{
+	int nodes = 1;
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, i, status, running = 0, failed = 0;
+	
+	while((opt = getopt(argc, argv, "n:j:c:t:e:r:w:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n': nodes = atoi(optarg); break;
+			case 'j': cpus = atoi(optarg); break;
+			case 'c': Host_CPUs = atoi(optarg); break;
+			case 't': Tick_Limit = strtoul(optarg, NULL, 0); break;
+			case 'e': Host_Entries_Per_Tick = strtoul(optarg, NULL, 0); break;
+			case 'r': Replay_Path = optarg; break;
+			case 'w': Record_Path = optarg; break;
+			default:
+			fprintf(stderr, "usage: %s [-n nodes] [-j cpus] [-c cpus per node] [-t ticks] [-e entries per tick] [-r trace] [-w trace]\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	if(Replay_Path != NULL && Host_Replay_Load(Replay_Path) < 0)
+	{
+		perror(Replay_Path);
+		return 2;
+	}
+	if((Replay_Path != NULL || Record_Path != NULL) && nodes > 1)
+	{
+		fprintf(stderr, "%s: -r and -w only work with a single node\n", argv[0]);
+		return 2;
+	}
+	#ifdef HOST_SMP
+	if((Replay_Path != NULL || Record_Path != NULL) && Host_CPUs > 1)
+	{
+		fprintf(stderr, "%s: -r and -w only work with a single virtual CPU\n", argv[0]);
+		return 2;
+	}
+	#else
+	if(Host_CPUs != 1)
+	{
+		fprintf(stderr, "%s: -c needs a build with -DHOST_SMP\n", argv[0]);
+		return 2;
+	}
+	#endif
+	
+	//A single node runs in this process, which keeps it easy to debug
+	if(nodes <= 1)
+		Node_Run(0);
+	
+	if(cpus < 1)
+		cpus = 1;
+	
+	for(i = 0; i < nodes || running > 0; )
+	{
+		//Start nodes while there are free virtual CPUs, otherwise wait for one to free up
+		if(i < nodes && running < cpus)
+		{
+			if(fork() == 0)
+				Node_Run(i);
+			++i;
+			++running;
+			continue;
+		}
+		
+		wait(&status);
+		--running;
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = 1;
+	}
+	
+	return failed;
+}
@@ -0,0 +1,217 @@
+/*
+ * Turns the samples of the kernel's PROFILER into a flat profile per function, using the firmware's symbols.
+ *
+ * Compile using:
+ *   gcc -Wall -o prof_report prof_report.c
+ *
+ * Usage:
+ *   ./prof_report <p2.elf | symbols.txt> <samples.log>
+ *
+ * The samples are the "PROFILE <pid> <address> <count>" lines printed by Kernel_Dump_Profile(), other lines are
+ * ignored so a whole UART log can be given. Symbols are read with "avr-nm -n" from the ELF file, or from a file
+ * holding that output when it's not called *.elf. Prints the share of samples of each function over all tasks,
+ * then for each task on its own. PID 0 is the kernel, and code that had interrupts disabled when a sample came due.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SYMBOLS 4096
+#define MAX_SAMPLES 1024
+#define MAX_NAME 64
+#define DATA_START 0x800000UL		//avr-nm shows RAM addresses above this
+
+typedef struct symbol
+{
+	unsigned long addr;
+	char name[MAX_NAME];
+} SYMBOL;
+
+typedef struct sample
+{
+	unsigned int pid;
+	int symbol;						//Index in Symbols, -1 = before the first function
+	unsigned long count;
+} SAMPLE;
+
+static SYMBOL Symbols[MAX_SYMBOLS];
+static unsigned int Symbol_Count;
+static SAMPLE Samples[MAX_SAMPLES];
+static unsigned int Sample_Count;
+
+/*Reads the code symbols of "avr-nm -n" output, already sorted by address*/
+static int Read_Symbols(FILE *in)
+{
+	char line[256], name[MAX_NAME];
+	char type;
+	unsigned long addr;
+	
+	while(fgets(line, sizeof(line), in) != NULL && Symbol_Count < MAX_SYMBOLS)
+	{
+		if(sscanf(line, "%lx %c %63s", &addr, &type, name) != 3)
+			continue;
+		if(addr >= DATA_START || strchr("tTwW", type) == NULL)
+			continue;
+		
+		Symbols[Symbol_Count].addr = addr;
+		strcpy(Symbols[Symbol_Count].name, name);
+		++Symbol_Count;
+	}
+	
+	return Symbol_Count > 0 ? 0 : -1;
+}
+
+/*Returns the function holding addr, -1 if it's before all of them*/
+static int Find_Symbol(unsigned long addr)
+{
+	int lo = 0, hi = (int)Symbol_Count - 1, mid, found = -1;
+	
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(Symbols[mid].addr <= addr)
+		{
+			found = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+	
+	return found;
+}
+
+/*Adds count samples of a task in a function*/
+static void Add_Sample(unsigned int pid, int symbol, unsigned long count)
+{
+	unsigned int i;
+	
+	for(i = 0; i < Sample_Count; i++)
+	{
+		if(Samples[i].pid == pid && Samples[i].symbol == symbol)
+		{
+			Samples[i].count += count;
+			return;
+		}
+	}
+	
+	if(Sample_Count < MAX_SAMPLES)
+	{
+		Samples[Sample_Count].pid = pid;
+		Samples[Sample_Count].symbol = symbol;
+		Samples[Sample_Count].count = count;
+		++Sample_Count;
+	}
+}
+
+static int By_Count(const void *a, const void *b)
+{
+	const SAMPLE *x = a, *y = b;
+	
+	return (y->count > x->count) - (y->count < x->count);
+}
+
+/*Prints the flat profile of one task, or of all of them merged if all is set*/
+static void Print_Profile(unsigned int pid, int all)
+{
+	SAMPLE merged[MAX_SAMPLES];
+	unsigned int i, j, n = 0;
+	unsigned long total = 0;
+	
+	for(i = 0; i < Sample_Count; i++)
+	{
+		if(!all && Samples[i].pid != pid)
+			continue;
+		
+		for(j = 0; j < n && merged[j].symbol != Samples[i].symbol; j++)
+			;
+		if(j == n)
+		{
+			merged[n] = Samples[i];
+			merged[n++].count = 0;
+		}
+		merged[j].count += Samples[i].count;
+		total += Samples[i].count;
+	}
+	
+	qsort(merged, n, sizeof(SAMPLE), By_Count);
+	
+	if(all)
+		printf("All tasks, %lu samples\n", total);
+	else if(pid == 0)
+		printf("PID 0 (kernel, interrupts disabled), %lu samples\n", total);
+	else
+		printf("PID %u, %lu samples\n", pid, total);
+	
+	for(i = 0; i < n; i++)
+		printf("  %6.2f%% %8lu  %s\n", 100.0 * merged[i].count / total, merged[i].count,
+			merged[i].symbol < 0 ? "??" : Symbols[merged[i].symbol].name);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in;
+	char line[256];
+	unsigned int pid, count, i, j;
+	unsigned long addr;
+	size_t len;
+	int seen;
+	
+	if(argc != 3)
+	{
+		fprintf(stderr, "usage: %s <p2.elf | symbols.txt> <samples.log>\n", argv[0]);
+		return 2;
+	}
+	
+	//Have avr-nm list an ELF file's symbols, or read a list made earlier
+	len = strlen(argv[1]);
+	if(len > 4 && strcmp(argv[1] + len - 4, ".elf") == 0)
+	{
+		snprintf(line, sizeof(line), "avr-nm -n \"%s\"", argv[1]);
+		in = popen(line, "r");
+	}
+	else
+		in = fopen(argv[1], "r");
+	
+	if(in == NULL || Read_Symbols(in) < 0)
+	{
+		fprintf(stderr, "%s: no code symbols found\n", argv[1]);
+		return 2;
+	}
+	
+	in = fopen(argv[2], "r");
+	if(in == NULL)
+	{
+		perror(argv[2]);
+		return 2;
+	}
+	
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+		if(sscanf(line, "PROFILE %u %lx %u", &pid, &addr, &count) == 3)
+			Add_Sample(pid, Find_Symbol(addr), count);
+	}
+	fclose(in);
+	
+	if(Sample_Count == 0)
+	{
+		fprintf(stderr, "%s: no PROFILE lines\n", argv[2]);
+		return 2;
+	}
+	
+	Print_Profile(0, 1);
+	
+	//Then each task that got sampled on its own
+	for(i = 0; i < Sample_Count; i++)
+	{
+		seen = 0;
+		for(j = 0; j < i; j++)
+			seen |= Samples[j].pid == Samples[i].pid;
+		if(!seen)
+			Print_Profile(Samples[i].pid, 0);
+	}
+	
+	return 0;
+}
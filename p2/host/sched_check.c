@@ -0,0 +1,105 @@
+/*
+ * Offline schedulability check of a periodic task set, using the same analysis and
+ * kernel overhead constants as the kernel's admission control (sched_analysis.c).
+ *
+ * Compile using:
+ *   gcc -Wall -I.. -o sched_check sched_check.c ../sched_analysis.c
+ *
+ * Usage:
+ *   ./sched_check taskset.txt
+ *
+ * Each non-empty line of the task set describes one task, '#' starts a comment:
+ *   <name> <fixed|edf> <priority> <period ticks> <deadline ticks> <wcet us> [<critical section us>]
+ * The critical section is the longest one job holds a mutex or reader-writer lock, 0 if left out.
+ * The priority of EDF tasks is ignored, they are analyzed in the EDF_PRIORITY band.
+ * Exits with 0 if the task set is schedulable, 1 if it isn't and 2 on input errors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "../sched_analysis.h"
+
+#define MAX_NAME 32
+
+static SCHED_TASK Set[MAXTHREAD];
+static char Names[MAXTHREAD][MAX_NAME];
+static unsigned long Response[MAXTHREAD];
+
+int main(int argc, char **argv)
+{
+	FILE *in;
+	char line[128];
+	char kind[8];
+	unsigned int pri, line_no = 0;
+	unsigned long period, deadline, wcet, cs;
+	unsigned int n = 0, i;
+	int failed;
+	
+	if(argc != 2)
+	{
+		fprintf(stderr, "usage: %s <taskset file>\n", argv[0]);
+		return 2;
+	}
+	
+	in = fopen(argv[1], "r");
+	if(in == NULL)
+	{
+		perror(argv[1]);
+		return 2;
+	}
+	
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+		++line_no;
+		
+		//Strip comments and skip blank lines
+		line[strcspn(line, "#\n")] = '\0';
+		if(line[strspn(line, " \t\r")] == '\0')
+			continue;
+		
+		if(n == MAXTHREAD)
+		{
+			fprintf(stderr, "%s:%u: more than MAXTHREAD (%d) tasks\n", argv[1], line_no, MAXTHREAD);
+			return 2;
+		}
+		
+		cs = 0;
+		if(sscanf(line, "%31s %7s %u %lu %lu %lu %lu", Names[n], kind, &pri, &period, &deadline, &wcet, &cs) < 6
+			|| (strcmp(kind, "fixed") != 0 && strcmp(kind, "edf") != 0)
+			|| period == 0 || deadline == 0 || deadline > period || pri > MINPRIORITY)
+		{
+			fprintf(stderr, "%s:%u: malformed task\n", argv[1], line_no);
+			return 2;
+		}
+		
+		Set[n].edf = (strcmp(kind, "edf") == 0);
+		Set[n].pri = Set[n].edf ? EDF_PRIORITY : pri;
+		Set[n].period = period * US_PER_TICK;
+		Set[n].deadline = deadline * US_PER_TICK;
+		Set[n].wcet = wcet;
+		Set[n].cs = cs;
+		++n;
+	}
+	fclose(in);
+	
+	failed = Sched_Analyze(Set, n, Response);
+	
+	printf("%-16s %-5s %4s %10s %10s %10s %10s %10s\n", "task", "class", "pri", "period_us", "deadline", "wcet_us", "cs_us", "response");
+	for(i=0; i<n; i++)
+	{
+		printf("%-16s %-5s %4u %10lu %10lu %10lu %10lu ", Names[i], Set[i].edf ? "edf" : "fixed", Set[i].pri, Set[i].period, Set[i].deadline, Set[i].wcet, Set[i].cs);
+		if(Response[i] == 0)
+			printf("%10s\n", "MISS");
+		else
+			printf("%10lu\n", Response[i]);
+	}
+	
+	if(failed != -1)
+	{
+		printf("UNSCHEDULABLE: %s can miss its deadline\n", Names[failed]);
+		return 1;
+	}
+	
+	printf("SCHEDULABLE\n");
+	return 0;
+}
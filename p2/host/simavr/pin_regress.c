@@ -0,0 +1,348 @@
+/*
+ * Runs a test firmware in simavr and checks the PORTB pulses of its tasks against a stored baseline.
+ * Used by run_regress.sh, which builds every provided test and runs it through this.
+ *
+ * Compile using (needs simavr and libelf):
+ *   gcc -std=gnu99 -O2 -Wall -o pin_regress pin_regress.c -lsimavr -lelf
+ *
+ * Usage:
+ *   ./pin_regress [-m ms] [-v trace.vcd] [-p percent] [-s] [-u] firmware.elf baseline.txt
+ *
+ * The tests pulse PB1-PB3 whenever a task gets to run, which used to be checked on a logic analyzer. Here every rising
+ * edge is logged with the cycle it happened at while the firmware runs for -m simulated milliseconds (default 2000),
+ * and -v also writes PB1-PB3 to a VCD file for gtkwave.
+ *
+ * The baseline file holds, '#' starting a comment:
+ *   order <pin> <pin> ...		The pins of the first rising edges, in the order they must happen
+ *   gaps <cycles> <cycles> ...	Cycles between each of those edges and the next one
+ * The run fails if the edges come in a different order, or if any gap grew by more than -p percent (default 10).
+ * Faster is fine, and is reported so the baseline can be refreshed. -u writes the baseline from this run instead of
+ * checking it, keeping the number of edges in an existing baseline.
+ * A baseline without a gap for every pair of edges can't catch a timing regression there. That's reported with a
+ * warning and exit code 3, or as a failure with -s. Gaps can only be recorded where avr-gcc and simavr are installed.
+ * Exits with 0 if the run matches, 1 if it doesn't, 2 on errors and 3 if only its order could be checked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/sim_vcd_file.h>
+
+#define MCU "atmega2560"
+#define CPU_HZ 16000000UL			//The board's clock, used when the firmware doesn't say
+#define FIRST_PIN 1					//PB1-PB3 are pins 52-50 on the board
+#define LAST_PIN 3
+#define MAX_EDGES 1024				//Edges kept. A task pulsing in a loop goes on forever
+#define DEFAULT_EDGES 16			//Edges put in a new baseline
+
+typedef struct edge
+{
+	unsigned char pin;
+	avr_cycle_count_t cycle;
+} EDGE;
+
+static avr_t *Avr;
+static EDGE Edges[MAX_EDGES];
+static unsigned int Edge_Count;
+
+static unsigned char Base_Order[MAX_EDGES];
+static unsigned long Base_Gaps[MAX_EDGES];
+static unsigned int Base_Count;			//Edges in the baseline's order line
+static unsigned int Base_Gap_Count;		//Entries in its gaps line, 0 = none recorded yet
+
+/*Called by simavr whenever one of the watched pins changes*/
+static void Pin_Changed(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	
+	if(value && Edge_Count < MAX_EDGES)
+	{
+		Edges[Edge_Count].pin = (unsigned char)(unsigned long)param;
+		Edges[Edge_Count].cycle = Avr->cycle;
+		++Edge_Count;
+	}
+}
+
+/*Reads the baseline. A missing file is an empty baseline, which only -u accepts*/
+static int Read_Baseline(const char *path)
+{
+	FILE *in = fopen(path, "r");
+	char line[4096];
+	char *tok;
+	
+	if(in == NULL)
+		return 0;
+	
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+		if((tok = strchr(line, '#')) != NULL)
+			*tok = '\0';
+		
+		tok = strtok(line, " \t\r\n");
+		if(tok == NULL)
+			continue;
+		
+		if(strcmp(tok, "order") == 0)
+		{
+			while((tok = strtok(NULL, " \t\r\n")) != NULL && Base_Count < MAX_EDGES)
+				Base_Order[Base_Count++] = (unsigned char)atoi(tok);
+		}
+		else if(strcmp(tok, "gaps") == 0)
+		{
+			while((tok = strtok(NULL, " \t\r\n")) != NULL && Base_Gap_Count < MAX_EDGES)
+				Base_Gaps[Base_Gap_Count++] = strtoul(tok, NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "%s: unknown line '%s'\n", path, tok);
+			fclose(in);
+			return -1;
+		}
+	}
+	
+	fclose(in);
+	return 0;
+}
+
+/*Writes the first n edges of this run as the new baseline*/
+static int Write_Baseline(const char *path, const char *firmware, unsigned int n)
+{
+	FILE *out = fopen(path, "w");
+	unsigned int i;
+	
+	if(out == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	
+	fprintf(out, "# Baseline of %s, written by pin_regress -u\n", firmware);
+	fprintf(out, "order");
+	for(i = 0; i < n; i++)
+		fprintf(out, " %u", Edges[i].pin);
+	fprintf(out, "\ngaps");
+	for(i = 0; i + 1 < n; i++)
+		fprintf(out, " %lu", (unsigned long)(Edges[i+1].cycle - Edges[i].cycle));
+	fprintf(out, "\n");
+	
+	fclose(out);
+	return 0;
+}
+
+/*Prints the pins of n edges, and the run order they add up to (consecutive pulses of the same task are one run)*/
+static void Print_Order(const char *what, const unsigned char *pins, unsigned int stride, unsigned int n)
+{
+	unsigned int i;
+	
+	printf("%s:", what);
+	for(i = 0; i < n; i++)
+		printf(" %u", pins[i * stride]);
+	
+	printf("  (runs:");
+	for(i = 0; i < n; i++)
+	{
+		if(i == 0 || pins[i * stride] != pins[(i - 1) * stride])
+			printf("%sP%u", i == 0 ? " " : ",", pins[i * stride]);
+	}
+	printf(")\n");
+}
+
+/*Reports the time between edges: all of them, and just the ones where another task took over*/
+static void Print_Metrics(unsigned int n, unsigned long hz)
+{
+	unsigned long gap, min = ~0UL, max = 0, sw_min = ~0UL, sw_max = 0;
+	unsigned long long sum = 0, sw_sum = 0;
+	unsigned int i, switches = 0;
+	double secs;
+	
+	if(n < 2)
+		return;
+	
+	for(i = 0; i + 1 < n; i++)
+	{
+		gap = Edges[i+1].cycle - Edges[i].cycle;
+		sum += gap;
+		if(gap < min) min = gap;
+		if(gap > max) max = gap;
+		
+		if(Edges[i+1].pin != Edges[i].pin)
+		{
+			++switches;
+			sw_sum += gap;
+			if(gap < sw_min) sw_min = gap;
+			if(gap > sw_max) sw_max = gap;
+		}
+	}
+	
+	printf("edge gaps: min %lu, avg %llu, max %lu cycles\n", min, sum / (n - 1), max);
+	if(switches > 0)
+		printf("task changes: %u, latency min %lu, avg %llu, max %lu cycles (%.1f us avg)\n",
+			switches, sw_min, sw_sum / switches, sw_max, (double)sw_sum / switches * 1e6 / hz);
+	
+	secs = (double)(Edges[n-1].cycle - Edges[0].cycle) / hz;
+	if(secs > 0)
+		printf("throughput: %.1f edges/s\n", (n - 1) / secs);
+}
+
+int main(int argc, char **argv)
+{
+	elf_firmware_t fw;
+	avr_vcd_t vcd;
+	const char *vcd_path = NULL;
+	const char *firmware, *baseline;
+	unsigned long ms = 2000, percent = 10;
+	unsigned long gap, limit;
+	unsigned int i, n;
+	int update = 0, strict = 0, failed = 0, state, opt;
+	char name[8];
+	
+	while((opt = getopt(argc, argv, "m:v:p:su")) != -1)
+	{
+		switch(opt)
+		{
+			case 'm': ms = strtoul(optarg, NULL, 0); break;
+			case 'v': vcd_path = optarg; break;
+			case 'p': percent = strtoul(optarg, NULL, 0); break;
+			case 's': strict = 1; break;
+			case 'u': update = 1; break;
+			default:
+			fprintf(stderr, "usage: %s [-m ms] [-v trace.vcd] [-p percent] [-s] [-u] firmware.elf baseline.txt\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	if(argc - optind != 2)
+	{
+		fprintf(stderr, "usage: %s [-m ms] [-v trace.vcd] [-p percent] [-s] [-u] firmware.elf baseline.txt\n", argv[0]);
+		return 2;
+	}
+	firmware = argv[optind];
+	baseline = argv[optind + 1];
+	
+	if(Read_Baseline(baseline) < 0)
+		return 2;
+	
+	memset(&fw, 0, sizeof(fw));
+	if(elf_read_firmware(firmware, &fw) != 0)
+	{
+		fprintf(stderr, "%s: can't read firmware\n", firmware);
+		return 2;
+	}
+	
+	Avr = avr_make_mcu_by_name(MCU);
+	if(Avr == NULL)
+	{
+		fprintf(stderr, "simavr doesn't know the " MCU "\n");
+		return 2;
+	}
+	avr_init(Avr);
+	if(fw.frequency == 0)
+		fw.frequency = CPU_HZ;
+	avr_load_firmware(Avr, &fw);
+	
+	if(vcd_path != NULL)
+		avr_vcd_init(Avr, vcd_path, &vcd, 1);
+	
+	for(i = FIRST_PIN; i <= LAST_PIN; i++)
+	{
+		avr_irq_t *irq = avr_io_getirq(Avr, AVR_IOCTL_IOPORT_GETIRQ('B'), i);
+		
+		avr_irq_register_notify(irq, Pin_Changed, (void *)(unsigned long)i);
+		if(vcd_path != NULL)
+		{
+			snprintf(name, sizeof(name), "PB%u", i);
+			avr_vcd_add_signal(&vcd, irq, 1, name);
+		}
+	}
+	
+	if(vcd_path != NULL)
+		avr_vcd_start(&vcd);
+	
+	limit = Avr->frequency / 1000 * ms;
+	do
+	{
+		state = avr_run(Avr);
+	} while(Avr->cycle < limit && state != cpu_Done && state != cpu_Crashed);
+	
+	if(vcd_path != NULL)
+		avr_vcd_stop(&vcd);
+	
+	if(state == cpu_Crashed)
+	{
+		fprintf(stderr, "%s: crashed after %llu cycles\n", firmware, (unsigned long long)Avr->cycle);
+		return 1;
+	}
+	
+	printf("%s: %u rising edges in %lu ms\n", firmware, Edge_Count, ms);
+	
+	if(update)
+	{
+		n = Base_Count > 0 ? Base_Count : DEFAULT_EDGES;
+		if(n > Edge_Count)
+			n = Edge_Count;
+		Print_Order("recorded", &Edges[0].pin, sizeof(EDGE), n);
+		Print_Metrics(n, Avr->frequency);
+		return Write_Baseline(baseline, firmware, n) < 0 ? 2 : 0;
+	}
+	
+	if(Base_Count == 0)
+	{
+		fprintf(stderr, "%s: no order in the baseline, run with -u to record one\n", baseline);
+		return 2;
+	}
+	
+	n = Edge_Count < Base_Count ? Edge_Count : Base_Count;
+	Print_Order("expected", Base_Order, 1, Base_Count);
+	Print_Order("actual  ", &Edges[0].pin, sizeof(EDGE), n);
+	Print_Metrics(n, Avr->frequency);
+	
+	if(Edge_Count < Base_Count)
+	{
+		printf("FAIL: only %u of %u edges\n", Edge_Count, Base_Count);
+		failed = 1;
+	}
+	
+	for(i = 0; i < n; i++)
+	{
+		if(Edges[i].pin != Base_Order[i])
+		{
+			printf("FAIL: edge %u is PB%u, expected PB%u\n", i, Edges[i].pin, Base_Order[i]);
+			failed = 1;
+			break;
+		}
+	}
+	
+	//Timing is only comparable while the order matches
+	for(i = 0; !failed && i + 1 < n && i < Base_Gap_Count; i++)
+	{
+		gap = Edges[i+1].cycle - Edges[i].cycle;
+		
+		if(gap > Base_Gaps[i] + Base_Gaps[i] * percent / 100)
+		{
+			printf("FAIL: edges %u-%u took %lu cycles, baseline %lu\n", i, i + 1, gap, Base_Gaps[i]);
+			failed = 1;
+		}
+		else if(gap < Base_Gaps[i] - Base_Gaps[i] * percent / 100)
+			printf("note: edges %u-%u took %lu cycles, baseline %lu. Refresh the baseline with -u\n", i, i + 1, gap, Base_Gaps[i]);
+	}
+	
+	if(Base_Gap_Count + 1 < Base_Count)
+	{
+		printf("%s: %s has %u of %u gaps, edges past them were only checked for order. Record them with run_regress.sh -u\n",
+			strict ? "FAIL" : "WARNING", baseline, Base_Gap_Count, Base_Count - 1);
+		if(strict)
+			failed = 1;
+		else if(!failed)
+		{
+			printf("PASS (order only)\n");
+			return 3;
+		}
+	}
+	
+	printf("%s\n", failed ? "FAIL" : "PASS");
+	return failed;
+}
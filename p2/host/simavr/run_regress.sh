@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Builds each provided test for the ATmega2560, runs it in simavr and checks the order and timing of its PORTB pulses
+# against host/simavr/baselines. See pin_regress.c for the baseline format.
+#
+# Usage (from p2/, needs avr-gcc, simavr and libelf, except for -h):
+#   host/simavr/run_regress.sh [-u | -s | -h]
+#
+# -u records new baselines from this build instead of checking against them, including the gaps between edges. The
+# VCD of each run is left in build/regress for gtkwave. Exits with 1 if any test doesn't match its baseline.
+#
+# A baseline without gaps only checks the order of the pulses, so timing regressions go unnoticed. Those tests
+# are listed in a warning at the end, and -s fails them instead. The checked-in baselines were written by hand
+# without simavr, so they have no gaps yet. Record them with -u on a machine with avr-gcc and simavr, check that
+# the order lines didn't change, and commit the result.
+#
+# -h only checks the order lines, with the tests built for the host port with HOST_PIN_TRACE and run by node_sim
+# instead of simavr. It needs nothing but gcc. The host port has no cycle times, so the gaps aren't looked at, and
+# its ticks are in virtual time: a test whose order depends on how long its tasks spin may differ from the board.
+#
+
+TESTS="test1_provided test2_provided test_priority_inheritance"
+OUT=build/regress
+BASE=host/simavr/baselines
+MCU=atmega2560
+
+UPDATE=
+STRICT=
+if [ "$1" = "-u" ]; then
+	UPDATE=-u
+elif [ "$1" = "-s" ]; then
+	STRICT=-s
+fi
+
+mkdir -p $OUT || exit 2
+
+if [ "$1" = "-h" ]; then
+	failed=0
+	for t in $TESTS; do
+		gcc -std=gnu99 -O2 -w -DHOST_PORT -DHOST_PIN_TRACE -Dmain=Host_Node_Main -Ihost/port -o $OUT/$t.host \
+			host/port/node_sim.c host/port/host_port.c kernel.c os.c sched_analysis.c $t.c || exit 2
+		want=$(sed -n 's/^order //p' $BASE/$t.txt)
+		got=$(timeout 20 $OUT/$t.host 2>/dev/null | sed -n 's/^PIN //p' | head -n $(echo $want | wc -w))
+		if [ "$(echo $got)" = "$(echo $want)" ]; then
+			echo "$t: order matches"
+		else
+			echo "$t: order" $got "differs from baseline" $want
+			failed=1
+		fi
+	done
+	exit $failed
+fi
+
+gcc -std=gnu99 -O2 -Wall -o $OUT/pin_regress host/simavr/pin_regress.c -lsimavr -lelf || exit 2
+
+failed=0
+untimed=
+for t in $TESTS; do
+	echo "== $t"
+	avr-gcc -mmcu=$MCU -DF_CPU=16000000UL -std=gnu99 -Os -o $OUT/$t.elf \
+		kernel.c os.c sched_analysis.c -x assembler-with-cpp cswitch.s -x none $t.c || exit 2
+	$OUT/pin_regress $UPDATE $STRICT -v $OUT/$t.vcd $OUT/$t.elf $BASE/$t.txt
+	case $? in
+		0) ;;
+		3) untimed="$untimed $t" ;;
+		*) failed=1 ;;
+	esac
+done
+
+if [ -n "$untimed" ]; then
+	echo "WARNING: only the pin order was checked for:$untimed"
+	echo "WARNING: their baselines have no gaps, record them with $0 -u"
+fi
+
+exit $failed
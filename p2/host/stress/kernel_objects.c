@@ -0,0 +1,1289 @@
+/*
+ * Scenario tests of the kernel objects the reference model in kernel_stress.c doesn't cover.
+ *
+ * Compile using (from p2/):
+ *   gcc -std=gnu99 -O2 -DHOST_PORT -Dmain=Host_Node_Main -Ihost/port -o kernel_objects \
+ *       host/stress/kernel_objects.c host/port/host_port.c os.c sched_analysis.c
+ *
+ * Usage:
+ *   ./kernel_objects [test...]
+ *
+ * Runs the named tests, or all of them. Each test boots the real kernel.c on the host port with tasks of its own, which
+ * check what the kernel did with CHECK(). Ticks only fire when a task calls Tick() or sets Host_Tick_Pending, or the kernel idles, so every run
+ * is the same. A test passes when one of its tasks calls Pass(), and fails on the first CHECK() that doesn't hold or if
+ * it's still going after TEST_TICKS ticks. The exit code is the number of failed tests. Build with -DADMISSION_CONTROL
+ * as well to include the admission control tests, or with -DSTATIC_OBJECTS to run the static objects test instead of the others.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+//Count what the instrumentation hooks see
+static void *Hook_Out;				//Last task switched out
+static unsigned long Hook_Ins, Hook_Same;
+static int Hook_Blocked;			//Tasks blocked minus tasks unblocked
+#define SWITCH_OUT_HOOK(p, request)		(Hook_Out = (p))
+#define SWITCH_IN_HOOK(p, request)		(++Hook_Ins, Hook_Same += ((void *)(p) == Hook_Out))
+#define BLOCK_HOOK(p, request)			(++Hook_Blocked)
+#define UNBLOCK_HOOK(p, request)		(--Hook_Blocked)
+
+#include "../../kernel.c"			//White box: the checks read the kernel's own tables
+
+#undef main
+
+#define TEST_TICKS 1000				//A test still running after this many ticks is stuck
+#define BOOT_STACK_SIZE 262144
+
+#define CHECK(c) do { if(!(c)) Fail(#c, __LINE__); } while(0)
+
+typedef struct
+{
+	const char *name;
+	void (*setup)(void);			//Creates the test's objects and tasks before the kernel starts
+} TEST;
+
+static const TEST *Current;
+static unsigned long Start_Ticks;
+static char Log[64];				//What the tasks of a test did, in order
+static unsigned int Log_Len;
+static ucontext_t Main_Ctx, Boot_Ctx;
+static char Boot_Stack[BOOT_STACK_SIZE];
+static int Failed;
+
+void a_main(void)
+{
+}
+
+/*Abandons the kernel and all tasks of the test*/
+static void Fail(const char *what, int line)
+{
+	printf("FAIL %s: line %d: %s (log \"%s\")\n", Current->name, line, what, Log);
+	Failed = 1;
+	setcontext(&Main_Ctx);
+}
+
+static void Pass(void)
+{
+	setcontext(&Main_Ctx);
+}
+
+/*Fires the tick interrupt from a task, which enters the kernel like it does on the board*/
+static void Tick(void)
+{
+	Disable_Interrupt();
+	Host_Tick();
+	Enable_Interrupt();
+}
+
+static void Log_Add(char c)
+{
+	if(Log_Len < sizeof(Log) - 1)
+		Log[Log_Len++] = c;
+}
+
+void Host_On_Tick(void)
+{
+	if(Host_Ticks - Start_Ticks >= TEST_TICKS)
+		Fail("still running after TEST_TICKS ticks", 0);
+}
+
+/************************************************************************/
+/*                          INSTRUMENTATION HOOKS                       */
+/************************************************************************/
+
+static EVENT_GROUP Hooks_Group;
+static EVENT Hooks_Event;
+static MUTEX Hooks_Mutex;
+static COND Hooks_Cond;
+
+static void Hooks_Waiter(void)
+{
+	CHECK(EventGroup_Wait(Hooks_Group, 1, EG_WAIT_ANY, 2) == 0);
+	Log_Add('t');
+	Event_Wait(Hooks_Event);
+	Log_Add('e');
+	Mutex_Lock(Hooks_Mutex);
+	Cond_Wait(Hooks_Cond, Hooks_Mutex);
+	Log_Add('c');
+	Mutex_Unlock(Hooks_Mutex);
+}
+
+/*Each block is matched by an unblock, whether the wait times out or the waiter is suspended, and switches are real*/
+static void Hooks_Task(void)
+{
+	PID waiter;
+	PD *w;
+	unsigned long ins;
+
+	Hooks_Group = EventGroup_Init();
+	Hooks_Event = Event_Init();
+	Hooks_Mutex = Mutex_Init();
+	Hooks_Cond = Cond_Init();
+	waiter = Task_Create(Hooks_Waiter, 1, 0);
+	w = findProcessByPID(waiter);
+	Task_Yield();
+	CHECK(Hook_Blocked == 1);
+
+	//A syscall that doesn't switch tasks isn't a switch
+	ins = Hook_Ins;
+	Event_Init();
+	CHECK(Hook_Ins == ins);
+
+	//The event group wait times out
+	Tick();
+	Tick();
+	CHECK(strcmp(Log, "t") == 0);
+	CHECK(Hook_Blocked == 1);
+
+	//The event comes while the waiter is suspended
+	Task_Suspend(waiter);
+	Event_Signal(Hooks_Event);
+	CHECK(Hook_Blocked == 0);
+	CHECK(w->state == SUSPENDED && w->last_state == READY);
+	Task_Resume(waiter);
+	CHECK(strcmp(Log, "te") == 0);
+
+	//The condition variable is signalled while the waiter is suspended, and it keeps waiting for the mutex
+	Mutex_Lock(Hooks_Mutex);
+	Task_Suspend(waiter);
+	Cond_Signal(Hooks_Cond);
+	CHECK(w->state == SUSPENDED && w->last_state == WAIT_MUTEX);
+	CHECK(Hook_Blocked == 1);
+	Mutex_Unlock(Hooks_Mutex);
+	CHECK(w->state == SUSPENDED && w->last_state == READY);
+	CHECK(Hook_Blocked == 0);
+	Task_Resume(waiter);
+
+	CHECK(strcmp(Log, "tec") == 0);
+	CHECK(Hook_Same == 0);
+	Pass();
+}
+
+static void Test_Hooks(void)
+{
+	Hook_Ins = Hook_Same = 0;
+	Hook_Out = NULL;
+	Hook_Blocked = 0;
+	Task_Create(Hooks_Task, 2, 0);
+}
+
+/************************************************************************/
+/*                                TIMERS                                */
+/************************************************************************/
+
+static TIMER Timer_A, Timer_B, Timer_C;
+
+static void Timer_Log(int arg)
+{
+	Log_Add(arg);
+}
+
+/*Runs in the timer task, which stays busy while A and B expire. A is then stopped and restarted, and expires again*/
+static void Timer_Busy(int arg)
+{
+	Log_Add(arg);
+	Tick();
+	Tick();
+	CHECK(Timer[Timer_A - 1].fired == 1 && Timer[Timer_B - 1].fired == 1);
+
+	Timer_Stop(Timer_A);
+	CHECK(Timer[Timer_A - 1].fired == 0);
+	Timer_Start(Timer_A);
+	Tick();
+	Tick();
+	CHECK(Timer[Timer_A - 1].fired == 1);
+}
+
+static void Timer_Restart_Task(void)
+{
+	Timer_C = Timer_Create(Timer_Busy, 'C', 1, 0);
+	Timer_A = Timer_Create(Timer_Log, 'A', 2, 0);
+	Timer_B = Timer_Create(Timer_Log, 'B', 2, 0);
+	Task_Yield();					//The timer task waits for the first expiry
+
+	Timer_Start(Timer_C);
+	Timer_Start(Timer_A);
+	Timer_Start(Timer_B);
+	Tick();
+
+	//The restarted A must not be queued twice, which cut B off the list of expired timers
+	CHECK(strcmp(Log, "CBA") == 0);
+	CHECK(Timer_Fired_Head == -1);
+	Pass();
+}
+
+static void Test_Timer_Restart(void)
+{
+	Task_Create(Timer_Restart_Task, 1, 0);
+}
+
+/************************************************************************/
+/*                             PROTOTHREADS                             */
+/************************************************************************/
+
+#define PT_PRIORITY 2
+
+static PT Pt_Bits, Pt_Note, Pt_Once, Pt_Restarter;
+static EVENT_GROUP Pt_Group;
+
+static char Pt_Bits_Func(PT *pt)
+{
+	PT_BEGIN(pt);
+	PT_WAIT_BITS(pt, Pt_Group, 0x6);
+	Log_Add(pt->mask == 0x4 ? 'g' : '?');
+	PT_END(pt);
+}
+
+static char Pt_Note_Func(PT *pt)
+{
+	PT_BEGIN(pt);
+	PT_WAIT_NOTIFY(pt, 0x1);
+	Log_Add(pt->mask == 0x1 ? 'n' : '?');
+	PT_END(pt);
+}
+
+static char Pt_Once_Func(PT *pt)
+{
+	PT_BEGIN(pt);
+	Log_Add('o');
+	PT_END(pt);
+}
+
+/*Starts Pt_Once again right after it ended, before the runner unlinked it*/
+static char Pt_Restarter_Func(PT *pt)
+{
+	PT_BEGIN(pt);
+	PT_Create(&Pt_Once, Pt_Once_Func, PT_PRIORITY);
+	Log_Add(err == NO_ERR ? 'r' : '?');
+	PT_END(pt);
+}
+
+/*Protothreads wait for event group bits and notifications without polling, and can't be linked twice*/
+static void Protothread_Task(void)
+{
+	PD *runner;
+	PT *pt;
+	int n;
+
+	Pt_Group = EventGroup_Init();
+	PT_Create(&Pt_Bits, Pt_Bits_Func, PT_PRIORITY);
+	PT_Create(&Pt_Note, Pt_Note_Func, PT_PRIORITY);
+	PT_Create(&Pt_Once, Pt_Once_Func, PT_PRIORITY);
+	CHECK(err == NO_ERR);
+	runner = findProcessByPID(PT_GetRunner(PT_PRIORITY));
+	CHECK(runner != NULL);
+
+	//Still waiting to run
+	PT_Create(&Pt_Bits, Pt_Bits_Func, PT_PRIORITY);
+	CHECK(err == INVALID_ARG_ERR);
+
+	Task_Yield();
+	CHECK(strcmp(Log, "o") == 0);
+	CHECK(runner->state == WAIT_PT && runner->wait_ticks == 0);
+
+	//Bits nobody waits for only make the runner look
+	EventGroup_Set(Pt_Group, 0x1);
+	CHECK(strcmp(Log, "o") == 0);
+	CHECK(runner->state == WAIT_PT);
+	EventGroup_Set(Pt_Group, 0x4);
+	CHECK(strcmp(Log, "og") == 0);
+	CHECK(EventGroup_Get(Pt_Group) == 0x5);
+
+	Task_Notify(runner->pid, 0x3, NOTIFY_SET_BITS);
+	CHECK(strcmp(Log, "ogn") == 0);
+	CHECK(runner->notify_value == 0x2);
+
+	//Pt_Once is done and unlinked, then done and still linked when Pt_Restarter starts it again
+	PT_Create(&Pt_Restarter, Pt_Restarter_Func, PT_PRIORITY);
+	PT_Create(&Pt_Once, Pt_Once_Func, PT_PRIORITY);
+	Task_Yield();
+	CHECK(strcmp(Log, "ognoro") == 0);
+
+	for(n = 0, pt = (PT *)PT_List[PT_PRIORITY]; pt != NULL && n < 8; pt = pt->next, n++);
+	CHECK(n < 8);
+	Pass();
+}
+
+static void Test_Protothreads(void)
+{
+	Task_Create(Protothread_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                              BASIC TASKS                             */
+/************************************************************************/
+
+#define BASIC_PRIORITY 2
+
+static MUTEX Basic_Mutex, Basic_Free;
+static EVENT Basic_Event, Basic_Wake;
+
+/*Every call that may wait fails instead of blocking the runner. The main task holds Basic_Mutex*/
+static void Basic_Blocker(int arg)
+{
+	Mutex_Lock(Basic_Mutex);
+	Log_Add(err == BASIC_BLOCKING_ERR ? 'b' : '?');
+	Event_Wait(Basic_Event);
+	Log_Add(err == BASIC_BLOCKING_ERR ? 'b' : '?');
+	Task_Sleep(5);
+	Log_Add(err == BASIC_BLOCKING_ERR ? 'b' : '?');
+	Log_Add(Task_NotifyWait(0x1, 0) == 0 && err == BASIC_BLOCKING_ERR ? 'b' : '?');
+	Log_Add(Task_Join(Cp->pid, 0) == 0 && err == BASIC_BLOCKING_ERR ? 'b' : '?');
+}
+
+static void Basic_Terminator(int arg)
+{
+	Log_Add('x');
+	Task_Terminate();
+	Log_Add('?');
+}
+
+/*Takes a free mutex, and returns still holding it after a more important task started waiting for it. The basic task in its arg runs next*/
+static void Basic_Locker(int arg)
+{
+	Mutex_Lock(Basic_Free);
+	Mutex_Lock(Basic_Free);
+	Log_Add(err == NO_ERR ? 'm' : '?');
+	Mutex_Unlock(Basic_Free);
+	Event_Signal(Basic_Wake);
+	Log_Add(Cp->pri == 1 ? 'r' : '?');
+	Task_Activate(arg);
+}
+
+static void Basic_Waiter(void)
+{
+	Event_Wait(Basic_Wake);
+	Mutex_Lock(Basic_Free);
+	Log_Add('w');
+	Mutex_Unlock(Basic_Free);
+}
+
+static void Basic_Task_Test(void)
+{
+	BASIC blocker, terminator, locker;
+	PID runner;
+
+	Basic_Mutex = Mutex_Init();
+	Basic_Free = Mutex_Init();
+	Basic_Event = Event_Init();
+	Basic_Wake = Event_Init();
+	blocker = Task_Create_Basic(Basic_Blocker, BASIC_PRIORITY, 0);
+	terminator = Task_Create_Basic(Basic_Terminator, BASIC_PRIORITY, 0);
+	locker = Task_Create_Basic(Basic_Locker, BASIC_PRIORITY, blocker);
+	CHECK(blocker != 0 && terminator != 0 && locker != 0);
+	runner = Basic_Runner[BASIC_PRIORITY]->pid;
+
+	Mutex_Lock(Basic_Mutex);
+	Task_Activate(blocker);
+	CHECK(strcmp(Log, "bbbbb") == 0);
+	CHECK(Basic_Runner[BASIC_PRIORITY]->state == WAIT_BASIC);
+
+	//Terminating only ends the activation, a new runner takes the next one
+	Task_Activate(terminator);
+	CHECK(strcmp(Log, "bbbbbx") == 0);
+	CHECK(Basic_Runner[BASIC_PRIORITY] != NULL && Basic_Runner[BASIC_PRIORITY]->pid != runner);
+	Task_Activate(blocker);
+	CHECK(strcmp(Log, "bbbbbxbbbbb") == 0);
+	CHECK(Basic_Runner[BASIC_PRIORITY]->state == WAIT_BASIC);
+
+	//A mutex left locked by an activation goes to its waiter once the activation returns, which runs before the next one
+	Task_Create(Basic_Waiter, 1, 0);
+	Task_Yield();
+	Task_Activate(locker);
+	CHECK(strcmp(Log, "bbbbbxbbbbbmrwbbbbb") == 0);
+	CHECK(findMutexByMutexID(Basic_Free)->owner == 0);
+	CHECK(Basic_Runner[BASIC_PRIORITY]->pri == BASIC_PRIORITY && Basic_Runner[BASIC_PRIORITY]->state == WAIT_BASIC);
+
+	//Other tasks are unaffected
+	Mutex_Unlock(Basic_Mutex);
+	Mutex_Lock(Basic_Free);
+	CHECK(err == NO_ERR);
+	Pass();
+}
+
+static void Test_Basic_Tasks(void)
+{
+	Task_Create(Basic_Task_Test, 3, 0);
+}
+
+/************************************************************************/
+/*                          READER-WRITER LOCKS                         */
+/************************************************************************/
+
+static RWLOCK Rw_Lock;
+static EVENT Rw_Event;
+
+/*Shares the lock with the main task, and keeps it until Rw_Event*/
+static void Rw_Slow_Reader(void)
+{
+	RWLock_ReadLock(Rw_Lock);
+	Log_Add('a');
+	Event_Wait(Rw_Event);
+	Log_Add('c');
+	RWLock_Unlock(Rw_Lock);
+	Log_Add('d');
+}
+
+static void Rw_Writer(void)
+{
+	RWLock_WriteLock(Rw_Lock);
+	Log_Add('w');
+	RWLock_Unlock(Rw_Lock);
+}
+
+static void Rw_Late_Reader(void)
+{
+	RWLock_ReadLock(Rw_Lock);
+	Log_Add('b');
+	RWLock_Unlock(Rw_Lock);
+}
+
+static void Rw_Quitter(void)
+{
+	RWLock_ReadLock(Rw_Lock);
+	Task_Terminate();
+}
+
+/*Readers share the lock, a waiting writer keeps new readers out and goes first, and every holder inherits from the waiters*/
+static void RWLock_Task(void)
+{
+	RWLOCK_TYPE *l;
+	PID me = Cp->pid;
+	PID slow, writer, late;
+
+	Rw_Lock = RWLock_Init();
+	Rw_Event = Event_Init();
+	l = findRWLockByID(Rw_Lock);
+
+	RWLock_ReadLock(Rw_Lock);
+	slow = Task_Create(Rw_Slow_Reader, 3, 0);
+	Task_Yield();
+	CHECK(strcmp(Log, "a") == 0);
+	CHECK(l->readers == (((THREAD_MASK)1 << (Cp - Process)) | ((THREAD_MASK)1 << (findProcessByPID(slow) - Process))));
+
+	//Both readers run at the writer's priority until it gets in
+	writer = Task_Create(Rw_Writer, 1, 0);
+	Task_Yield();
+	CHECK(findProcessByPID(writer)->state == WAIT_RWLOCK);
+	CHECK(Task_GetEffectivePriority(me) == 1 && Task_GetEffectivePriority(slow) == 1);
+
+	//Readers that come after the writer wait, even at a higher priority
+	late = Task_Create(Rw_Late_Reader, 0, 0);
+	Task_Yield();
+	CHECK(findProcessByPID(late)->state == WAIT_RWLOCK);
+	CHECK(Task_GetEffectivePriority(me) == 0);
+
+	RWLock_Unlock(Rw_Lock);
+	CHECK(Task_GetEffectivePriority(me) == 5);
+	CHECK(strcmp(Log, "a") == 0);
+
+	//The last reader out lets the writer in, then the late reader
+	Event_Signal(Rw_Event);
+	CHECK(strcmp(Log, "acwbd") == 0);
+	CHECK(l->writer == 0 && l->readers == 0 && l->read_waiters == 0 && l->write_waiters == 0);
+
+	//Unlocking a lock we don't hold
+	RWLock_Unlock(Rw_Lock);
+	CHECK(err == RWLOCK_NOT_HELD_ERR);
+
+	//A reader that terminates lets go of the lock
+	Task_Create(Rw_Quitter, 3, 0);
+	Task_Yield();
+	CHECK(l->readers == 0);
+	RWLock_WriteLock(Rw_Lock);
+	CHECK(err == NO_ERR && l->writer == me);
+	Pass();
+}
+
+static void Test_RWLocks(void)
+{
+	Task_Create(RWLock_Task, 5, 0);
+}
+
+/************************************************************************/
+/*                          CONDITION VARIABLES                         */
+/************************************************************************/
+
+static MUTEX Cv_Mutex;
+static COND Cv_Cond;
+
+/*Waits holding the mutex twice, and gets both locks back. The arg is logged*/
+static void Cv_Waiter(void)
+{
+	Mutex_Lock(Cv_Mutex);
+	Mutex_Lock(Cv_Mutex);
+	Cond_Wait(Cv_Cond, Cv_Mutex);
+	Log_Add(findMutexByMutexID(Cv_Mutex)->count == 2 ? Task_GetArg() : '?');
+	Mutex_Unlock(Cv_Mutex);
+	Mutex_Unlock(Cv_Mutex);
+}
+
+/*A signal wakes the highest priority waiter, a broadcast all of them, and each relocks the mutex in priority order*/
+static void Cond_Task(void)
+{
+	COND_TYPE *c;
+	PID a, b, d;
+	THREAD_MASK waiters = 0;
+
+	Cv_Mutex = Mutex_Init();
+	Cv_Cond = Cond_Init();
+	c = findCondByID(Cv_Cond);
+
+	Cond_Signal(Cv_Cond);
+	CHECK(err == NO_ERR);
+
+	d = Task_Create(Cv_Waiter, 3, 'C');
+	a = Task_Create(Cv_Waiter, 1, 'A');
+	b = Task_Create(Cv_Waiter, 2, 'B');
+	waiters |= (THREAD_MASK)1 << (findProcessByPID(a) - Process);
+	waiters |= (THREAD_MASK)1 << (findProcessByPID(b) - Process);
+	waiters |= (THREAD_MASK)1 << (findProcessByPID(d) - Process);
+	Task_Yield();
+	CHECK(c->waiters == waiters);
+	CHECK(findMutexByMutexID(Cv_Mutex)->owner == 0);
+
+	Cond_Signal(Cv_Cond);
+	CHECK(strcmp(Log, "A") == 0);
+
+	//Woken while we hold the mutex, the others wait for it and lend us their priority
+	Mutex_Lock(Cv_Mutex);
+	Cond_Broadcast(Cv_Cond);
+	CHECK(c->waiters == 0);
+	CHECK(findProcessByPID(b)->state == WAIT_MUTEX);
+	CHECK(Task_GetEffectivePriority(Cp->pid) == 2);
+	Mutex_Unlock(Cv_Mutex);
+	CHECK(strcmp(Log, "ABC") == 0);
+
+	//The mutex has to be held
+	d = Task_Create(Cv_Waiter, 3, 'D');
+	Task_Yield();
+	Cond_Wait(Cv_Cond, Cv_Mutex);
+	CHECK(err == MUTEX_NOT_OWNED_ERR);
+	Cond_Broadcast(Cv_Cond);
+	CHECK(strcmp(Log, "ABCD") == 0);
+	CHECK(findProcessByPID(d) == NULL || findProcessByPID(d)->state == DEAD);
+	Pass();
+}
+
+static void Test_Condition_Variables(void)
+{
+	Task_Create(Cond_Task, 4, 0);
+}
+
+/************************************************************************/
+/*                             MEMORY POOLS                             */
+/************************************************************************/
+
+#define POOL_BLOCK 8
+
+static POOL Test_Pool;
+static unsigned char Pool_Storage[2 * POOL_BLOCK];
+static void *Pool_Got[2];			//Blocks handed to the waiters, by priority - 1
+
+/*Waits for a block with the timeout in its arg, 0 = forever. Logs 't' on a timeout*/
+static void Pool_Waiter(void)
+{
+	void *block = Pool_Alloc_Wait(Test_Pool, Task_GetArg());
+
+	if(block == NULL)
+		Log_Add('t');
+	else
+	{
+		Pool_Got[Task_GetPriority(Cp->pid) - 1] = block;
+		Log_Add('0' + Task_GetPriority(Cp->pid));
+	}
+}
+
+/*Freed blocks go straight to the highest priority waiter, from tasks and ISRs, and waits time out*/
+static void Pool_Task(void)
+{
+	void *a, *b;
+
+	Test_Pool = Pool_Create(POOL_BLOCK, 2, Pool_Storage);
+	a = Pool_Alloc(Test_Pool);
+	b = Pool_Alloc(Test_Pool);
+	CHECK(a != NULL && b != NULL && a != b);
+	CHECK(Pool_Alloc(Test_Pool) == NULL && err == POOL_EMPTY_ERR);
+	CHECK(Pool_GetUsed(Test_Pool) == 2 && Pool_GetHighWater(Test_Pool) == 2);
+
+	Task_Create(Pool_Waiter, 2, 0);
+	Task_Create(Pool_Waiter, 1, 0);
+	Task_Yield();
+	CHECK(Log_Len == 0);
+
+	Pool_Free(Test_Pool, a);
+	CHECK(strcmp(Log, "1") == 0 && Pool_Got[0] == a);
+	CHECK(Pool_GetUsed(Test_Pool) == 2);
+
+	//As an ISR would: the kernel hands the block over as soon as the ISR is done
+	Disable_Interrupt();
+	Pool_Free_FromISR(Test_Pool, b);
+	Enable_Interrupt();
+	CHECK(strcmp(Log, "12") == 0 && Pool_Got[1] == b);
+
+	Task_Create(Pool_Waiter, 1, 2);
+	Task_Yield();
+	Tick();
+	CHECK(strcmp(Log, "12") == 0);
+	Tick();
+	CHECK(strcmp(Log, "12t") == 0);
+	CHECK(findPoolByID(Test_Pool)->waiters == 0);
+
+	//Only the start of one of the pool's blocks can be freed
+	Pool_Free(Test_Pool, Pool_Storage + 1);
+	CHECK(err == INVALID_ARG_ERR);
+
+	Pool_Free(Test_Pool, a);
+	Pool_Free(Test_Pool, b);
+	CHECK(Pool_GetUsed(Test_Pool) == 0 && Pool_GetHighWater(Test_Pool) == 2);
+
+	//ISRs allocate without touching the error of whatever they interrupted
+	Pool_Free(Test_Pool, Pool_Storage + 1);
+	Disable_Interrupt();
+	a = Pool_Alloc_FromISR(Test_Pool);
+	b = Pool_Alloc_FromISR(Test_Pool);
+	Enable_Interrupt();
+	CHECK(a != NULL && b != NULL && Pool_Alloc_FromISR(Test_Pool) == NULL);
+	CHECK(err == INVALID_ARG_ERR && Pool_GetUsed(Test_Pool) == 2);
+	Pass();
+}
+
+static void Test_Pools(void)
+{
+	Pool_Got[0] = Pool_Got[1] = NULL;
+	Task_Create(Pool_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                          TASK NOTIFICATIONS                          */
+/************************************************************************/
+
+static void Notify_Waiter(void)
+{
+	Log_Add(Task_NotifyWait(0x3, 0) == 0x2 ? 'a' : '?');
+	Log_Add(Task_NotifyWait(0x4, 0) == 0x4 ? 'b' : '?');		//Already set, doesn't wait
+	Log_Add(Task_NotifyWait(0x1, 2) == 0 && err == TIMEOUT_ERR ? 't' : '?');
+	Log_Add(Task_NotifyWait(0xFFFF, 0) == 0x10 ? 'o' : '?');
+	Log_Add(Task_NotifyWait(0x8, 0) == 0x8 ? 'i' : '?');
+	Log_Add(Task_NotifyWait(0xFFFF, 0) == 1 ? 'n' : '?');
+	Log_Add(Task_NotifyWait(0x20, 3) == 0x20 ? 's' : '?');
+}
+
+/*A waiter only wakes for the bits it waits for and takes only those, even while suspended, and waits time out*/
+static void Notify_Task(void)
+{
+	PID waiter = Task_Create(Notify_Waiter, 1, 0);
+	PD *w = findProcessByPID(waiter);
+
+	Task_Yield();
+	Task_Notify(waiter, 0x4, NOTIFY_SET_BITS);
+	CHECK(err == NO_ERR && Log_Len == 0);
+	CHECK(w->state == WAIT_NOTIFY && w->notify_value == 0x4);
+
+	Task_Notify(waiter, 0x2, NOTIFY_SET_BITS);
+	CHECK(strcmp(Log, "ab") == 0 && w->notify_value == 0);
+
+	Tick();
+	Tick();
+	CHECK(strcmp(Log, "abt") == 0);
+
+	Task_Notify(waiter, 0x10, NOTIFY_OVERWRITE);
+	CHECK(strcmp(Log, "abto") == 0);
+
+	//As an ISR would
+	Disable_Interrupt();
+	Task_Notify_FromISR(waiter, 0x8, NOTIFY_SET_BITS);
+	Enable_Interrupt();
+	CHECK(strcmp(Log, "abtoi") == 0);
+
+	Task_Notify(waiter, 0, NOTIFY_INCREMENT);
+	CHECK(strcmp(Log, "abtoin") == 0);
+
+	//Notified while it's suspended in its wait, it has the bits as soon as it's resumed
+	Task_Suspend(waiter);
+	Task_Notify(waiter, 0x20, NOTIFY_SET_BITS);
+	CHECK(w->state == SUSPENDED && w->last_state == READY && w->notify_value == 0);
+	Task_Resume(waiter);
+	CHECK(strcmp(Log, "abtoins") == 0);
+
+	Task_Notify(waiter, 0x1, NOTIFY_SET_BITS);
+	CHECK(err == PID_NOT_FOUND_ERR);
+	Pass();
+}
+
+static void Test_Notifications(void)
+{
+	Task_Create(Notify_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                                 JOIN                                 */
+/************************************************************************/
+
+static EVENT Join_Never;
+
+/*Exits with its arg*/
+static void Join_Exiter(void)
+{
+	Task_Exit(Task_GetArg());
+}
+
+/*Joins the PID in its arg, which exits with 'y', and logs its own priority*/
+static void Join_Joiner(void)
+{
+	Log_Add(Task_Join(Task_GetArg(), 0) == 'y' ? '0' + Task_GetPriority(Cp->pid) : '?');
+}
+
+static void Join_Stuck(void)
+{
+	Event_Wait(Join_Never);
+}
+
+/*Joiners get the exit code whether the task ends before or after they join, and timed joins give up*/
+static void Join_Task(void)
+{
+	PID child, stuck;
+
+	Join_Never = Event_Init();
+
+	child = Task_Create(Join_Exiter, 4, 'x');
+	CHECK(Task_Join(child, 0) == 'x' && err == NO_ERR);
+	CHECK(Task_Join(child, 0) == 'x' && err == NO_ERR);
+
+	//Every joiner is woken, highest priority first
+	child = Task_Create(Join_Exiter, 4, 'y');
+	Task_Create(Join_Joiner, 2, child);
+	Task_Create(Join_Joiner, 1, child);
+	Task_Yield();
+	CHECK(findProcessByPID(child)->joiners != 0);
+	CHECK(Task_Join(child, 0) == 'y');
+	CHECK(strcmp(Log, "12") == 0);
+
+	//Nothing else runs, so the kernel idles until the join times out
+	stuck = Task_Create(Join_Stuck, 4, 0);
+	CHECK(Task_Join(stuck, 3) == 0 && err == TIMEOUT_ERR);
+	CHECK(findProcessByPID(stuck)->joiners == 0);
+
+	Task_Join(Cp->pid, 0);
+	CHECK(err == INVALID_ARG_ERR);
+	Task_Join(stuck + MAXTHREAD, 0);
+	CHECK(err == PID_NOT_FOUND_ERR);
+	Pass();
+}
+
+static void Test_Join(void)
+{
+	Task_Create(Join_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                              CPU BUDGETS                             */
+/************************************************************************/
+
+/*Burns ticks until its budget is taken away. Every tick it fires is charged to it*/
+static void Budget_Hog(void)
+{
+	for(;;)
+	{
+		if(Cp->budget == 0)
+		{
+			Log_Add('u');
+			Task_Terminate();
+		}
+		Log_Add('h');
+		Tick();
+	}
+}
+
+/*An overrunning task is demoted or stopped until its budget is replenished, and runs right away once it is or the budget is lifted*/
+static void Budget_Task(void)
+{
+	PID hog = Task_Create(Budget_Hog, 1, 0);
+	PD *h = findProcessByPID(hog);
+	int ticks;
+
+	Task_SetBudget(hog, 2, 10, BUDGET_DEMOTE);
+	CHECK(strcmp(Log, "hh") == 0);
+	CHECK(h->throttled && h->state == READY && Task_GetEffectivePriority(hog) == BACKGROUND_PRIORITY);
+
+	//The hog ran for 2 of the 10 ticks before its budget comes back
+	for(ticks = 0; Log_Len == 2 && ticks < 10; ticks++)
+		Tick();
+	CHECK(ticks == 8);
+	CHECK(strcmp(Log, "hhhh") == 0 && h->throttled);
+
+	Task_SetBudget(hog, 1, 10, BUDGET_SUSPEND);
+	CHECK(strcmp(Log, "hhhhh") == 0);
+	CHECK(h->throttled && h->state == THROTTLED);
+
+	Task_SetBudget(hog, 0, 0, 0);
+	CHECK(strcmp(Log, "hhhhhu") == 0);
+
+	Task_SetBudget(Cp->pid, 1, 10, 7);
+	CHECK(err == INVALID_ARG_ERR);
+	Task_SetBudget(Cp->pid, 11, 10, BUDGET_DEMOTE);
+	CHECK(err == INVALID_ARG_ERR);
+	Pass();
+}
+
+static void Test_Budgets(void)
+{
+	Task_Create(Budget_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                             EVENT GROUPS                             */
+/************************************************************************/
+
+static EVENT_GROUP Eg_Group;
+
+static void Eg_All(void)
+{
+	if(EventGroup_Wait(Eg_Group, 0x3, EG_WAIT_ALL | EG_CLEAR_ON_EXIT, 0) == 0x3)
+		Log_Add('a');
+	if(EventGroup_Wait(Eg_Group, 0x30, EG_WAIT_ALL, 0) == 0x30)
+		Log_Add('i');
+}
+
+static void Eg_Any(void)
+{
+	if(EventGroup_Wait(Eg_Group, 0x6, EG_WAIT_ANY, 0) == 0x2)
+		Log_Add('b');
+}
+
+/*Wait-all waits for every bit, waiters woken together see the same flags, and only the bits of a clear-on-exit mask are cleared*/
+static void Event_Group_Task(void)
+{
+	Eg_Group = EventGroup_Init();
+	Task_Create(Eg_All, 1, 0);
+	Task_Create(Eg_Any, 2, 0);
+	Task_Yield();
+
+	EventGroup_Set(Eg_Group, 0x1);
+	CHECK(strcmp(Log, "") == 0 && EventGroup_Get(Eg_Group) == 0x1);
+
+	EventGroup_Set(Eg_Group, 0xA);
+	CHECK(strcmp(Log, "ab") == 0);
+	CHECK(EventGroup_Get(Eg_Group) == 0x8);
+
+	//As an ISR would
+	Disable_Interrupt();
+	EventGroup_Set_FromISR(Eg_Group, 0x10);
+	Enable_Interrupt();
+	CHECK(strcmp(Log, "ab") == 0);
+	Disable_Interrupt();
+	EventGroup_Set_FromISR(Eg_Group, 0x20);
+	Enable_Interrupt();
+	CHECK(strcmp(Log, "abi") == 0);
+
+	//Already satisfied, so the caller doesn't block
+	CHECK(EventGroup_Wait(Eg_Group, 0x18, EG_WAIT_ALL | EG_CLEAR_ON_EXIT, 1) == 0x18);
+	CHECK(EventGroup_Get(Eg_Group) == 0x20);
+	Pass();
+}
+
+static void Test_Event_Groups(void)
+{
+	Task_Create(Event_Group_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                                  EDF                                 */
+/************************************************************************/
+
+/*One job that logs its arg*/
+static void Edf_Job(void)
+{
+	Log_Add(Task_GetArg());
+}
+
+/*Runs past its deadline, and logs if the miss was counted*/
+static void Edf_Late(void)
+{
+	int i;
+
+	Log_Add('c');
+	for(i = 0; i < 3; i++)
+		Tick();
+	Log_Add(Task_GetDeadlineMisses(Cp->pid) == 1 ? 'm' : '?');
+}
+
+/*Two jobs with an early deadline*/
+static void Edf_Short(void)
+{
+	Log_Add('e');
+	Task_WaitPeriod();
+	Log_Add('e');
+}
+
+/*One long job with a late deadline, preempted when the short one is released again*/
+static void Edf_Long(void)
+{
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		Log_Add('l');
+		Tick();
+	}
+}
+
+/*EDF tasks run by deadline within their band, between the fixed priorities above and below it*/
+static void Edf_Task(void)
+{
+	PID a;
+
+	a = Task_Create_EDF(Edf_Job, 'a', 20, 10, 1000);
+	Task_Create_EDF(Edf_Job, 'b', 20, 4, 1000);
+	Task_Create(Edf_Job, EDF_PRIORITY + 1, 'f');
+	Task_Create(Edf_Job, EDF_PRIORITY - 1, 'h');
+	CHECK(a != 0 && Task_GetPriority(a) == EDF_PRIORITY);
+	Task_SetPriority(a, 1);
+	CHECK(err == INVALID_ARG_ERR);
+	Task_Sleep(1);
+	CHECK(strcmp(Log, "hbaf") == 0);
+
+	//A job still running past its deadline is counted once
+	Task_Create_EDF(Edf_Late, 0, 10, 2, 1000);
+	Task_Sleep(5);
+	CHECK(strcmp(Log, "hbafcm") == 0);
+	CHECK(Total_Deadline_Misses == 1);
+
+	//The tick that releases the short task's second job preempts the long one, whose deadline is later
+	Task_Create_EDF(Edf_Short, 0, 3, 3, 1000);
+	Task_Create_EDF(Edf_Long, 0, 100, 100, 1000);
+	Task_Sleep(10);
+	CHECK(strcmp(Log, "hbafcmelllel") == 0);
+	CHECK(Total_Deadline_Misses == 1);
+	Pass();
+}
+
+static void Test_Edf(void)
+{
+	Task_Create(Edf_Task, 0, 0);
+}
+
+/************************************************************************/
+/*                            OBJECT CREATION                           */
+/************************************************************************/
+
+static MUTEX Create_Other;
+
+/*Woken by the tick that comes in while the main task creates its mutex. Creates one too and leaves an error behind*/
+static void Create_Sleeper(void)
+{
+	Task_Sleep(1);
+	Create_Other = Mutex_Init();
+	Task_Join(Cp->pid, 0);
+	Log_Add(err == INVALID_ARG_ERR ? 's' : '?');
+}
+
+/*A task preempted on its way out of a create call still gets its own ID and error*/
+static void Create_Task(void)
+{
+	MUTEX m;
+
+	Task_Create(Create_Sleeper, 1, 0);
+	Task_Yield();
+	CHECK(strcmp(Log, "") == 0);
+
+	//The tick fires once the kernel enables interrupts, and the sleeper runs before the create call returns
+	Host_Tick_Pending = 1;
+	m = Mutex_Init();
+	CHECK(strcmp(Log, "s") == 0);
+	CHECK(m != 0 && Create_Other != 0 && m != Create_Other);
+	CHECK(err == NO_ERR);
+	Pass();
+}
+
+static void Test_Create(void)
+{
+	Task_Create(Create_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                            TASK ARGUMENTS                            */
+/************************************************************************/
+
+typedef struct
+{
+	int in;
+	int out;
+} ARG_CHANNEL;
+
+/*Declared with a parameter, so it gets its arg the way avr-gcc passes it*/
+static void Arg_Int(int arg)
+{
+	Log_Add(arg == 0x1234 && Task_GetArg() == 0x1234 ? 'i' : '?');
+}
+
+/*Gets a pointer to its channel, and answers through it*/
+static void Arg_Ctx(void *ctx)
+{
+	ARG_CHANNEL *c = ctx;
+
+	Log_Add(Task_GetCtx() == ctx ? 'c' : '?');
+	c->out = c->in + 1;
+}
+
+/*The arg is in r24:r25 of the new task's initial frame, and tasks taking a parameter get it there*/
+static void Arg_Task(void)
+{
+	ARG_CHANNEL c = { 41, 0 };
+	PID p;
+	PD *t;
+
+	p = Task_Create((voidfuncptr)Arg_Int, 1, 0x1234);
+	t = findProcessByPID(p);
+	CHECK(t->workSpace[WORKSPACE-7-24] == 0x34 && t->workSpace[WORKSPACE-7-25] == 0x12);
+	Task_Yield();
+	CHECK(strcmp(Log, "i") == 0);
+
+	p = Task_Create_Ctx(Arg_Ctx, 1, &c);
+	t = findProcessByPID(p);
+	CHECK(t->workSpace[WORKSPACE-7-24] == ((uintptr_t)&c & 0xff) && t->workSpace[WORKSPACE-7-25] == (((uintptr_t)&c >> 8) & 0xff));
+	Task_Yield();
+	CHECK(strcmp(Log, "ic") == 0 && c.out == 42);
+	Pass();
+}
+
+static void Test_Arguments(void)
+{
+	Task_Create(Arg_Task, 3, 0);
+}
+
+/************************************************************************/
+/*                          TASK-LOCAL STORAGE                          */
+/************************************************************************/
+
+static TLS_KEY Tls_Logged, Tls_Plain;
+static char Tls_Values[] = "xyz";
+
+/*Logs the value it is handed when a task terminates*/
+static void Tls_Destructor(void *value)
+{
+	Log_Add(*(char *)value);
+}
+
+/*Keeps the value of its arg in both keys across a sleep, in which the other workers set theirs. The last one clears its
+  logged slot before it terminates*/
+static void Tls_Worker(void)
+{
+	char *mine = &Tls_Values[Task_GetArg()];
+
+	if(TLS_Get(Tls_Logged) != NULL || TLS_Get(Tls_Plain) != NULL)
+		Log_Add('?');
+	TLS_Set(Tls_Logged, mine);
+	TLS_Set(Tls_Plain, mine);
+	Task_Sleep(1);
+	Log_Add(TLS_Get(Tls_Logged) == mine && TLS_Get(Tls_Plain) == mine ? 'a' + Task_GetArg() : '?');
+	if(*mine == 'z')
+		TLS_Set(Tls_Logged, NULL);
+}
+
+/*Each task has its own slot of a key, and the destructor gets what's left in it when the task terminates*/
+static void Tls_Task(void)
+{
+	PID x;
+
+	Tls_Logged = TLS_Create(Tls_Destructor);
+	Tls_Plain = TLS_Create(NULL);
+	CHECK(Tls_Logged != 0 && Tls_Plain != 0 && Tls_Logged != Tls_Plain);
+
+	x = Task_Create(Tls_Worker, 1, 0);
+	Task_Create(Tls_Worker, 2, 1);
+	Task_Create(Tls_Worker, 2, 2);
+	Task_Yield();
+	CHECK(strcmp(Log, "") == 0);
+	CHECK(findProcessByPID(x)->tls[Tls_Logged - 1] == &Tls_Values[0]);
+	CHECK(TLS_Get(Tls_Logged) == NULL);
+
+	//Only the values left in a key with a destructor are handed to it
+	Task_Sleep(2);
+	CHECK(strcmp(Log, "axbyc") == 0);
+
+	//Every key is in use
+	CHECK(TLS_Create(NULL) != 0 && TLS_Create(NULL) != 0);
+	CHECK(TLS_Create(NULL) == 0 && err == MAX_TLS_ERR);
+	TLS_Set(MAXTLS + 1, &Tls_Values[0]);
+	CHECK(err == INVALID_ARG_ERR);
+	Pass();
+}
+
+static void Test_TLS(void)
+{
+	Task_Create(Tls_Task, 3, 0);
+}
+
+#ifdef ADMISSION_CONTROL
+/************************************************************************/
+/*                          ADMISSION CONTROL                           */
+/************************************************************************/
+
+static void Periodic_Task(void)
+{
+	for(;;)
+		Task_WaitPeriod();
+}
+
+/*Rate monotonic order passes the response time analysis, swapping the two priorities doesn't*/
+static void Admission_Priority_Task(void)
+{
+	PID fast = Task_Create_Periodic(Periodic_Task, 1, 0, 10, 60000);
+	PID slow = Task_Create_Periodic(Periodic_Task, 2, 0, 20, 70000);
+
+	CHECK(fast != 0 && slow != 0);
+
+	Task_SetPriority(fast, 3);
+	CHECK(err == UNSCHEDULABLE_ERR);
+	CHECK(Task_GetPriority(fast) == 1);
+
+	Task_SetPriority(slow, 3);
+	CHECK(err == NO_ERR);
+	CHECK(Task_GetPriority(slow) == 3);
+	Pass();
+}
+
+static void Test_Admission_Priority(void)
+{
+	Task_Create(Admission_Priority_Task, 0, 0);
+}
+#endif
+
+#ifdef STATIC_OBJECTS
+/************************************************************************/
+/*                            STATIC OBJECTS                            */
+/************************************************************************/
+
+static void Static_Main(void);
+static void Static_Waiter(void);
+
+//The tables are only laid out once, like .data after a reset, so this is the only test of a STATIC_OBJECTS build
+OS_STATIC_TASKS(STATIC_TASK(0, Static_Main, 2, 'm'), STATIC_TASK(1, Static_Waiter, 1, 'w'));
+OS_STATIC_EVENTS(STATIC_EVENT(0));
+OS_STATIC_EVENT_GROUPS(STATIC_EVENT_GROUP(0));
+OS_STATIC_MUTEXES(STATIC_MUTEX(0));
+
+/*Holds the static mutex until the static event is signalled, then sets a bit of the static event group*/
+static void Static_Waiter(void)
+{
+	Log_Add(Task_GetArg());
+	Mutex_Lock(STATIC_ID(0));
+	Event_Wait(STATIC_ID(0));
+	Log_Add('e');
+	Mutex_Unlock(STATIC_ID(0));
+	EventGroup_Set(STATIC_ID(0), 0x1);
+}
+
+/*The declared tasks boot with their priorities and args, the declared objects work, and more can be created at runtime*/
+static void Static_Main(void)
+{
+	Log_Add(Task_GetArg());
+	CHECK(strcmp(Log, "wm") == 0);
+	CHECK(Cp->pid == STATIC_ID(0) && Task_GetPriority(STATIC_ID(1)) == 1);
+	CHECK(Process[0].workSpace[WORKSPACE-7-24] == 'm' && Process[0].workSpace[WORKSPACE-7-25] == 0);
+	CHECK(Mutex[0].owner == STATIC_ID(1));
+
+	Event_Signal(STATIC_ID(0));
+	CHECK(strcmp(Log, "wme") == 0);
+	CHECK(EventGroup_Get(STATIC_ID(0)) == 0x1);
+	Mutex_Lock(STATIC_ID(0));
+	CHECK(err == NO_ERR && Mutex[0].owner == STATIC_ID(0));
+	Mutex_Unlock(STATIC_ID(0));
+
+	//The next IDs follow the declared ones
+	CHECK(Event_Init() == STATIC_ID(1) && Mutex_Init() == STATIC_ID(1) && EventGroup_Init() == STATIC_ID(1));
+	CHECK(Task_Create(Edf_Job, 1, 'd') > STATIC_ID(1));
+	Task_Yield();
+	CHECK(strcmp(Log, "wmed") == 0);
+	Pass();
+}
+
+/*Everything was declared above*/
+static void Test_Static_Objects(void)
+{
+}
+#endif
+
+/************************************************************************/
+/*                                 MAIN                                 */
+/************************************************************************/
+
+static const TEST Tests[] =
+{
+	#ifdef STATIC_OBJECTS
+	{ "static_objects", Test_Static_Objects },
+	#else
+	{ "hooks", Test_Hooks },
+	{ "timer_restart", Test_Timer_Restart },
+	{ "protothreads", Test_Protothreads },
+	{ "basic_tasks", Test_Basic_Tasks },
+	{ "rwlocks", Test_RWLocks },
+	{ "condition_variables", Test_Condition_Variables },
+	{ "pools", Test_Pools },
+	{ "notifications", Test_Notifications },
+	{ "join", Test_Join },
+	{ "budgets", Test_Budgets },
+	{ "event_groups", Test_Event_Groups },
+	{ "edf", Test_Edf },
+	{ "create", Test_Create },
+	{ "arguments", Test_Arguments },
+	{ "tls", Test_TLS },
+	#ifdef ADMISSION_CONTROL
+	{ "admission_priority", Test_Admission_Priority },
+	#endif
+	#endif
+};
+
+/*Boots the kernel with the test's tasks. Runs on its own stack, which becomes the kernel's*/
+static void Boot(void)
+{
+	Host_Reset();
+	OS_Init();
+	Current->setup();
+	OS_Start();
+}
+
+static int Selected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	for(i = 1; i < argc; i++)
+		if(strcmp(argv[i], name) == 0)
+			return 1;
+	return argc == 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int failures = 0;
+
+	Host_Entries_Per_Tick = 0;
+
+	for(i = 0; i < sizeof(Tests) / sizeof(Tests[0]); i++)
+	{
+		if(!Selected(Tests[i].name, argc, argv))
+			continue;
+
+		Current = &Tests[i];
+		Start_Ticks = Host_Ticks;
+		Log_Len = 0;
+		memset(Log, 0, sizeof(Log));
+		Failed = 0;
+
+		getcontext(&Boot_Ctx);
+		Boot_Ctx.uc_stack.ss_sp = Boot_Stack;
+		Boot_Ctx.uc_stack.ss_size = sizeof(Boot_Stack);
+		Boot_Ctx.uc_link = NULL;
+		makecontext(&Boot_Ctx, Boot, 0);
+		swapcontext(&Main_Ctx, &Boot_Ctx);
+
+		if(!Failed)
+			printf("pass %s\n", Current->name);
+		failures += Failed;
+	}
+	return failures;
+}
@@ -0,0 +1,348 @@
+/*
+ * Tests of the kernel running on several virtual CPUs of the SMP host port at once.
+ *
+ * Compile using (from p2/):
+ *   gcc -std=gnu99 -O2 -DHOST_PORT -DHOST_SMP -pthread -Dmain=Host_Node_Main -Ihost/port -o kernel_smp \
+ *       host/stress/kernel_smp.c host/port/host_port.c os.c sched_analysis.c
+ *
+ * Usage:
+ *   ./kernel_smp [-c cpus]
+ *
+ * Boots the real kernel.c once on -c virtual CPUs (4 by default), with a main task that runs the tests one after the other.
+ * The CPUs are threads, so unlike kernel_objects.c no two runs interleave the same way: the checks hold for any order.
+ * A failed CHECK() is printed and the tests go on. The exit code is the number of failed checks, or 1 if the run is
+ * still going after SMP_SECONDS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../../kernel.c"			//White box: the checks read the kernel's own tables
+
+#undef main
+
+#define SMP_SECONDS 60				//A run still going after this long is stuck
+#define WORKERS 8
+#define ROUNDS 2000					//Times each worker takes the shared mutex
+#define WORK 2000					//Busy loop iterations between them, so the workers run long enough to spread out
+#define PING_BATCHES 200			//Each batch passes PING_ROUNDS pings and pongs on fresh events
+#define PING_ROUNDS 3
+#define FAST_ROUNDS 1000
+#define SPIN_LIMIT 100000000UL		//Busy loop iterations before a task gives up waiting for another CPU
+
+#define CHECK(c) do { if(!(c)) Fail(#c, __LINE__); } while(0)
+
+static volatile int Failed;
+
+static MUTEX Excl_Mutex;
+static volatile unsigned long Excl_Count;
+static volatile int Excl_Inside;
+static volatile unsigned int Cpus_Used;		//Bit per virtual CPU a worker ran on
+
+static EVENT Ping_Events[2 * PING_ROUNDS];
+static volatile int Ping_Sent, Pong_Sent;
+
+static volatile int Spin_Stop;
+static volatile unsigned long Spin_Count[HOST_MAX_CPUS];
+static volatile int Urgent_Ran, Urgent_CPU;
+
+void a_main(void)
+{
+}
+
+static void Fail(const char *what, int line)
+{
+	printf("FAIL line %d: %s\n", line, what);
+	__atomic_add_fetch(&Failed, 1, __ATOMIC_SEQ_CST);
+}
+
+void Host_On_Tick(void)
+{
+}
+
+static void Timeout(int sig)
+{
+	static const char msg[] = "FAIL still running after SMP_SECONDS\n";
+
+	(void)sig;
+	write(1, msg, sizeof(msg) - 1);
+	_exit(1);
+}
+
+/*Busy waits on this CPU for a flag another CPU sets, taking interrupts but never giving up the CPU*/
+static int Spin_Until(volatile int *flag)
+{
+	unsigned long n;
+
+	for(n = 0; n < SPIN_LIMIT && !*flag; n++)
+		Enable_Interrupt();
+	return *flag;
+}
+
+/************************************************************************/
+/*                          MUTUAL EXCLUSION                            */
+/************************************************************************/
+
+/*Takes the shared mutex ROUNDS times. Now and then it yields while holding it, so the others queue up on it*/
+static void Excl_Worker(int arg)
+{
+	volatile unsigned long work;
+	unsigned long n;
+	int i;
+
+	for(i = 0; i < ROUNDS; i++)
+	{
+		Mutex_Lock(Excl_Mutex);
+		if(__atomic_exchange_n(&Excl_Inside, 1, __ATOMIC_SEQ_CST))
+			Fail("two workers hold the mutex", __LINE__);
+		n = Excl_Count;
+		if((i + arg) % 16 == 0)
+			Task_Yield();
+		Excl_Count = n + 1;
+		__atomic_store_n(&Excl_Inside, 0, __ATOMIC_SEQ_CST);
+		Mutex_Unlock(Excl_Mutex);
+
+		__atomic_or_fetch(&Cpus_Used, 1u << Host_CPU, __ATOMIC_SEQ_CST);
+		for(work = 0; work < WORK; work++)
+			;
+	}
+}
+
+static void Test_Mutual_Exclusion(void)
+{
+	PID workers[WORKERS];
+	int i;
+
+	Excl_Mutex = Mutex_Init();
+	for(i = 0; i < WORKERS; i++)
+		workers[i] = Task_Create((voidfuncptr)Excl_Worker, 2, i);
+	for(i = 0; i < WORKERS; i++)
+		Task_Join(workers[i], 0);
+
+	CHECK(Excl_Count == (unsigned long)WORKERS * ROUNDS);
+	CHECK(Host_CPUs == 1 || (Cpus_Used & (Cpus_Used - 1)) != 0);
+	CHECK(Host_CPUs == 1 || getSteals() > 0);
+}
+
+/************************************************************************/
+/*                          EVENTS ACROSS CPUS                          */
+/************************************************************************/
+
+static void Ping_Task(void)
+{
+	int i;
+
+	for(i = 0; i < PING_ROUNDS; i++)
+	{
+		Ping_Sent = i + 1;
+		Event_Signal(Ping_Events[2 * i]);
+		Event_Wait(Ping_Events[2 * i + 1]);
+		CHECK(Pong_Sent > i);
+	}
+}
+
+static void Pong_Task(void)
+{
+	int i;
+
+	for(i = 0; i < PING_ROUNDS; i++)
+	{
+		Event_Wait(Ping_Events[2 * i]);
+		CHECK(Ping_Sent > i);
+		Pong_Sent = i + 1;
+		Event_Signal(Ping_Events[2 * i + 1]);
+	}
+}
+
+/*Passes one-shot events back and forth between two tasks, which are signalled before or after they wait, whichever comes first*/
+static void Test_Events(void)
+{
+	PID ping, pong;
+	int b, i;
+
+	for(b = 0; b < PING_BATCHES; b++)
+	{
+		Ping_Sent = Pong_Sent = 0;
+		for(i = 0; i < 2 * PING_ROUNDS; i++)
+			Ping_Events[i] = Event_Init();
+
+		ping = Task_Create(Ping_Task, 2, 0);
+		pong = Task_Create(Pong_Task, 2, 0);
+		Task_Join(ping, 0);
+		Task_Join(pong, 0);
+		CHECK(Pong_Sent == PING_ROUNDS);
+	}
+	CHECK(Event_Count == 0);
+}
+
+/************************************************************************/
+/*                          REMOTE SUSPEND                              */
+/************************************************************************/
+
+static void Spin_Task(int arg)
+{
+	while(!Spin_Stop)
+	{
+		++Spin_Count[arg];
+		Enable_Interrupt();
+	}
+}
+
+/*Suspends a task while another CPU runs it, which has to stop it there*/
+static void Test_Remote_Suspend(void)
+{
+	PID spin;
+	PD *p;
+	unsigned long n;
+
+	if(Host_CPUs == 1)
+		return;
+
+	Spin_Stop = 0;
+	Spin_Count[0] = 0;
+	spin = Task_Create((voidfuncptr)Spin_Task, 3, 0);
+	p = findProcessByPID(spin);
+	while(Spin_Count[0] == 0)
+		Task_Sleep(1);
+	CHECK(p->on_cpu >= 0 && p->on_cpu != Host_CPU);
+
+	Task_Suspend(spin);
+	CHECK(err == NO_ERR);
+	Task_Sleep(2);
+	n = Spin_Count[0];
+	CHECK(p->state == SUSPENDED && p->on_cpu < 0);
+	Task_Sleep(2);
+	CHECK(Spin_Count[0] == n);
+
+	Task_Resume(spin);
+	while(Spin_Count[0] == n)
+		Task_Sleep(1);
+	Spin_Stop = 1;
+	Task_Join(spin, 0);
+}
+
+/************************************************************************/
+/*                          REMOTE PREEMPTION                           */
+/************************************************************************/
+
+static void Urgent_Task(void)
+{
+	Urgent_CPU = Host_CPU;
+	Urgent_Ran = 1;
+}
+
+/*Wakes a task of a higher priority while every other CPU runs a less important one. One of them is interrupted to run it,
+  and this CPU, which runs the most important task of all, keeps it*/
+static void Test_Remote_Preemption(void)
+{
+	PID spinners[HOST_MAX_CPUS], urgent;
+	int i, running;
+	unsigned long n;
+
+	if(Host_CPUs == 1)
+		return;
+
+	Spin_Stop = 0;
+	for(i = 0; i < Host_CPUs - 1; i++)
+	{
+		Spin_Count[i] = 0;
+		spinners[i] = Task_Create((voidfuncptr)Spin_Task, 4, i);
+	}
+	for(n = 0, running = 0; n < SPIN_LIMIT && running < Host_CPUs - 1; n++)
+	{
+		for(i = 0, running = 0; i < Host_CPUs - 1; i++)
+			running += findProcessByPID(spinners[i])->on_cpu >= 0;
+		Enable_Interrupt();
+	}
+	CHECK(running == Host_CPUs - 1);
+
+	Urgent_Ran = 0;
+	urgent = Task_Create(Urgent_Task, 2, 0);
+	CHECK(Spin_Until(&Urgent_Ran));
+	CHECK(Urgent_CPU != Host_CPU);
+
+	Spin_Stop = 1;
+	Task_Join(urgent, 0);
+	for(i = 0; i < Host_CPUs - 1; i++)
+		Task_Join(spinners[i], 0);
+}
+
+/************************************************************************/
+/*                          FAST PATHS                                  */
+/************************************************************************/
+
+/*Uncontended mutexes, and events that were signalled already, don't take the kernel lock. At most a tick that comes due takes it*/
+static void Test_Fast_Paths(void)
+{
+	unsigned long taken, extra = 0;
+	MUTEX m;
+	EVENT e;
+	int i;
+
+	m = Mutex_Init();
+	taken = Host_Lock_Taken;
+	for(i = 0; i < FAST_ROUNDS; i++)
+	{
+		Mutex_Lock(m);
+		Mutex_Lock(m);
+		Mutex_Unlock(m);
+		Mutex_Unlock(m);
+	}
+	CHECK(err == NO_ERR);
+	CHECK(Host_Lock_Taken - taken <= 2);
+
+	for(i = 0; i < FAST_ROUNDS; i++)
+	{
+		e = Event_Init();
+		Event_Signal(e);
+		CHECK(err == SIGNAL_UNOWNED_EVENT_ERR);
+		taken = Host_Lock_Taken;
+		Event_Wait(e);
+		extra += Host_Lock_Taken - taken;
+	}
+	CHECK(extra <= FAST_ROUNDS / 50);
+	CHECK(Event_Count == 0);
+}
+
+static void Main_Task(void)
+{
+	Test_Mutual_Exclusion();
+	Test_Events();
+	Test_Remote_Suspend();
+	Test_Remote_Preemption();
+	Test_Fast_Paths();
+
+	printf("%s: %d virtual CPUs, %lu steals, kernel lock contended %lu of %lu times\n", Failed ? "FAIL" : "pass",
+		Host_CPUs, getSteals(), Host_Lock_Contended, Host_Lock_Taken);
+	fflush(stdout);
+	_exit(Failed);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	Host_CPUs = 4;
+	while((opt = getopt(argc, argv, "c:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c': Host_CPUs = atoi(optarg); break;
+			default:
+			fprintf(stderr, "usage: %s [-c cpus]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	signal(SIGALRM, Timeout);
+	alarm(SMP_SECONDS);
+
+	Host_Reset();
+	OS_Init();
+	Task_Create(Main_Task, 1, 0);
+	OS_Start();
+	return 1;
+}
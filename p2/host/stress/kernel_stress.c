@@ -0,0 +1,808 @@
+/*
+ * Randomized syscall stress test of the kernel, checked against a reference model after every step.
+ *
+ * Compile using (from p2/):
+ *   gcc -std=gnu99 -O2 -DHOST_PORT -Dmain=Host_Node_Main -Ihost/port -o kernel_stress \
+ *       host/stress/kernel_stress.c host/port/host_port.c os.c sched_analysis.c
+ *
+ * Usage:
+ *   ./kernel_stress [-s seed] [-n steps] [-l steps per scenario] [-v]
+ *
+ * The real kernel.c runs on the host port with "puppet" tasks. Whichever puppet is running first checks the
+ * kernel's state against the model, then picks a random syscall, predicts its outcome in the model and makes it.
+ * The syscall returns in whichever task the kernel runs next, which starts over by checking the prediction.
+ * Checked are the running task, the state, base and effective priority and sleep time of every task, mutex owners,
+ * counts and wait queues, events, and the error code of syscalls that don't switch tasks.
+ *
+ * A puppet at the lowest priority never blocks and is never suspended, so the kernel never idles. Ticks are only
+ * fired by puppets, which keeps every run reproducible from its seed. Each one enters the kernel like on the board. Every -l steps the kernel is booted again.
+ * On a mismatch the seed, the step and the most recent syscalls are printed and the exit code is 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <ucontext.h>
+#include "../../kernel.c"			//White box: the checks read the kernel's own tables
+
+#undef main
+
+#define IDLE_SLOT 0					//The idle puppet is created first
+#define HISTORY 32					//Syscalls kept for the failure report
+#define BOOT_STACK_SIZE 262144
+
+/*The reference model. Kept as simple as possible, independent of how the kernel stores things*/
+typedef struct
+{
+	PID pid;
+	PROCESS_STATES state;
+	PROCESS_STATES last_state;
+	PRIORITY pri;						//Priority it runs at
+	PRIORITY base_pri;					//Priority it was given
+	int sleep;							//Ticks left for SLEEPING tasks, and SUSPENDED ones that were sleeping
+} MODEL_TASK;
+
+typedef struct
+{
+	MUTEX id;
+	PID owner;
+	unsigned int count;
+	unsigned int nwait;
+	PID wait_pid[MAXTHREAD];			//Waiters in arrival order
+	PRIORITY wait_pri[MAXTHREAD];		//Their current priorities
+} MODEL_MUTEX;
+
+typedef struct
+{
+	EVENT id;
+	PID owner;
+	unsigned int count;
+} MODEL_EVENT;
+
+static struct
+{
+	MODEL_TASK task[MAXTHREAD];
+	MODEL_MUTEX mutex[MAXMUTEX];
+	MODEL_EVENT event[MAXEVENT];
+	int running;						//Slot of the running task
+	int next_p;							//Slot the last dispatch started from
+	unsigned int pending_ticks;			//Ticks fired since the last kernel entry
+	PID last_pid;
+	unsigned int mutexes;
+	EVENT last_event;
+	int expect_err;						//err the current syscall must leave behind, -1 = don't check
+} M;
+
+static unsigned long long Seed, Rng;
+static unsigned long Total_Steps = 10000000, Scenario_Steps = 5000;
+static unsigned long Step, Scenario, Scenario_Step;
+static int Verbose;
+static char History[HISTORY][64];
+static ucontext_t Main_Ctx, Boot_Ctx;
+static char Boot_Stack[BOOT_STACK_SIZE];
+
+void a_main(void)
+{
+}
+
+static unsigned int Random(unsigned int n)
+{
+	Rng ^= Rng >> 12;
+	Rng ^= Rng << 25;
+	Rng ^= Rng >> 27;
+	return (unsigned int)((Rng * 2685821657736338717ULL) >> 33) % n;
+}
+
+static void Fail(const char *what, long expected, long actual)
+{
+	unsigned int i;
+
+	printf("MISMATCH: %s, expected %ld, kernel has %ld\n", what, expected, actual);
+	printf("seed %llu, scenario %lu, step %lu (%lu in scenario). Most recent syscalls:\n", Seed, Scenario, Step, Scenario_Step);
+	for(i = 0; i < HISTORY; i++)
+	{
+		if(History[(Step + 1 + i) % HISTORY][0])
+			printf("  %s\n", History[(Step + 1 + i) % HISTORY]);
+	}
+	exit(1);
+}
+
+static void Expect(const char *what, long expected, long actual)
+{
+	if(expected != actual)
+		Fail(what, expected, actual);
+}
+
+/************************************************************************/
+/*                           REFERENCE MODEL                            */
+/************************************************************************/
+
+static int Model_Slot(PID pid)
+{
+	if(pid == 0 || M.task[(pid - 1) % MAXTHREAD].pid != pid || M.task[(pid - 1) % MAXTHREAD].state == DEAD)
+		return -1;
+	return (pid - 1) % MAXTHREAD;
+}
+
+static MODEL_MUTEX* Model_Mutex(MUTEX id)
+{
+	return (id >= 1 && id <= M.mutexes) ? &M.mutex[id - 1] : NULL;
+}
+
+static MODEL_EVENT* Model_Event(EVENT id)
+{
+	int i;
+
+	for(i = 0; id != 0 && i < MAXEVENT; i++)
+		if(M.event[i].id == id)
+			return &M.event[i];
+	return NULL;
+}
+
+static int Model_Task_Count(void)
+{
+	int i, n = 0;
+
+	for(i = 0; i < MAXTHREAD; i++)
+		n += M.task[i].state != DEAD;
+	return n;
+}
+
+/*Anything that becomes READY while suspended stays suspended, and is READY once resumed*/
+static void Model_Ready(int slot)
+{
+	if(M.task[slot].state == SUSPENDED)
+		M.task[slot].last_state = READY;
+	else
+		M.task[slot].state = READY;
+}
+
+/*Highest priority READY task, ties going round robin from the task dispatched last*/
+static void Model_Dispatch(void)
+{
+	int i, slot, best = -1;
+
+	for(i = 1; i <= MAXTHREAD; i++)
+	{
+		slot = (M.next_p + i) % MAXTHREAD;
+		if(M.task[slot].state == READY && (best < 0 || M.task[slot].pri < M.task[best].pri))
+			best = slot;
+	}
+
+	if(best < 0)
+		Fail("model: nothing to run although the idle puppet never blocks", 0, 0);
+
+	M.next_p = M.running = best;
+	M.task[best].state = RUNNING;
+}
+
+/*Every syscall first processes the ticks that came in since the last one. Returns the highest priority they woke*/
+static PRIORITY Model_Ticks(void)
+{
+	int i;
+	MODEL_TASK *t;
+	PRIORITY woken = LOWEST_PRIORITY + 1;
+
+	if(M.pending_ticks == 0)
+		return woken;
+
+	for(i = 0; i < MAXTHREAD; i++)
+	{
+		t = &M.task[i];
+		if(t->state == SLEEPING)
+		{
+			t->sleep -= M.pending_ticks;
+			if(t->sleep <= 0)
+			{
+				t->sleep = 0;
+				t->state = READY;
+				if(t->pri < woken)
+					woken = t->pri;
+			}
+		}
+		else if(t->state == SUSPENDED && t->last_state == SLEEPING)
+		{
+			t->sleep -= M.pending_ticks;
+			if(t->sleep <= 0)
+			{
+				t->sleep = 0;
+				t->last_state = READY;
+			}
+		}
+	}
+	M.pending_ticks = 0;
+	return woken;
+}
+
+/*A task runs at its base priority, or that of the most important task waiting for a mutex it holds if that's higher*/
+static PRIORITY Model_Effective(int slot)
+{
+	PRIORITY pri = M.task[slot].base_pri;
+	unsigned int i, j;
+
+	for(i = 0; i < M.mutexes; i++)
+	{
+		if(M.mutex[i].owner != M.task[slot].pid)
+			continue;
+		for(j = 0; j < M.mutex[i].nwait; j++)
+			if(M.mutex[i].wait_pri[j] < pri)
+				pri = M.mutex[i].wait_pri[j];
+	}
+	return pri;
+}
+
+/*The mutex a task is waiting for, with its place in the wait queue. NULL if it isn't waiting for one*/
+static MODEL_MUTEX* Model_Waiting_For(PID pid, unsigned int *pos)
+{
+	unsigned int i, j;
+
+	for(i = 0; i < M.mutexes; i++)
+		for(j = 0; j < M.mutex[i].nwait; j++)
+			if(M.mutex[i].wait_pid[j] == pid)
+			{
+				*pos = j;
+				return &M.mutex[i];
+			}
+	return NULL;
+}
+
+/*Recomputes the priority of the task in slot. If it's waiting for a mutex, the owner is recomputed next, and so on*/
+static void Model_Update(int slot)
+{
+	PRIORITY pri;
+	MODEL_MUTEX *m;
+	unsigned int pos;
+
+	while(slot >= 0)
+	{
+		pri = Model_Effective(slot);
+		if(pri == M.task[slot].pri)
+			return;
+		M.task[slot].pri = pri;
+
+		m = Model_Waiting_For(M.task[slot].pid, &pos);
+		if(m == NULL)
+			return;
+		m->wait_pri[pos] = pri;
+		slot = Model_Slot(m->owner);
+	}
+}
+
+/*Releases a mutex held by the task in slot, handing it to the highest priority waiter that came first*/
+static int Model_Release(MODEL_MUTEX *m, int slot)
+{
+	unsigned int i, best = 0;
+	int target;
+
+	if(m->nwait == 0)
+	{
+		m->owner = 0;
+		m->count = 0;
+		Model_Update(slot);
+		return 0;
+	}
+
+	for(i = 1; i < m->nwait; i++)
+		if(m->wait_pri[i] < m->wait_pri[best])
+			best = i;
+
+	target = Model_Slot(m->wait_pid[best]);
+	m->owner = m->wait_pid[best];
+	m->count = 1;
+	for(i = best; i + 1 < m->nwait; i++)
+	{
+		m->wait_pid[i] = m->wait_pid[i + 1];
+		m->wait_pri[i] = m->wait_pri[i + 1];
+	}
+	--m->nwait;
+
+	//The new owner inherits from the remaining waiters
+	Model_Ready(target);
+	Model_Update(slot);
+	Model_Update(target);
+	return 1;
+}
+
+/*Would the running task waiting for m close a cycle of tasks waiting for each other's mutexes?*/
+static int Model_Deadlock(MODEL_MUTEX *m)
+{
+	int i, slot;
+	unsigned int j;
+	PID pid = m->owner;
+	MODEL_MUTEX *next;
+
+	for(i = 0; i < MAXTHREAD; i++)
+	{
+		slot = Model_Slot(pid);
+		if(slot == M.running)
+			return 1;
+
+		//Find the mutex this task waits for, if any
+		next = NULL;
+		for(j = 0; j < M.mutexes && next == NULL; j++)
+		{
+			unsigned int w;
+			for(w = 0; w < M.mutex[j].nwait; w++)
+				if(M.mutex[j].wait_pid[w] == pid)
+					next = &M.mutex[j];
+		}
+		if(next == NULL)
+			return 0;
+		pid = next->owner;
+	}
+	return 0;
+}
+
+/************************************************************************/
+/*                       SYSCALLS AND PREDICTIONS                       */
+/************************************************************************/
+
+enum { OP_YIELD, OP_TICK, OP_CREATE, OP_TERMINATE, OP_SLEEP, OP_SUSPEND, OP_RESUME, OP_EVENT_INIT,
+	OP_EVENT_WAIT, OP_EVENT_SIGNAL, OP_MUTEX_INIT, OP_MUTEX_LOCK, OP_MUTEX_UNLOCK, OP_SET_PRIORITY, OP_COUNT };
+
+static const char *Op_Name[OP_COUNT] = { "Task_Yield", "tick", "Task_Create", "Task_Terminate", "Task_Sleep",
+	"Task_Suspend", "Task_Resume", "Event_Init", "Event_Wait", "Event_Signal", "Mutex_Init", "Mutex_Lock", "Mutex_Unlock",
+	"Task_SetPriority" };
+
+/*Relative frequencies. The idle puppet only gets the ones that can't block it*/
+static const unsigned char Op_Weight[OP_COUNT] = { 10, 12, 6, 3, 8, 5, 6, 3, 6, 8, 1, 10, 10, 5 };
+static const unsigned char Idle_Op[OP_COUNT] = { 1, 1, 1, 0, 0, 1, 1, 1, 0, 1, 0, 0, 0, 1 };
+
+static void Puppet(void);
+
+/*A PID that's usually valid, sometimes dead or nonsense*/
+static PID Random_PID(int allow_idle)
+{
+	int slot;
+	unsigned int r = Random(10);
+
+	if(r == 0)
+		return 0;
+	if(r == 1)
+		return M.last_pid + 1 + Random(3);
+
+	slot = Random(MAXTHREAD);
+	if(slot == IDLE_SLOT && !allow_idle)
+		slot = 1;
+	return M.task[slot].pid;
+}
+
+static unsigned int Random_ID(unsigned int last)
+{
+	return (Random(8) == 0) ? Random(last + 2) : 1 + Random(last > 0 ? last : 1);
+}
+
+static void Do_Op(void)
+{
+	int op, slot, s;
+	unsigned int arg = 0, arg2 = 0, total = 0;
+	MODEL_TASK *c = &M.task[M.running];
+	MODEL_MUTEX *m;
+	MODEL_EVENT *e;
+
+	//Pick a syscall
+	for(op = 0; op < OP_COUNT; op++)
+		if(M.running != IDLE_SLOT || Idle_Op[op])
+			total += Op_Weight[op];
+	arg = Random(total);
+	for(op = 0; op < OP_COUNT; op++)
+	{
+		if(M.running == IDLE_SLOT && !Idle_Op[op])
+			continue;
+		if(arg < Op_Weight[op])
+			break;
+		arg -= Op_Weight[op];
+	}
+	arg = 0;
+
+	M.expect_err = -1;
+
+	//Ticks only count once the kernel is entered
+	if(op != OP_TICK)
+		Model_Ticks();
+
+	switch(op)
+	{
+		case OP_YIELD:
+		c->state = READY;
+		Model_Dispatch();
+		break;
+
+		case OP_TICK:
+		//The tick ISR enters the kernel, which switches to a task the tick woke if it's more important
+		++M.pending_ticks;
+		if(Model_Ticks() < c->pri)
+		{
+			c->state = READY;
+			Model_Dispatch();
+		}
+		break;
+
+		case OP_CREATE:
+		arg = Random(LOWEST_PRIORITY);			//The idle puppet alone has the lowest priority
+		if(Model_Task_Count() == MAXTHREAD)
+		{
+			M.expect_err = MAX_PROCESS_ERR;
+			break;
+		}
+		for(slot = 0; M.task[slot].state != DEAD; slot++);
+		s = M.last_pid + 1 + (slot + MAXTHREAD - M.last_pid % MAXTHREAD) % MAXTHREAD;
+		M.task[slot].pid = M.last_pid = s;
+		M.task[slot].state = READY;
+		M.task[slot].last_state = DEAD;
+		M.task[slot].pri = M.task[slot].base_pri = arg;
+		M.task[slot].sleep = 0;
+		M.expect_err = NO_ERR;
+		break;
+
+		case OP_TERMINATE:
+		for(s = 0; s < (int)M.mutexes; s++)
+			if(M.mutex[s].owner == c->pid)
+				Model_Release(&M.mutex[s], M.running);
+		c->state = DEAD;
+		Model_Dispatch();
+		break;
+
+		case OP_SLEEP:
+		arg = Random(5);
+		c->state = SLEEPING;
+		c->sleep = arg;
+		Model_Dispatch();
+		break;
+
+		case OP_SUSPEND:
+		arg = Random_PID(0);
+		slot = (arg - 1) % MAXTHREAD;
+		if(arg == 0 || M.task[slot].pid != arg)
+		{
+			M.expect_err = PID_NOT_FOUND_ERR;
+			break;
+		}
+		M.expect_err = SUSPEND_NONRUNNING_TASK_ERR;
+		if(M.task[slot].state == DEAD || M.task[slot].state == SUSPENDED)
+			break;
+		for(s = 0; s < (int)M.mutexes; s++)
+			if(M.mutex[s].owner == arg)
+				break;
+		if(s < (int)M.mutexes)
+			break;
+
+		M.task[slot].last_state = (slot == M.running) ? READY : M.task[slot].state;
+		M.task[slot].state = SUSPENDED;
+		M.expect_err = NO_ERR;
+		if(slot == M.running)
+		{
+			M.expect_err = -1;
+			Model_Dispatch();
+		}
+		break;
+
+		case OP_RESUME:
+		arg = Random_PID(0);
+		slot = Model_Slot(arg);
+		if(slot >= 0 && M.task[slot].state == SUSPENDED)
+		{
+			M.task[slot].state = M.task[slot].last_state;
+			M.task[slot].last_state = SUSPENDED;
+		}
+		c->state = READY;
+		Model_Dispatch();
+		break;
+
+		case OP_EVENT_INIT:
+		for(s = 0; s < MAXEVENT && M.event[s].id != 0; s++);
+		if(s == MAXEVENT)
+		{
+			M.expect_err = MAX_EVENT_ERR;
+			break;
+		}
+		M.event[s].id = ++M.last_event;
+		M.event[s].owner = 0;
+		M.event[s].count = 0;
+		M.expect_err = NO_ERR;
+		break;
+
+		case OP_EVENT_WAIT:
+		arg = Random_ID(M.last_event);
+		e = Model_Event(arg);
+		if(e == NULL || (e->owner != 0 && e->owner != c->pid))
+			break;
+		if(e->count > 0)
+		{
+			e->id = 0;					//Consumed events are gone
+			break;
+		}
+		e->owner = c->pid;
+		c->state = WAIT_EVENT;
+		Model_Dispatch();
+		break;
+
+		case OP_EVENT_SIGNAL:
+		arg = Random_ID(M.last_event);
+		e = Model_Event(arg);
+		if(e != NULL)
+		{
+			if(MAX_EVENT_SIG_MISS == 0 || e->count < MAX_EVENT_SIG_MISS)
+				++e->count;
+			if(e->owner != 0)
+			{
+				slot = Model_Slot(e->owner);
+				e->id = 0;
+				Model_Ready(slot);
+			}
+		}
+		c->state = READY;
+		Model_Dispatch();
+		break;
+
+		case OP_MUTEX_INIT:
+		if(M.mutexes == MAXMUTEX)
+		{
+			M.expect_err = MAX_MUTEX_ERR;
+			break;
+		}
+		m = &M.mutex[M.mutexes++];
+		memset(m, 0, sizeof(*m));
+		m->id = M.mutexes;
+		M.expect_err = NO_ERR;
+		break;
+
+		case OP_MUTEX_LOCK:
+		arg = Random_ID(M.mutexes);
+		m = Model_Mutex(arg);
+		if(m == NULL)
+			break;
+		M.expect_err = NO_ERR;
+		if(m->owner == 0)
+		{
+			m->owner = c->pid;
+			m->count = 1;
+		}
+		else if(m->owner == c->pid)
+			++m->count;
+		else if(Model_Deadlock(m))
+			M.expect_err = DEADLOCK_ERR;
+		else
+		{
+			m->wait_pid[m->nwait] = c->pid;
+			m->wait_pri[m->nwait++] = c->pri;
+			c->state = WAIT_MUTEX;
+			Model_Update(Model_Slot(m->owner));
+			M.expect_err = -1;
+			Model_Dispatch();
+		}
+		break;
+
+		case OP_MUTEX_UNLOCK:
+		arg = Random_ID(M.mutexes);
+		m = Model_Mutex(arg);
+		if(m == NULL || m->owner != c->pid)
+			break;
+		if(m->count > 1)
+			--m->count;
+		else if(Model_Release(m, M.running))
+		{
+			c->state = READY;
+			Model_Dispatch();
+		}
+		break;
+
+		case OP_SET_PRIORITY:
+		arg = Random_PID(0);
+		arg2 = Random(LOWEST_PRIORITY);
+		slot = Model_Slot(arg);
+		if(slot >= 0)
+		{
+			M.task[slot].base_pri = arg2;
+			Model_Update(slot);
+		}
+		c->state = READY;
+		Model_Dispatch();
+		break;
+	}
+
+	if(op == OP_SET_PRIORITY)
+		snprintf(History[Step % HISTORY], sizeof(History[0]), "PID %u: %s(%u, %u)", c->pid, Op_Name[op], arg, arg2);
+	else
+		snprintf(History[Step % HISTORY], sizeof(History[0]), "PID %u: %s(%u)", c->pid, Op_Name[op], arg);
+	if(Verbose)
+		printf("%lu: %s\n", Step, History[Step % HISTORY]);
+
+	//Now make the real syscall
+	switch(op)
+	{
+		case OP_YIELD: Task_Yield(); break;
+		case OP_TICK: Disable_Interrupt(); Host_Tick(); Enable_Interrupt(); break;
+		case OP_CREATE: Task_Create(Puppet, arg, 0); break;
+		case OP_TERMINATE: Task_Terminate(); break;
+		case OP_SLEEP: Task_Sleep(arg); break;
+		case OP_SUSPEND: Task_Suspend(arg); break;
+		case OP_RESUME: Task_Resume(arg); break;
+		case OP_EVENT_INIT: Event_Init(); break;
+		case OP_EVENT_WAIT: Event_Wait(arg); break;
+		case OP_EVENT_SIGNAL: Event_Signal(arg); break;
+		case OP_MUTEX_INIT: Mutex_Init(); break;
+		case OP_MUTEX_LOCK: Mutex_Lock(arg); break;
+		case OP_MUTEX_UNLOCK: Mutex_Unlock(arg); break;
+		case OP_SET_PRIORITY: Task_SetPriority(arg, arg2); break;
+	}
+}
+
+/************************************************************************/
+/*                             STATE CHECKS                             */
+/************************************************************************/
+
+static void Check(void)
+{
+	int i, n;
+	unsigned int j, k;
+	char what[64];
+	MODEL_TASK *t;
+	MODEL_MUTEX *m;
+	MUTEX_TYPE *km;
+	EVENT_TYPE *ke;
+
+	Expect("running slot", M.running, Cp - Process);
+	if(M.expect_err >= 0)
+		Expect("err", M.expect_err, err);
+	Expect("Task_Count", Model_Task_Count(), Task_Count);
+
+	for(i = 0; i < MAXTHREAD; i++)
+	{
+		t = &M.task[i];
+		snprintf(what, sizeof(what), "state of slot %d", i);
+		Expect(what, t->state, Process[i].state);
+		if(t->state == DEAD)
+			continue;
+
+		snprintf(what, sizeof(what), "PID in slot %d", i);
+		Expect(what, t->pid, Process[i].pid);
+		snprintf(what, sizeof(what), "priority of PID %u", t->pid);
+		Expect(what, t->pri, Process[i].pri);
+		snprintf(what, sizeof(what), "base priority of PID %u", t->pid);
+		Expect(what, t->base_pri, Process[i].base_pri);
+		if(t->state == SUSPENDED)
+		{
+			snprintf(what, sizeof(what), "state before suspension of PID %u", t->pid);
+			Expect(what, t->last_state, Process[i].last_state);
+		}
+		if(t->state == SLEEPING || (t->state == SUSPENDED && t->last_state == SLEEPING))
+		{
+			snprintf(what, sizeof(what), "sleep ticks left of PID %u", t->pid);
+			Expect(what, t->sleep, Process[i].request_arg);
+		}
+	}
+
+	Expect("number of mutexes", M.mutexes, Last_MutexID);
+	for(j = 0; j < M.mutexes; j++)
+	{
+		m = &M.mutex[j];
+		km = findMutexByMutexID(m->id);
+		snprintf(what, sizeof(what), "owner of mutex %u", m->id);
+		Expect(what, m->owner, km ? km->owner : (PID)-1);
+		if(m->owner == 0)
+			continue;
+
+		snprintf(what, sizeof(what), "lock count of mutex %u", m->id);
+		Expect(what, m->count, km->count);
+		snprintf(what, sizeof(what), "number of tasks waiting for mutex %u", m->id);
+		Expect(what, m->nwait, km->num_of_process);
+		for(k = 0; k < m->nwait; k++)
+		{
+			for(n = 0; n < MAXTHREAD && km->blocked_stack[n] != m->wait_pid[k]; n++);
+			snprintf(what, sizeof(what), "PID %u waiting for mutex %u", m->wait_pid[k], m->id);
+			Expect(what, 1, n < MAXTHREAD);
+			Expect(what, m->id, Process[(m->wait_pid[k] - 1) % MAXTHREAD].request_arg);
+			snprintf(what, sizeof(what), "queued priority of PID %u in mutex %u", m->wait_pid[k], m->id);
+			Expect(what, m->wait_pri[k], km->priority_stack[n]);
+		}
+	}
+
+	for(i = 0, n = 0; i < MAXEVENT; i++)
+	{
+		if(M.event[i].id == 0)
+			continue;
+		++n;
+		ke = findEventByEventID(M.event[i].id);
+		snprintf(what, sizeof(what), "owner of event %u", M.event[i].id);
+		Expect(what, M.event[i].owner, ke ? ke->owner : (PID)-1);
+		snprintf(what, sizeof(what), "count of event %u", M.event[i].id);
+		Expect(what, M.event[i].count, ke->count);
+	}
+	Expect("number of events", n, Event_Count);
+	err = NO_ERR;
+}
+
+/*Every task is a puppet. It checks the outcome of the last syscall, whoever made it, then makes the next one*/
+static void Puppet(void)
+{
+	for(;;)
+	{
+		Check();
+		if(++Step >= Total_Steps || ++Scenario_Step >= Scenario_Steps)
+			setcontext(&Main_Ctx);		//Abandons the kernel and all tasks, the next scenario boots it again
+		Do_Op();
+	}
+}
+
+/************************************************************************/
+/*                                BOOT                                  */
+/************************************************************************/
+
+void Host_On_Tick(void)
+{
+	if(Host_Idling)
+		Fail("kernel went idle although the idle puppet is READY", 0, 1);
+}
+
+/*Boots the kernel with the idle puppet and a few more. Runs on its own stack, which becomes the kernel's*/
+static void Boot(void)
+{
+	int i, n = 2 + Random(4);
+
+	memset(&M, 0, sizeof(M));
+	M.expect_err = -1;
+	Host_Reset();
+	OS_Init();
+
+	Task_Create(Puppet, LOWEST_PRIORITY, 0);
+	for(i = 1; i <= n; i++)
+		Task_Create(Puppet, Random(LOWEST_PRIORITY), 0);
+
+	//Mirror what was created, and the first dispatch
+	for(i = 0; i <= n; i++)
+	{
+		M.task[i].pid = Process[i].pid;
+		M.task[i].pri = M.task[i].base_pri = Process[i].pri;
+		M.task[i].state = READY;
+		M.task[i].last_state = DEAD;
+	}
+	M.last_pid = Last_PID;
+	Model_Dispatch();
+
+	OS_Start();
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	struct timespec start, end;
+	double secs;
+
+	Seed = time(NULL);
+	while((opt = getopt(argc, argv, "s:n:l:v")) != -1)
+	{
+		switch(opt)
+		{
+			case 's': Seed = strtoull(optarg, NULL, 0); break;
+			case 'n': Total_Steps = strtoul(optarg, NULL, 0); break;
+			case 'l': Scenario_Steps = strtoul(optarg, NULL, 0); break;
+			case 'v': Verbose = 1; break;
+			default:
+			fprintf(stderr, "usage: %s [-s seed] [-n steps] [-l steps per scenario] [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	Rng = Seed ? Seed : 1;
+	Host_Entries_Per_Tick = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while(Step < Total_Steps)
+	{
+		++Scenario;
+		Scenario_Step = 0;
+		getcontext(&Boot_Ctx);
+		Boot_Ctx.uc_stack.ss_sp = Boot_Stack;
+		Boot_Ctx.uc_stack.ss_size = sizeof(Boot_Stack);
+		Boot_Ctx.uc_link = NULL;
+		makecontext(&Boot_Ctx, Boot, 0);
+		swapcontext(&Main_Ctx, &Boot_Ctx);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("seed %llu: %lu steps in %lu scenarios passed, %.0f steps/s\n", Seed, Step, Scenario, secs > 0 ? Step / secs : 0.0);
+	return 0;
+}
@@ -3,47 +3,125 @@
 /*Context Switching functions defined in cswitch.s*/
 extern void CSwitch();
 extern void Exit_Kernel();
+extern void Enter_Kernel();
 
 /*System variables used by the kernel only*/
+#ifndef STATIC_OBJECTS
 volatile static PD Process[MAXTHREAD];			//Contains the process descriptor for all tasks, regardless of their current state.
 volatile static EVENT_TYPE Event[MAXEVENT];		//Contains all the event objects 
 volatile static MUTEX_TYPE Mutex[MAXMUTEX];		//Contains all the mutex objects
+volatile static EVENT_GROUP_TYPE EventGroup[MAXEVENTGROUP];	//Contains all the event group objects
+#else
+extern volatile PD Process[MAXTHREAD];			//Declared by the application through OS_STATIC_TASKS()
+extern volatile EVENT_TYPE Event[MAXEVENT];		//Declared by the application through OS_STATIC_EVENTS()
+extern volatile MUTEX_TYPE Mutex[MAXMUTEX];		//Declared by the application through OS_STATIC_MUTEXES()
+extern volatile EVENT_GROUP_TYPE EventGroup[MAXEVENTGROUP];	//Declared by the application through OS_STATIC_EVENT_GROUPS()
+#endif
 
-volatile static unsigned int NextP;				//Which task in the process queue to dispatch next.
+volatile static PER_CPU unsigned int NextP;		//Which task in the process queue to dispatch next.
 volatile static unsigned int Task_Count;		//Number of tasks created so far.
 volatile static unsigned int Event_Count;		//Number of events created so far.
 volatile static unsigned int Mutex_Count;		//Number of Mutexes created so far.
+volatile static unsigned int Event_Group_Count;	//Number of event groups created so far.
+
+volatile static TIMER_TYPE Timer[MAXTIMER];		//Contains all the software timers
+volatile static unsigned int Timer_Count;		//Number of timers created so far.
+volatile static signed char Timer_Active;		//Head of the active timer delta list, -1 = empty
+volatile static signed char Timer_Fired_Head;	//Head of the list of expired timers waiting for their callback, -1 = empty
+volatile static signed char Timer_Fired_Tail;	//Tail of the list of expired timers
+volatile static PD *Timer_Daemon;				//The task running timer callbacks, created along with the first timer
+
+volatile static POOL_TYPE Pool[MAXPOOL];		//Contains all the memory pools
+volatile static unsigned int Pool_Count;		//Number of memory pools created so far.
+volatile static COND_TYPE Cond[MAXCOND];		//Contains all the condition variables
+volatile static unsigned int Cond_Count;		//Number of condition variables created so far.
+volatile static RWLOCK_TYPE RWLock[MAXRWLOCK];	//Contains all the reader-writer locks
+volatile static unsigned int RWLock_Count;		//Number of reader-writer locks created so far.
+volatile static tlsdestructor TLS_Destructor[MAXTLS];	//Destructor of each task-local storage key, NULL = none
+volatile static PT *PT_List[LOWEST_PRIORITY+1];	//Protothreads of each priority, newest first
+volatile static PD *PT_Runner[LOWEST_PRIORITY+1];	//The task running each priority's protothreads, created along with its first one
+volatile static BASIC_TYPE Basic[MAXBASIC];		//Contains all the basic tasks
+volatile static signed char Basic_Head[LOWEST_PRIORITY+1];	//Queue of activated basic tasks of each priority, -1 = empty
+volatile static signed char Basic_Tail[LOWEST_PRIORITY+1];	//Tail of each queue
+volatile static PD *Basic_Runner[LOWEST_PRIORITY+1];	//The task running each priority's basic tasks, created along with its first one
 volatile static unsigned int Tick_Count;		//Number of timer ticks missed
+volatile static TICK Sys_Ticks;					//Number of timer ticks processed since the kernel started
+volatile static PER_CPU unsigned char InKernel;	//Is the kernel itself running right now (as opposed to a task)?
+volatile static PER_CPU unsigned char KernelIdle;	//Is the kernel waiting for an interrupt in Dispatch()?
+volatile static PER_CPU PRIORITY Woken_Pri;		//Highest priority made READY since the last check. Decides if work deferred by ISRs preempts the running task
+volatile static DEFERRED_WORK Deferred[DEFERRED_SIZE];	//Ring of work queued by ISRs for the kernel
+volatile static unsigned char Deferred_Head;	//Next work to do
+volatile static unsigned char Deferred_Tail;	//Where ISRs queue the next work
+volatile static unsigned int Deferred_Overflows;	//Work dropped because the queue was full
+
+volatile static unsigned char EDF_Heap[MAXTHREAD];	//Min-heap of READY EDF tasks (indices into Process), ordered by absolute deadline
+volatile static unsigned int EDF_Heap_Size;		//Number of tasks in the EDF heap
+
+#ifdef ADMISSION_CONTROL
+static SCHED_TASK Admission_Set[MAXTHREAD];		//Scratch space for describing the periodic task set to the analysis
+#endif
+
+#ifdef HOST_SMP
+static PD *volatile Cpu_Running[HOST_MAX_CPUS];	//The task each virtual CPU is running, NULL while its kernel runs or idles
+volatile static unsigned long Steals;			//Tasks a virtual CPU took off another one's run queue
+static PER_CPU unsigned char Resched_Due;		//Another virtual CPU interrupted this one to have it look at the run queues
+#endif
 
 /*Variables accessible by OS*/
-volatile PD* Cp;		
-volatile unsigned char *KernelSp;				//Pointer to the Kernel's own stack location.
-volatile unsigned char *CurrentSp;				//Pointer to the stack location of the current running task. Used for saving into PD during ctxswitch.						//The process descriptor of the currently RUNNING task. CP is used to pass information from OS calls to the kernel telling it what to do.
+PER_CPU volatile PD* Cp;		
+PER_CPU volatile unsigned char *KernelSp;		//Pointer to the Kernel's own stack location.
+PER_CPU volatile unsigned char *CurrentSp;				//Pointer to the stack location of the current running task. Used for saving into PD during ctxswitch.						//The process descriptor of the currently RUNNING task. CP is used to pass information from OS calls to the kernel telling it what to do.
 volatile unsigned int KernelActive;				//Indicates if kernel has been initialzied by OS_Start().
 volatile unsigned int Last_PID;					//Last (also highest) PID value created so far.
 volatile unsigned int Last_EventID;				//Last (also highest) EVENT value created so far.
 volatile unsigned int Last_MutexID;				//Last (also highest) MUTEX value created so far.
-volatile ERROR_TYPE err;						//Error code for the previous kernel operation (if any)
+volatile unsigned int Last_EventGroupID;		//Last (also highest) EVENT_GROUP value created so far.
+volatile unsigned int Last_TimerID;				//Last (also highest) TIMER value created so far.
+volatile unsigned int Last_PoolID;				//Last (also highest) POOL value created so far.
+volatile unsigned int Last_CondID;				//Last (also highest) COND value created so far.
+volatile unsigned int Last_RWLockID;			//Last (also highest) RWLOCK value created so far.
+volatile unsigned int Last_TLSKey;				//Last (also highest) TLS_KEY value created so far. Keys are never deleted, so also their count
+volatile unsigned int Last_BasicID;				//Last (also highest) BASIC value created so far. Basic tasks are never deleted, so also their count
+PER_CPU volatile ERROR_TYPE err;				//Error code for the previous kernel operation (if any)
+volatile unsigned int Total_Deadline_Misses;	//Deadline misses of all periodic tasks combined
+
+#ifdef PROFILER
+volatile PROFILE_ENTRY Profile[PROFILE_SIZE];	//Sample counts, hashed by address and task
+volatile unsigned long Profile_Samples;			//Samples taken
+volatile unsigned int Profile_Dropped;			//Samples that found no room in Profile
+#endif
+
+#ifdef ISR_TRACE
+volatile TRACE_RECORD Trace_Buffer[TRACE_SIZE];	//Interrupt arrivals in the order they came in
+volatile unsigned int Trace_Count;				//Records in Trace_Buffer
+volatile unsigned int Trace_Dropped;			//Arrivals that didn't fit in Trace_Buffer
+volatile static unsigned long Kernel_Entries;	//Number of times a task entered the kernel, i.e. the program point an interrupt arrived at
+#endif
+
+#ifdef CLI_TIMING
+volatile static CLI_WINDOW CLI_Longest;			//Longest stretch with interrupts disabled so far
+volatile static CLI_WINDOW CLI_Current;			//The stretch going on, its length being the TCNT4 it began at
+volatile static unsigned char CLI_Open;			//Is CLI_Current being timed?
+#endif
 
 
 /************************************************************************/
 /*						  KERNEL-ONLY HELPERS                           */
 /************************************************************************/
 
-/*Returns the pointer of a process descriptor in the global process list, by searching for its PID*/
-PD* findProcessByPID(int pid)
+/*Returns the pointer of a process descriptor in the global process list. PIDs encode their slot, so this is O(1)*/
+PD* findProcessByPID(PID pid)
 {
-	int i;
+	PD *p;
 	
 	//Valid PIDs must be greater than 0.
-	if(pid <=0)
+	if(pid == 0)
 	return NULL;
 	
-	for(i=0; i<MAXTHREAD; i++)
-	{
-		if (Process[i].pid == pid)
-		return &(Process[i]);
-	}
+	//The slot may have been reused by a newer task since
+	p = &(Process[(pid - 1) % MAXTHREAD]);
+	if (p->pid == pid)
+		return p;
 	
 	//No process with such PID
 	return NULL;
@@ -107,400 +185,3083 @@ MUTEX_TYPE* findMutexByMutexID(MUTEX m)
 	return NULL;
 }
 
-/************************************************************************/
-/*				   		       OS HELPERS                               */
-/************************************************************************/
-
-/*Returns the PID associated with a function's memory address*/
-int findPIDByFuncPtr(voidfuncptr f)
+EVENT_GROUP_TYPE* findEventGroupByID(EVENT_GROUP g)
 {
 	int i;
 	
-	for(i=0; i<MAXTHREAD; i++)
+	//Ensure the request event group ID is > 0
+	if(g <= 0)
 	{
-		if (Process[i].code == f)
-			return Process[i].pid;
+		err = INVALID_ARG_ERR;
+		return NULL;
 	}
 	
-	//No process with such PID
-	return -1;
+	//Find the requested event group and return its pointer if found
+	for(i=0; i<MAXEVENTGROUP; i++)
+	{
+		if(EventGroup[i].id == g)
+			return &EventGroup[i];
+	}
+	
+	err = EVENT_GROUP_NOT_FOUND_ERR;
+	return NULL;
 }
 
-/*Only useful if our RTOS allows more than one missed event signals to be recorded*/
-int getEventCount(EVENT e)
+TIMER_TYPE* findTimerByID(TIMER t)
 {
-	EVENT_TYPE* e1 = findEventByEventID(e);
+	int i;
 	
-	if(e1 == NULL) 
-		return 0;
-		
-	return e1->count;	
+	//Ensure the request timer ID is > 0
+	if(t <= 0)
+	{
+		err = INVALID_ARG_ERR;
+		return NULL;
+	}
+	
+	//Find the requested timer and return its pointer if found
+	for(i=0; i<MAXTIMER; i++)
+	{
+		if(Timer[i].id == t)
+			return &Timer[i];
+	}
+	
+	err = TIMER_NOT_FOUND_ERR;
+	return NULL;
 }
 
-/************************************************************************/
-/*                  ISR FOR HANDLING SLEEP TICKS                        */
-/************************************************************************/
+POOL_TYPE* findPoolByID(POOL p)
+{
+	int i;
+	
+	//Ensure the request pool ID is > 0
+	if(p <= 0)
+	{
+		err = INVALID_ARG_ERR;
+		return NULL;
+	}
+	
+	//Find the requested pool and return its pointer if found
+	for(i=0; i<MAXPOOL; i++)
+	{
+		if(Pool[i].id == p)
+			return &Pool[i];
+	}
+	
+	err = POOL_NOT_FOUND_ERR;
+	return NULL;
+}
 
-//Timer tick ISR
-ISR(TIMER1_COMPA_vect)
+COND_TYPE* findCondByID(COND c)
 {
-	++Tick_Count;
+	int i;
+	
+	//Ensure the request condition variable ID is > 0
+	if(c <= 0)
+	{
+		err = INVALID_ARG_ERR;
+		return NULL;
+	}
+	
+	//Find the requested condition variable and return its pointer if found
+	for(i=0; i<MAXCOND; i++)
+	{
+		if(Cond[i].id == c)
+			return &Cond[i];
+	}
+	
+	err = COND_NOT_FOUND_ERR;
+	return NULL;
 }
 
-//Processes all tasks that are currently sleeping and decrement their sleep ticks when called. Expired sleep tasks are placed back into their old state
-void Kernel_Tick_Handler()
+RWLOCK_TYPE* findRWLockByID(RWLOCK l)
 {
 	int i;
 	
-	//No ticks has been issued yet, skipping...
-	if(Tick_Count == 0)
-		return;
+	//Ensure the request lock ID is > 0
+	if(l <= 0)
+	{
+		err = INVALID_ARG_ERR;
+		return NULL;
+	}
 	
-	for(i=0; i<MAXTHREAD; i++)
+	//Find the requested lock and return its pointer if found
+	for(i=0; i<MAXRWLOCK; i++)
 	{
-		//Process any active tasks that are sleeping
-		if(Process[i].state == SLEEPING)
-		{
-			//If the current sleeping task's tick count expires, put it back into its READY state
-			Process[i].request_arg -= Tick_Count;
-			if(Process[i].request_arg <= 0)
-			{
-				Process[i].state = READY;
-				Process[i].request_arg = 0;
-			}
-		}
-		
-		//Process any SUSPENDED tasks that were previously sleeping
-		else if(Process[i].last_state == SLEEPING)
-		{
-			//When task_resume is called again, the task will be back into its READY state instead if its sleep ticks expired.
-			Process[i].request_arg -= Tick_Count;
-			if(Process[i].request_arg <= 0)
-			{
-				Process[i].last_state = READY;
-				Process[i].request_arg = 0;
-			}
-		}
+		if(RWLock[i].id == l)
+			return &RWLock[i];
 	}
-	Tick_Count = 0;
+	
+	err = RWLOCK_NOT_FOUND_ERR;
+	return NULL;
+}
+
+/*Returns the highest priority task in a set of waiters. Ties go to the lowest slot*/
+static PD* Highest_Priority_Waiter(THREAD_MASK waiters)
+{
+	PD *best = NULL;
+	unsigned int i;
+	
+	for(i=0; waiters != 0; i++, waiters >>= 1)
+	{
+		if((waiters & 1) && (best == NULL || Process[i].pri < best->pri))
+			best = &Process[i];
+	}
+	return best;
 }
 
 /************************************************************************/
-/*                   TASK RELATED KERNEL FUNCTIONS                      */
+/*                        EDF READY HEAP                                */
 /************************************************************************/
 
-/* Handles all low level operations for creating a new task */
-void Kernel_Create_Task(voidfuncptr f, PRIORITY py, int arg)
+/*Does task a have an earlier deadline than task b? Safe across tick counter wraparound*/
+static int EDF_Earlier(unsigned int a, unsigned int b)
 {
-	int x;
-	unsigned char *sp;
-	PD *p;
+	return (int)(Process[a].abs_deadline - Process[b].abs_deadline) < 0;
+}
 
-	#ifdef DEBUG
-	int counter = 0;
-	#endif
+/*Swaps two heap entries and keeps their heap_pos up to date*/
+static void EDF_Swap(unsigned int i, unsigned int j)
+{
+	unsigned char temp = EDF_Heap[i];
 	
-	//Make sure the system can still have enough resources to create more tasks
-	if (Task_Count == MAXTHREAD)
+	EDF_Heap[i] = EDF_Heap[j];
+	EDF_Heap[j] = temp;
+	Process[EDF_Heap[i]].heap_pos = i;
+	Process[EDF_Heap[j]].heap_pos = j;
+}
+
+static void EDF_Sift_Up(unsigned int i)
+{
+	while(i > 0 && EDF_Earlier(EDF_Heap[i], EDF_Heap[(i-1)/2]))
 	{
-		#ifdef DEBUG
-		printf("Task_Create: Failed to create task. The system is at its process threshold.\n");
-		#endif
-		
-		err = MAX_PROCESS_ERR;
-		return;
+		EDF_Swap(i, (i-1)/2);
+		i = (i-1)/2;
 	}
+}
 
-	//Find a dead or empty PD slot to allocate our new task
-	for (x = 0; x < MAXTHREAD; x++)
-	if (Process[x].state == DEAD) break;
+static void EDF_Sift_Down(unsigned int i)
+{
+	unsigned int child;
 	
-	++Task_Count;
-	p = &(Process[x]);
+	while((child = 2*i + 1) < EDF_Heap_Size)
+	{
+		//Pick the child with the earlier deadline
+		if(child + 1 < EDF_Heap_Size && EDF_Earlier(EDF_Heap[child+1], EDF_Heap[child]))
+			++child;
+		
+		if(!EDF_Earlier(EDF_Heap[child], EDF_Heap[i]))
+			break;
+		
+		EDF_Swap(i, child);
+		i = child;
+	}
+}
+
+/*Queues an EDF task by its absolute deadline*/
+static void EDF_Heap_Push(PD *p)
+{
+	unsigned int i = EDF_Heap_Size++;
 	
-	/*The code below was agglomerated from Kernel_Create_Task_At;*/
+	EDF_Heap[i] = p - Process;
+	p->heap_pos = i;
+	EDF_Sift_Up(i);
+}
+
+/*Removes the task at position i from the EDF heap*/
+static void EDF_Heap_Remove(unsigned int i)
+{
+	Process[EDF_Heap[i]].heap_pos = -1;
 	
-	//Initializing the workspace memory for the new task
-	sp = (unsigned char *) &(p->workSpace[WORKSPACE-1]);
-	memset(&(p->workSpace),0,WORKSPACE);
+	if(i != --EDF_Heap_Size)
+	{
+		EDF_Heap[i] = EDF_Heap[EDF_Heap_Size];
+		Process[EDF_Heap[i]].heap_pos = i;
+		EDF_Sift_Down(i);
+		EDF_Sift_Up(i);
+	}
+}
 
-	//Store terminate at the bottom of stack to protect against stack underrun.
-	*(unsigned char *)sp-- = ((unsigned int)Task_Terminate) & 0xff;
-	*(unsigned char *)sp-- = (((unsigned int)Task_Terminate) >> 8) & 0xff;
-	*(unsigned char *)sp-- = 0x00;
+/*Is the task scheduled by deadline right now? EDF tasks leave the band while inheriting a priority or demoted for overrunning their budget*/
+static int In_EDF_Band(PD *p)
+{
+	return p->sched == SCHED_EDF && p->pri == EDF_PRIORITY;
+}
 
-	//Place return address of function at bottom of stack
-	*(unsigned char *)sp-- = ((unsigned int)f) & 0xff;
-	*(unsigned char *)sp-- = (((unsigned int)f) >> 8) & 0xff;
-	*(unsigned char *)sp-- = 0x00;
+/*Returns the READY EDF task with the earliest deadline. Tasks that left the READY state since being queued are dropped lazily*/
+static PD* EDF_Heap_Peek()
+{
+	while(EDF_Heap_Size > 0)
+	{
+		if(Process[EDF_Heap[0]].state == READY && In_EDF_Band(&Process[EDF_Heap[0]]))
+			return &Process[EDF_Heap[0]];
+		
+		EDF_Heap_Remove(0);
+	}
+	return NULL;
+}
 
-	//Allocate the stack with enough memory spaces to save the registers needed for ctxswitch
-	#ifdef DEBUG
-	 //Fill stack with initial values for development debugging
-	 for (counter = 0; counter < 34; counter++)
-	 {
-		 *(unsigned char *)sp-- = counter;
-	 }
-	#else
-	 //Place stack pointer at top of stack
-	 sp = sp - 34;
-	#endif
+/*Is a task in this state blocked on a kernel object? Sleeping and throttled tasks only wait for time to pass*/
+static int Is_Blocked_State(PROCESS_STATES s)
+{
+	return s >= WAIT_EVENT && s != THROTTLED;
+}
+
+#ifdef HOST_SMP
+/*Should task a run before task b? The order Dispatch() has on a single CPU: by priority, then EDF tasks in their band by deadline*/
+static int Kernel_SMP_Before(PD *a, PD *b)
+{
+	if(a->pri != b->pri)
+		return a->pri < b->pri;
+	if(!In_EDF_Band(a))
+		return 0;
+	return !In_EDF_Band(b) || (int)(a->abs_deadline - b->abs_deadline) < 0;
+}
+
+/*Picks what this virtual CPU runs next: the best READY task on its own run queue, round robin among equals. It steals a task
+  of a higher priority from another CPU's queue, or any task if it has none of its own, preferring the CPU with the most
+  tasks waiting. Returns the task's index in the process list, or -1 if there's nothing to run*/
+static int Kernel_SMP_Pick(void)
+{
+	unsigned char queued[HOST_MAX_CPUS] = { 0 };
+	int local = -1, remote = -1;
+	unsigned int i, n;
+	PD *p, *r;
 	
-	//Build the process descriptor for the new task
-	p->pid = ++Last_PID;
-	p->pri = py;
-	p->arg = arg;
-	p->request = NONE;
-	p->state = READY;
-	p->sp = sp;					/* stack pointer into the "workSpace" */
-	p->code = f;				/* function to be executed as a task */
+	//A READY task may still run on a CPU that hasn't got to an interrupt since it was suspended and resumed again
+	for(i=0; i<MAXTHREAD; i++)
+		if(Process[i].state == READY && Process[i].on_cpu < 0)
+			++queued[(int)Process[i].cpu];
 	
-	//No errors occured
-	err = NO_ERR;
+	for(n=1; n<=MAXTHREAD; n++)
+	{
+		i = (NextP + n) % MAXTHREAD;
+		p = &Process[i];
+		if(p->state != READY || p->on_cpu >= 0)
+			continue;
+		
+		if(p->cpu == Host_CPU)
+		{
+			if(local < 0 || Kernel_SMP_Before(p, &Process[local]))
+				local = i;
+			continue;
+		}
+		
+		r = (remote < 0) ? NULL : &Process[remote];
+		if(r == NULL || Kernel_SMP_Before(p, r) || (!Kernel_SMP_Before(r, p) && queued[(int)p->cpu] > queued[(int)r->cpu]))
+			remote = i;
+	}
+	
+	if(remote >= 0 && (local < 0 || Process[remote].pri < Process[local].pri))
+		return remote;
+	return local;
 }
 
-/*TODO: Check for mutex ownership. If PID owns any mutex, ignore this request*/
-static void Kernel_Suspend_Task() 
+/*Lets the other virtual CPUs know that task p changed, like an inter-processor interrupt would. The CPU running p looks at
+  it again, e.g. because it was suspended or lost a priority it inherited. A READY task is left to its own CPU if that's idle
+  or runs something less important. Otherwise an idle CPU steals it, or the one running the least important task it outranks*/
+static void Kernel_SMP_Notice(PD *p)
 {
-	//Finds the process descriptor for the specified PID
-	PD* p = findProcessByPID(Cp->request_arg);
+	PD *r;
+	int c, victim = -1;
 	
-	//Ensure the PID specified in the PD currently exists in the global process list
-	if(p == NULL)
+	if(!KernelActive)
+		return;
+	
+	if(p->on_cpu >= 0)
 	{
-		#ifdef DEBUG
-			printf("Kernel_Suspend_Task: PID not found in global process list!\n");
-		#endif
-		err = PID_NOT_FOUND_ERR;
+		if(p->on_cpu != Host_CPU)
+			Host_Resched(p->on_cpu);
 		return;
 	}
+	if(p->state != READY)
+		return;
 	
-	//Ensure the task is not in a unsuspendable state
-	if(p->state == DEAD || p->state == SUSPENDED)
+	//This CPU looks at its run queue anyway before it runs a task again
+	if(p->cpu == Host_CPU)
 	{
-		#ifdef DEBUG
-		printf("Kernel_Suspend_Task: Trying to suspend a task that's in an unsuspendable state %d!\n", p->state);
-		#endif
-		err = SUSPEND_NONRUNNING_TASK_ERR;
+		if(KernelIdle)
+			return;
+	}
+	else if(Cpu_Running[(int)p->cpu] == NULL || Kernel_SMP_Before(p, Cpu_Running[(int)p->cpu]))
+	{
+		Host_Resched(p->cpu);
 		return;
 	}
 	
-	//Ensure the task is not currently owning a mutex
-	for(int i=0; i<MAXMUTEX; i++) {
-		if (Mutex[i].owner == p->pid) {
-			#ifdef DEBUG
-			printf("Kernel_Suspend_Task: Trying to suspend a task that currently owns a mutex\n");
-			#endif
-			err = SUSPEND_NONRUNNING_TASK_ERR;
+	for(c=0; c<Host_CPUs; c++)
+	{
+		r = Cpu_Running[c];
+		if(c == Host_CPU || c == p->cpu)
+			continue;
+		if(r == NULL)
+		{
+			Host_Resched(c);
 			return;
 		}
+		if(Kernel_SMP_Before(p, r) && (victim < 0 || Kernel_SMP_Before(Cpu_Running[victim], r)))
+			victim = c;
 	}
+	if(victim >= 0)
+		Host_Resched(victim);
+}
+
+/*Queues a new task on the virtual CPU with the fewest tasks*/
+static void Kernel_SMP_Place(PD *p)
+{
+	unsigned char tasks[HOST_MAX_CPUS] = { 0 };
+	int i, c = 0;
 	
-	//Save its current state and set it to SUSPENDED
-	p->last_state = p->state;
-	p->state = SUSPENDED;
-	err = NO_ERR;
+	for(i=0; i<MAXTHREAD; i++)
+		if(Process[i].state != DEAD && &Process[i] != p)
+			++tasks[(int)Process[i].cpu];
+	for(i=1; i<Host_CPUs; i++)
+		if(tasks[i] < tasks[c])
+			c = i;
+	
+	p->cpu = c;
+	p->on_cpu = -1;
 }
 
-static void Kernel_Resume_Task()
+/*Charges a tick to the task running on every virtual CPU. One whose task used up its budget gets an interrupt to throttle it*/
+static void Kernel_SMP_Charge_Tick(void)
 {
-	//Finds the process descriptor for the specified PID
-	PD* p = findProcessByPID(Cp->request_arg);
+	PD *p;
+	int c;
 	
-	//Ensure the PID specified in the PD currently exists in the global process list
-	if(p == NULL)
+	for(c=0; c<Host_CPUs; c++)
 	{
-		#ifdef DEBUG
-			printf("Kernel_Resume_Task: PID not found in global process list!\n");
-		#endif
-		err = PID_NOT_FOUND_ERR;
-		return;
+		p = Cpu_Running[c];
+		if(p == NULL || p->budget == 0 || p->budget_left == 0)
+			continue;
+		
+		if(--p->budget_left == 0 && c != Host_CPU)
+			Host_Resched(c);
+	}
+}
+
+unsigned long getSteals()
+{
+	return Steals;
+}
+#endif
+
+/*Puts a task into the READY state, queuing it by deadline if it's an EDF task*/
+static void Kernel_Ready_Task(PD *p)
+{
+	p->wait_ticks = 0;
+	
+	//It got what it was blocked on, or gave up waiting. A suspended waiter leaves its wait as well
+	if(Is_Blocked_State(p->state == SUSPENDED ? p->last_state : p->state))
+		UNBLOCK_HOOK(p, p->request);
+	
+	//A suspended task got what it was waiting for, but stays suspended until it's resumed
+	if(p->state == SUSPENDED)
+	{
+		p->last_state = READY;
+		return;
+	}
+	
+	p->state = READY;
+	
+	if(p->pri < Woken_Pri)
+		Woken_Pri = p->pri;
+	
+	if(In_EDF_Band(p) && p->heap_pos < 0)
+		EDF_Heap_Push(p);
+	
+	#ifdef HOST_SMP
+	Kernel_SMP_Notice(p);
+	#endif
+}
+
+/*Wakes a protothread runner blocked until one of its protothreads can go on, so it looks at them again*/
+static void Kernel_Wake_Runner(PD *runner)
+{
+	if(runner->state == WAIT_PT || (runner->state == SUSPENDED && runner->last_state == WAIT_PT))
+		Kernel_Ready_Task(runner);
+}
+
+/*Works out the priority a task runs at: its base priority, or the background priority while it's demoted for overrunning its
+  budget, raised to that of the most important task waiting for a mutex or reader-writer lock it holds*/
+static PRIORITY Kernel_Effective_Priority(PD *p)
+{
+	THREAD_MASK bit = (THREAD_MASK)1 << (p - Process);
+	PRIORITY pri = (p->throttled && p->budget_action == BUDGET_DEMOTE) ? BACKGROUND_PRIORITY : p->base_pri;
+	PD *waiter;
+	int i, j;
+	
+	for(i=0; i<MAXMUTEX; i++)
+	{
+		if(Mutex[i].id == 0 || Mutex[i].owner != p->pid)
+			continue;
+		
+		//Free places in the wait queue hold LOWEST_PRIORITY+1
+		for(j=0; j<MAXTHREAD; j++)
+			if(Mutex[i].priority_stack[j] < pri)
+				pri = Mutex[i].priority_stack[j];
+	}
+	
+	for(i=0; i<MAXRWLOCK; i++)
+	{
+		if(RWLock[i].id == 0 || (RWLock[i].writer != p->pid && !(RWLock[i].readers & bit)))
+			continue;
+		
+		waiter = Highest_Priority_Waiter(RWLock[i].read_waiters | RWLock[i].write_waiters);
+		if(waiter != NULL && waiter->pri < pri)
+			pri = waiter->pri;
+	}
+	
+	return pri;
+}
+
+static void RWLock_Inherit(RWLOCK_TYPE *l);
+
+/*Brings a task's priority up to date after anything it depends on changed, requeuing it if it's READY. A task waiting for
+  a mutex moves up or down its wait queue, and passes the change on to the owner, and so on down the chain*/
+static void Kernel_Update_Priority(PD *p)
+{
+	PROCESS_STATES state;
+	MUTEX_TYPE *m;
+	PRIORITY pri;
+	int i, n;
+	
+	//Kernel_Would_Deadlock() keeps mutex chains free of cycles, so one is never longer than the number of tasks
+	for(n=0; p != NULL && n < MAXTHREAD; n++)
+	{
+		pri = Kernel_Effective_Priority(p);
+		if(pri == p->pri)
+			return;
+		
+		//EDF tasks drop out of the deadline heap when they leave their band, and are queued again when they come back
+		if(p->heap_pos >= 0)
+			EDF_Heap_Remove(p->heap_pos);
+		p->pri = pri;
+		if(p->state == READY)
+			Kernel_Ready_Task(p);
+		#ifdef HOST_SMP
+		else
+			Kernel_SMP_Notice(p);		//It may be running on another virtual CPU
+		#endif
+		
+		//A suspended task keeps its place in any wait queue
+		state = (p->state == SUSPENDED) ? p->last_state : p->state;
+		if(state == WAIT_RWLOCK)
+		{
+			RWLock_Inherit(findRWLockByID(p->request_arg));
+			return;
+		}
+		if(state != WAIT_MUTEX)
+			return;
+		
+		m = findMutexByMutexID(p->request_arg);
+		if(m == NULL)
+			return;
+		for(i=0; i<MAXTHREAD; i++)
+			if(m->blocked_stack[i] == p->pid)
+				m->priority_stack[i] = pri;
+		p = findProcessByPID(m->owner);
+	}
+}
+
+/************************************************************************/
+/*				   		       OS HELPERS                               */
+/************************************************************************/
+
+/*Returns the PID associated with a function's memory address*/
+int findPIDByFuncPtr(voidfuncptr f)
+{
+	int i;
+	
+	for(i=0; i<MAXTHREAD; i++)
+	{
+		if (Process[i].code == f)
+			return Process[i].pid;
+	}
+	
+	//No process with such PID
+	return -1;
+}
+
+/*Only useful if our RTOS allows more than one missed event signals to be recorded*/
+int getEventCount(EVENT e)
+{
+	EVENT_TYPE* e1 = findEventByEventID(e);
+	
+	if(e1 == NULL) 
+		return 0;
+		
+	return e1->count;	
+}
+
+/*Returns how many jobs of a periodic task have missed their deadline*/
+unsigned int getDeadlineMisses(PID p)
+{
+	PD* p1 = findProcessByPID(p);
+	
+	if(p1 == NULL)
+		return 0;
+	
+	return p1->deadline_misses;
+}
+
+/*Returns the base priority of a task, or the one it runs at right now if effective is set. LOWEST_PRIORITY+1 if there's no such task*/
+PRIORITY getTaskPriority(PID p, unsigned char effective)
+{
+	PD* p1 = findProcessByPID(p);
+	
+	if(p1 == NULL || p1->state == DEAD)
+		return LOWEST_PRIORITY + 1;
+	
+	return effective ? p1->pri : p1->base_pri;
+}
+
+/*Returns the PID of the task running the protothreads of a priority, 0 if it has none yet*/
+PID getPTRunner(PRIORITY py)
+{
+	if(py > LOWEST_PRIORITY || PT_Runner[py] == NULL)
+		return 0;
+	
+	return PT_Runner[py]->pid;
+}
+
+/*Returns the flags currently set in an event group*/
+EVENT_BITS getEventGroupBits(EVENT_GROUP g)
+{
+	EVENT_GROUP_TYPE* g1 = findEventGroupByID(g);
+	
+	if(g1 == NULL)
+		return 0;
+	
+	return g1->bits;
+}
+
+/*Returns how many blocks of a memory pool are in use*/
+unsigned int getPoolUsed(POOL p)
+{
+	POOL_TYPE* p1 = findPoolByID(p);
+	
+	if(p1 == NULL)
+		return 0;
+	
+	return p1->used;
+}
+
+/*Returns how many times a task had to wait for a mutex*/
+unsigned int getMutexContention(MUTEX m)
+{
+	MUTEX_TYPE* m1 = findMutexByMutexID(m);
+	
+	if(m1 == NULL)
+		return 0;
+	
+	return m1->contended;
+}
+
+/*Returns the most blocks of a memory pool that were ever in use at once*/
+unsigned int getPoolHighWater(POOL p)
+{
+	POOL_TYPE* p1 = findPoolByID(p);
+	
+	if(p1 == NULL)
+		return 0;
+	
+	return p1->high_water;
+}
+
+/************************************************************************/
+/*                  ISR FOR HANDLING SLEEP TICKS                        */
+/************************************************************************/
+
+static void Kernel_Wait_Timeout(PD *p);
+static void Kernel_Timer_Tick(unsigned int ticks);
+static int Kernel_Release_Mutexes(PD *p);
+
+/*Queues work for the kernel. Called by ISRs instead of touching kernel objects, which the kernel may be in the middle of updating*/
+static void Kernel_Defer(unsigned char type, unsigned int id, unsigned int bits, unsigned char action, void *block)
+{
+	unsigned char sreg = SREG;
+	unsigned char next;
+	volatile DEFERRED_WORK *w;
+	
+	Disable_Interrupt();
+	next = (Deferred_Tail + 1) % DEFERRED_SIZE;
+	if(next == Deferred_Head)
+	{
+		++Deferred_Overflows;
+	}
+	else
+	{
+		w = &Deferred[Deferred_Tail];
+		w->type = type;
+		w->id = id;
+		w->bits = bits;
+		w->action = action;
+		w->block = block;
+		Deferred_Tail = next;
+	}
+	Restore_Interrupt(sreg);
+}
+
+/*Called at the end of ISRs that queued work for the kernel. An interrupted task enters the kernel so the work is done right
+  away, and is only switched out if it woke something more important. A running kernel does the work before it leaves*/
+static void Kernel_ISR_Preempt()
+{
+	#ifdef HOST_SMP
+	//Another virtual CPU may have suspended Cp, or resumed it again, while it runs here. It's still this CPU's until it enters
+	if(KernelActive && !InKernel && Cp->on_cpu == Host_CPU)
+	#else
+	if(KernelActive && !InKernel && Cp->state == RUNNING)
+	#endif
+	{
+		Cp->request = NONE;
+		Enter_Kernel();
+	}
+}
+
+#ifdef HOST_SMP
+/*Handles Host_Resched() on the virtual CPU it was sent to. The kernel looks at the run queues, and at what changed about Cp*/
+void Kernel_Resched_ISR()
+{
+	Resched_Due = 1;
+	Kernel_ISR_Preempt();
+}
+#endif
+
+unsigned int getDeferredOverflows()
+{
+	return Deferred_Overflows;
+}
+
+#ifdef ISR_TRACE
+/*Records the arrival of an interrupt. Called first thing in an ISR through TRACE_ISR()*/
+void Kernel_Trace_ISR(unsigned char vector)
+{
+	volatile TRACE_RECORD *r;
+	
+	if(Trace_Count >= TRACE_SIZE)
+	{
+		++Trace_Dropped;
+		return;
+	}
+	
+	r = &Trace_Buffer[Trace_Count++];
+	r->entry = Kernel_Entries;
+	r->tick = Sys_Ticks + Tick_Count;
+	r->tcnt = TCNT1;
+	r->vector = vector;
+	r->where = !InKernel ? TRACE_TASK : KernelIdle ? TRACE_IDLE : TRACE_KERNEL;
+}
+
+#ifdef DEBUG
+/*Prints the recorded interrupts in the format host/port/node_sim.c replays with -r*/
+void Kernel_Dump_Trace()
+{
+	unsigned int i;
+	
+	for(i = 0; i < Trace_Count; i++)
+		printf("TRACE %lu %u %u %u %u\n", Trace_Buffer[i].entry, Trace_Buffer[i].tick, Trace_Buffer[i].tcnt, Trace_Buffer[i].vector, Trace_Buffer[i].where);
+	
+	if(Trace_Dropped > 0)
+		printf("Kernel_Dump_Trace: %u interrupts didn't fit in the trace\n", Trace_Dropped);
+	
+	#ifdef CLI_TIMING
+	Kernel_Dump_CLI();
+	#endif
+}
+#endif
+#endif
+
+#ifdef PROFILER
+#ifdef HOST_PORT
+#error "PROFILER reads the interrupted address off the AVR stack, it can't run on the host port"
+#endif
+
+#define PROFILE_SAVED 15		//Bytes the profiler ISR pushes before sampling: r0, SREG, r1, r18-r27, r30, r31
+#define PROFILE_PROBES 8		//Entries of Profile looked at for a sample before it's dropped
+
+/*Counts one profiler sample. sp is the stack pointer after the ISR saved its registers, so the 3 byte return address
+  (most significant byte first) is right above them. Samples taken while the kernel ran, or that were held up by
+  interrupts being disabled, are counted under PID 0: they land where interrupts came back on, not where the time went*/
+void Kernel_Profile_Sample(unsigned char *sp)
+{
+	unsigned char *ret = sp + 1 + PROFILE_SAVED;
+	unsigned int pc, i, n;
+	PID pid;
+	
+	pc = ((unsigned int)ret[1] << 8) | ret[2];		//The top byte is only set above 128K of flash
+	pid = (!KernelActive || InKernel || TCNT3 > PROFILE_SKID) ? 0 : Cp->pid;
+	++Profile_Samples;
+	
+	i = (pc ^ (pid * 31)) % PROFILE_SIZE;
+	for(n = 0; n < PROFILE_PROBES; n++, i = (i + 1) % PROFILE_SIZE)
+	{
+		if(Profile[i].count == 0)
+		{
+			Profile[i].pc = pc;
+			Profile[i].pid = pid;
+		}
+		
+		if(Profile[i].pc == pc && Profile[i].pid == pid)
+		{
+			if(Profile[i].count < 0xFFFF)
+				++Profile[i].count;
+			return;
+		}
+	}
+	
+	++Profile_Dropped;
+}
+
+//Profiler ISR. Naked, so the return address is a known distance up the stack. Only the registers a C function may
+//clobber are saved, Kernel_Profile_Sample() keeps the rest
+ISR(TIMER3_COMPA_vect, ISR_NAKED)
+{
+	asm volatile (
+		"push r0				\n\t"
+		"in r0, __SREG__		\n\t"
+		"push r0				\n\t"
+		"push r1				\n\t"
+		"clr r1					\n\t"
+		"push r18				\n\t"
+		"push r19				\n\t"
+		"push r20				\n\t"
+		"push r21				\n\t"
+		"push r22				\n\t"
+		"push r23				\n\t"
+		"push r24				\n\t"
+		"push r25				\n\t"
+		"push r26				\n\t"
+		"push r27				\n\t"
+		"push r30				\n\t"
+		"push r31				\n\t"
+		"in r24, __SP_L__		\n\t"
+		"in r25, __SP_H__		\n\t"
+		"call Kernel_Profile_Sample	\n\t"
+		"pop r31				\n\t"
+		"pop r30				\n\t"
+		"pop r27				\n\t"
+		"pop r26				\n\t"
+		"pop r25				\n\t"
+		"pop r24				\n\t"
+		"pop r23				\n\t"
+		"pop r22				\n\t"
+		"pop r21				\n\t"
+		"pop r20				\n\t"
+		"pop r19				\n\t"
+		"pop r18				\n\t"
+		"pop r1					\n\t"
+		"pop r0					\n\t"
+		"out __SREG__, r0		\n\t"
+		"pop r0					\n\t"
+		"reti					\n\t"
+	::);
+}
+
+#ifdef DEBUG
+/*Prints the profile in the format host/prof_report.c reads*/
+void Kernel_Dump_Profile()
+{
+	unsigned int i;
+	
+	for(i = 0; i < PROFILE_SIZE; i++)
+	{
+		if(Profile[i].count > 0)
+			printf("PROFILE %u %lx %u\n", Profile[i].pid, (unsigned long)Profile[i].pc * 2, Profile[i].count);
+	}
+	
+	printf("Kernel_Dump_Profile: %lu samples, %u didn't fit\n", Profile_Samples, Profile_Dropped);
+}
+#endif
+#endif
+
+#ifdef CLI_TIMING
+#ifdef HOST_PORT
+#error "CLI_TIMING times the AVR's interrupt flag on Timer4, it can't run on the host port"
+#endif
+
+/*Starts timing a stretch with interrupts disabled. Called right after they were, through Disable_Interrupt() and CLI_ISR_BEGIN()*/
+void Kernel_CLI_Begin(const char *file, unsigned int line)
+{
+	CLI_Current.length = TCNT4;
+	CLI_Current.file = file;
+	CLI_Current.line = line;
+	CLI_Open = 1;
+}
+
+/*Ends the stretch being timed, if any. Called right before interrupts come back on: by Enable_Interrupt(), Restore_Interrupt(),
+  CLI_ISR_END(), and the kernel before the reti of Exit_Kernel()*/
+void Kernel_CLI_End()
+{
+	unsigned int length;
+	
+	if(!CLI_Open)
+		return;
+	
+	CLI_Open = 0;
+	length = TCNT4 - CLI_Current.length;		//Wraps correctly for anything under 32ms
+	if(length >= CLI_Longest.length)
+	{
+		CLI_Longest.length = length;
+		CLI_Longest.file = CLI_Current.file;
+		CLI_Longest.line = CLI_Current.line;
+	}
+}
+
+/*Returns the longest stretch with interrupts disabled since the kernel was initialized or resetLongestCLI() was called*/
+CLI_WINDOW getLongestCLI()
+{
+	unsigned char sreg = SREG;
+	CLI_WINDOW w;
+	
+	Disable_Interrupt();
+	w.length = CLI_Longest.length;
+	w.file = CLI_Longest.file;
+	w.line = CLI_Longest.line;
+	Restore_Interrupt(sreg);
+	
+	return w;
+}
+
+/*Forgets the longest stretch so far, e.g. to leave out the boot*/
+void resetLongestCLI()
+{
+	unsigned char sreg = SREG;
+	
+	Disable_Interrupt();
+	CLI_Longest.length = 0;
+	CLI_Longest.file = NULL;
+	CLI_Longest.line = 0;
+	Restore_Interrupt(sreg);
+}
+
+#ifdef DEBUG
+/*Prints the longest stretch with interrupts disabled as "CLI <Timer4 counts> <microseconds> <file>:<line>"*/
+void Kernel_Dump_CLI()
+{
+	CLI_WINDOW w = getLongestCLI();
+	
+	if(w.file != NULL)
+		printf("CLI %u %u %s:%u\n", w.length, w.length / 2, w.file, w.line);
+}
+#endif
+#endif
+
+//Timer tick ISR
+ISR(TIMER1_COMPA_vect)
+{
+	CLI_ISR_BEGIN();
+	TRACE_ISR(TIMER1_COMPA_vect_num);
+	++Tick_Count;
+	
+	//Charge the tick to the running task
+	#ifdef HOST_SMP
+	Kernel_SMP_Charge_Tick();
+	#else
+	if(KernelActive && !InKernel && Cp->state == RUNNING && Cp->budget > 0 && Cp->budget_left > 0)
+		--Cp->budget_left;
+	#endif
+	
+	//Have the kernel process the tick right away. A task it wakes preempts the running one if it's more important, and a task that used up its budget is throttled
+	Kernel_ISR_Preempt();
+	CLI_ISR_END();
+}
+
+/*Gives a task its CPU budget back at the start of a new replenishment period, undoing any throttling*/
+static void Kernel_Replenish_Budget(PD *p)
+{
+	p->budget_left = p->budget;
+	
+	if(!p->throttled)
+		return;
+	
+	p->throttled = 0;
+	if(p->budget_action == BUDGET_DEMOTE)
+		Kernel_Update_Priority(p);
+	else if(p->state == THROTTLED)
+		Kernel_Ready_Task(p);
+	else if(p->state == SUSPENDED && p->last_state == THROTTLED)
+		p->last_state = READY;		//It becomes READY once it's resumed
+}
+
+//Processes all tasks that are currently sleeping and decrement their sleep ticks when called. Expired sleep tasks are placed back into their old state
+void Kernel_Tick_Handler()
+{
+	unsigned char sreg = SREG;
+	ERROR_TYPE e = err;			//The ticks aren't part of the current request, which keeps its own error
+	unsigned int ticks;
+	int i;
+	
+	//Take the ticks counted so far. More may come in while these are processed
+	Disable_Interrupt();
+	ticks = Tick_Count;
+	Tick_Count = 0;
+	Sys_Ticks += ticks;
+	Restore_Interrupt(sreg);
+	
+	//No ticks has been issued yet, skipping...
+	if(ticks == 0)
+		return;
+	
+	for(i=0; i<MAXTHREAD; i++)
+	{
+		//Count a deadline miss once per job if a periodic task is still working past its absolute deadline
+		if(Process[i].state != DEAD && Process[i].rel_deadline > 0 && !Process[i].missed && (int)(Sys_Ticks - Process[i].abs_deadline) > 0)
+		{
+			Process[i].missed = 1;
+			++Process[i].deadline_misses;
+			++Total_Deadline_Misses;
+			
+			#ifdef DEBUG
+			printf("Kernel_Tick_Handler: PID %d missed its deadline! Total misses: %d\n", Process[i].pid, Process[i].deadline_misses);
+			#endif
+		}
+		
+		//Replenish CPU budgets once per replenishment period
+		if(Process[i].state != DEAD && Process[i].budget > 0)
+		{
+			Process[i].replenish_in -= ticks;
+			if(Process[i].replenish_in <= 0)
+			{
+				Process[i].replenish_in = Process[i].budget_period;
+				Kernel_Replenish_Budget(&Process[i]);
+			}
+		}
+		
+		//Give up timed waits on kernel objects once their timeout expires
+		if(Process[i].wait_ticks > 0 && Process[i].state != SUSPENDED)
+		{
+			if(Process[i].wait_ticks <= ticks)
+				Kernel_Wait_Timeout(&Process[i]);
+			else
+				Process[i].wait_ticks -= ticks;
+		}
+		
+		//Process any active tasks that are sleeping
+		if(Process[i].state == SLEEPING)
+		{
+			//If the current sleeping task's tick count expires, put it back into its READY state
+			Process[i].request_arg -= ticks;
+			if(Process[i].request_arg <= 0)
+			{
+				Kernel_Ready_Task(&Process[i]);
+				Process[i].request_arg = 0;
+			}
+		}
+		
+		//Process any SUSPENDED tasks that were previously sleeping
+		else if(Process[i].last_state == SLEEPING)
+		{
+			//When task_resume is called again, the task will be back into its READY state instead if its sleep ticks expired.
+			Process[i].request_arg -= ticks;
+			if(Process[i].request_arg <= 0)
+			{
+				Process[i].last_state = READY;
+				Process[i].request_arg = 0;
+			}
+		}
+	}
+	
+	Kernel_Timer_Tick(ticks);
+	
+	err = e;
+}
+
+/************************************************************************/
+/*                   TASK RELATED KERNEL FUNCTIONS                      */
+/************************************************************************/
+
+#ifdef ADMISSION_CONTROL
+/*Fills in the analysis description of a periodic task*/
+static void Describe_Task(SCHED_TASK *t, SCHED_CLASS sched, PRIORITY pri, TICK period, TICK deadline, unsigned long wcet)
+{
+	t->edf = (sched == SCHED_EDF);
+	t->pri = t->edf ? EDF_PRIORITY : pri;
+	t->period = period * US_PER_TICK;
+	t->deadline = deadline * US_PER_TICK;
+	t->wcet = wcet;
+	t->cs = ADMISSION_CS_US;
+}
+
+/*Checks if the current periodic tasks plus the requested one are still schedulable. Aperiodic tasks are treated as background load and ignored.
+  A task being changed is passed as replaced, and params describe it after the change. Tasks are analysed at their base priority*/
+static int Kernel_Admit_Task(TASK_PARAMS *params, PD *replaced)
+{
+	int i;
+	unsigned int n = 0;
+	
+	for(i=0; i<MAXTHREAD; i++)
+	{
+		if(Process[i].state != DEAD && Process[i].period > 0 && &Process[i] != replaced)
+			Describe_Task(&Admission_Set[n++], Process[i].sched, Process[i].base_pri, Process[i].period, Process[i].rel_deadline, Process[i].wcet);
+	}
+	Describe_Task(&Admission_Set[n++], params->sched, params->pri, params->period, params->deadline, params->wcet);
+	
+	return Sched_Analyze(Admission_Set, n, NULL) == -1;
+}
+#endif
+
+/*Stores the return addresses at the bottom of a task's initial frame: the task's function, and Task_Terminate below it*/
+static void Kernel_Init_Return_Addresses(PD *p)
+{
+	unsigned char *sp = (unsigned char *) &(p->workSpace[WORKSPACE-1]);
+	
+	//Store terminate at the bottom of stack to protect against stack underrun.
+	*(unsigned char *)sp-- = ((unsigned int)Task_Terminate) & 0xff;
+	*(unsigned char *)sp-- = (((unsigned int)Task_Terminate) >> 8) & 0xff;
+	*(unsigned char *)sp-- = 0x00;
+
+	//Place return address of function at bottom of stack
+	*(unsigned char *)sp-- = ((unsigned int)p->code) & 0xff;
+	*(unsigned char *)sp-- = (((unsigned int)p->code) >> 8) & 0xff;
+	*(unsigned char *)sp-- = 0x00;
+}
+
+/*Puts the task's argument in r24:r25 of its initial frame, where avr-gcc passes the first parameter of f(arg).
+ *The frame starts right below the return addresses with r0, so rN is at workSpace[WORKSPACE-7-N]*/
+static void Kernel_Init_Arg(PD *p)
+{
+	p->workSpace[WORKSPACE-7-24] = ((unsigned int)p->arg) & 0xff;
+	p->workSpace[WORKSPACE-7-25] = (((unsigned int)p->arg) >> 8) & 0xff;
+}
+
+/* Handles all low level operations for creating a new task */
+PID Kernel_Create_Task(TASK_PARAMS *params)
+{
+	int x;
+	unsigned char *sp;
+	PD *p;
+	voidfuncptr f = params->code;
+
+	#ifdef DEBUG
+	int counter = 0;
+	#endif
+	
+	//Make sure the system can still have enough resources to create more tasks
+	if (Task_Count == MAXTHREAD)
+	{
+		#ifdef DEBUG
+		printf("Task_Create: Failed to create task. The system is at its process threshold.\n");
+		#endif
+		
+		err = MAX_PROCESS_ERR;
+		return 0;
+	}
+	
+	#ifdef ADMISSION_CONTROL
+	//Periodic tasks are only admitted if every periodic task can still meet its deadlines afterwards
+	if(params->period > 0 && !Kernel_Admit_Task(params, NULL))
+	{
+		#ifdef DEBUG
+		printf("Task_Create: Rejected task. The periodic task set would become unschedulable.\n");
+		#endif
+		
+		err = UNSCHEDULABLE_ERR;
+		return 0;
+	}
+	#endif
+
+	//Find a dead or empty PD slot to allocate our new task
+	for (x = 0; x < MAXTHREAD; x++)
+	if (Process[x].state == DEAD) break;
+	
+	++Task_Count;
+	p = &(Process[x]);
+	
+	/*The code below was agglomerated from Kernel_Create_Task_At;*/
+	
+	//Initializing the workspace memory for the new task
+	memset(&(p->workSpace),0,WORKSPACE);
+	p->code = f;				/* function to be executed as a task */
+	Kernel_Init_Return_Addresses(p);
+	sp = (unsigned char *) &(p->workSpace[WORKSPACE-1-6]);
+
+	//Allocate the stack with enough memory spaces to save the registers needed for ctxswitch
+	#ifdef DEBUG
+	 //Fill stack with initial values for development debugging
+	 for (counter = 0; counter < 34; counter++)
+	 {
+		 *(unsigned char *)sp-- = counter;
+	 }
+	#else
+	 //Place stack pointer at top of stack
+	 sp = sp - 34;
+	#endif
+	
+	//Build the process descriptor for the new task. PIDs are allocated so that (pid - 1) % MAXTHREAD is the task's slot
+	p->pid = Last_PID + 1 + (x + MAXTHREAD - Last_PID % MAXTHREAD) % MAXTHREAD;
+	if(p->pid <= Last_PID)
+		p->pid = x + 1;			//Wrapped around
+	Last_PID = p->pid;
+	p->pri = params->pri;
+	p->base_pri = params->pri;
+	p->arg = params->arg;
+	Kernel_Init_Arg(p);
+	p->request = NONE;
+	p->sp = sp;					/* stack pointer into the "workSpace" */
+	
+	//Timing attributes. The first job of a periodic task is released right away
+	p->sched = params->sched;
+	p->period = params->period;
+	p->rel_deadline = params->deadline;
+	p->wcet = params->wcet;
+	p->release = Sys_Ticks;
+	p->abs_deadline = Sys_Ticks + p->rel_deadline;
+	p->deadline_misses = 0;
+	p->missed = 0;
+	p->heap_pos = -1;
+	p->budget = 0;
+	p->throttled = 0;
+	p->wait_ticks = 0;
+	p->exit_code = 0;
+	p->joiners = 0;
+	p->notify_value = 0;
+	p->err = NO_ERR;
+	memset(p->tls, 0, sizeof(p->tls));
+	if(p->sched == SCHED_EDF)
+		p->pri = p->base_pri = EDF_PRIORITY;
+	
+	#ifdef HOST_SMP
+	Kernel_SMP_Place(p);
+	#endif
+	
+	TASK_CREATE_HOOK(p, CREATE_T);
+	Kernel_Ready_Task(p);
+	
+	//No errors occured
+	err = NO_ERR;
+	
+	return p->pid;
+}
+
+/*TODO: Check for mutex ownership. If PID owns any mutex, ignore this request*/
+static void Kernel_Suspend_Task() 
+{
+	//Finds the process descriptor for the specified PID
+	PD* p = findProcessByPID(Cp->request_arg);
+	#ifdef HOST_SMP
+	PROCESS_STATES state;
+	#endif
+	
+	//Ensure the PID specified in the PD currently exists in the global process list
+	if(p == NULL)
+	{
+		#ifdef DEBUG
+			printf("Kernel_Suspend_Task: PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	//Ensure the task is not in a unsuspendable state
+	if(p->state == DEAD || p->state == SUSPENDED)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Suspend_Task: Trying to suspend a task that's in an unsuspendable state %d!\n", p->state);
+		#endif
+		err = SUSPEND_NONRUNNING_TASK_ERR;
+		return;
+	}
+	
+	#ifdef HOST_SMP
+	//A task running on another virtual CPU may lock a free mutex without the kernel. Kernel_Lock_Mutex_Fast() looks at its
+	//state after taking one, so either it sees it's suspended and backs off, or we see it's the owner
+	state = p->state;
+	p->state = SUSPENDED;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	#endif
+	
+	//Ensure the task is not currently owning a mutex
+	for(int i=0; i<MAXMUTEX; i++) {
+		if (Mutex[i].owner == p->pid) {
+			#ifdef DEBUG
+			printf("Kernel_Suspend_Task: Trying to suspend a task that currently owns a mutex\n");
+			#endif
+			#ifdef HOST_SMP
+			p->state = state;
+			#endif
+			err = SUSPEND_NONRUNNING_TASK_ERR;
+			return;
+		}
+	}
+	
+	//Save its current state and set it to SUSPENDED. A task suspending itself is READY again once it's resumed
+	#ifdef HOST_SMP
+	p->last_state = (state == RUNNING) ? READY : state;		//Marked SUSPENDED already
+	#else
+	p->last_state = (p->state == RUNNING) ? READY : p->state;
+	p->state = SUSPENDED;
+	#endif
+	err = NO_ERR;
+	
+	#ifdef HOST_SMP
+	Kernel_SMP_Notice(p);		//The CPU running it stops it
+	#endif
+}
+
+static void Kernel_Resume_Task()
+{
+	//Finds the process descriptor for the specified PID
+	PD* p = findProcessByPID(Cp->request_arg);
+	
+	//Ensure the PID specified in the PD currently exists in the global process list
+	if(p == NULL)
+	{
+		#ifdef DEBUG
+			printf("Kernel_Resume_Task: PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	//Ensure the task is currently in the SUSPENDED state
+	if(p->state != SUSPENDED)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Resume_Task: Trying to resume a task that's not SUSPENDED!\n");
+		printf("CURRENT STATE: %d\n", p->state);
+		#endif
+		err = RESUME_NONSUSPENDED_TASK_ERR;
+		return;
+	}
+	
+	//Restore the previous state of the task
+	p->state = p->last_state;
+	p->last_state = SUSPENDED;
+	if(p->state == READY)
+		Kernel_Ready_Task(p);
+	err = NO_ERR;
+}
+
+/*Ends the current job of a periodic task and waits for the release of its next one*/
+static void Kernel_Next_Period()
+{
+	int remaining;
+	
+	if(Cp->period == 0)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Next_Period: PID %d is not a periodic task!\n", Cp->pid);
+		#endif
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	//Advance to the next job. Its deadline is relative to its release
+	Cp->release += Cp->period;
+	Cp->abs_deadline = Cp->release + Cp->rel_deadline;
+	Cp->missed = 0;
+	
+	//Sleep until the next release, or keep running right away if we're already late for it
+	remaining = (int)(Cp->release - Sys_Ticks);
+	if(remaining > 0)
+	{
+		Cp->request_arg = remaining;
+		Cp->state = SLEEPING;
+	}
+	else
+		Kernel_Ready_Task(Cp);
+	
+	err = NO_ERR;
+}
+
+/*Sets or clears (budget = 0) the CPU budget of a task*/
+static void Kernel_Set_Budget()
+{
+	BUDGET_PARAMS *params = Cp->request_ptr;
+	PD* p = findProcessByPID(params->pid);
+	
+	if(p == NULL || p->state == DEAD)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Set_Budget: PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	if(params->budget > 0 && (params->period == 0 || params->budget > params->period || (params->action != BUDGET_DEMOTE && params->action != BUDGET_SUSPEND)))
+	{
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	//Lift any throttling from the old budget before switching to the new one
+	p->budget = params->budget;
+	Kernel_Replenish_Budget(p);
+	
+	p->budget_period = params->period;
+	p->replenish_in = params->period;
+	p->budget_action = params->action;
+	err = NO_ERR;
+}
+
+/*Gives a task a new base priority. It runs at that priority from then on, unless it inherits a higher one*/
+static void Kernel_Set_Priority()
+{
+	PRIORITY_PARAMS *params = Cp->request_ptr;
+	PD* p = findProcessByPID(params->pid);
+	#ifdef ADMISSION_CONTROL
+	TASK_PARAMS changed;
+	#endif
+	
+	if(p == NULL || p->state == DEAD)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Set_Priority: PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	//EDF tasks are ordered by deadline in their band instead
+	if(params->pri > LOWEST_PRIORITY || p->sched == SCHED_EDF)
+	{
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	#ifdef ADMISSION_CONTROL
+	//A periodic task at its new priority must leave every periodic task able to meet its deadlines
+	if(p->period > 0)
+	{
+		changed.sched = p->sched;
+		changed.pri = params->pri;
+		changed.period = p->period;
+		changed.deadline = p->rel_deadline;
+		changed.wcet = p->wcet;
+		if(!Kernel_Admit_Task(&changed, p))
+		{
+			#ifdef DEBUG
+			printf("Kernel_Set_Priority: Rejected priority. The periodic task set would become unschedulable.\n");
+			#endif
+			err = UNSCHEDULABLE_ERR;
+			return;
+		}
+	}
+	#endif
+	
+	p->base_pri = params->pri;
+	Kernel_Update_Priority(p);
+	err = NO_ERR;
+}
+
+/*Throttles the current task after the tick ISR preempted it for using up its budget*/
+static void Kernel_Throttle_Task()
+{
+	#ifdef DEBUG
+	printf("Kernel_Throttle_Task: PID %d used up its budget!\n", Cp->pid);
+	#endif
+	
+	Cp->throttled = 1;
+	
+	//Either keep it running in the background, or don't let it run at all until its budget is replenished
+	if(Cp->budget_action == BUDGET_DEMOTE)
+		Kernel_Update_Priority(Cp);
+	else
+		Cp->state = THROTTLED;
+}
+
+/************************************************************************/
+/*                  EVENT RELATED KERNEL FUNCTIONS                      */
+/************************************************************************/
+
+EVENT Kernel_Create_Event(void)
+{
+	int i;
+	
+	//Make sure the system's events are not at max
+	if(Event_Count >= MAXEVENT)
+	{
+		#ifdef DEBUG
+		printf("Event_Init: Failed to create Event. The system is at its max event threshold.\n");
+		#endif
+		err = MAX_EVENT_ERR;
+		return 0;
+	}
+	
+	//Find an uninitialized Event slot
+	for(i=0; i<MAXEVENT; i++)
+		if(Event[i].id == 0) break;
+	
+	//Assign a new unique ID to the event. Note that the smallest valid Event ID is 1.
+	Spin_Lock(Event[i].lock);
+	Event[i].id = ++Last_EventID;
+	Event[i].owner = 0;
+	Spin_Unlock(Event[i].lock);
+	Count_Add(Event_Count, 1);
+	err = NO_ERR;
+	
+	#ifdef DEBUG
+	printf("Event_Init: Created Event %d!\n", Last_EventID);
+	#endif
+	
+	return Event[i].id;
+}
+
+static void Kernel_Wait_Event(void)
+{
+	EVENT_TYPE* e = findEventByEventID(Cp->request_arg);
+	
+	if(e == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Wait_Event: Error finding requested event!\n");
+		#endif
+		return;
+	}
+	
+	Spin_Lock(e->lock);
+	
+	//Ensure no one else is waiting for this same event
+	if(e->owner > 0 && e->owner != Cp->pid)
+	{
+		Spin_Unlock(e->lock);
+		#ifdef DEBUG
+			printf("Kernel_Wait_Event: The requested event is already being waited by PID %d\n", e->owner);
+		#endif
+		err = EVENT_NOT_FOUND_ERR;
+		return;
+	}
+	
+	//Has this event been signaled already? If yes, "consume" event and keep executing the same task
+	if(e->count > 0)
+	{
+		e->owner = 0;
+		e->count = 0;
+		e->id = 0;
+		Spin_Unlock(e->lock);
+		Count_Add(Event_Count, -1);
+		return;
+	}
+	
+	//Set the owner of the requested event to the current task and put it into the WAIT EVENT state
+	e->owner = Cp->pid;
+	Spin_Unlock(e->lock);
+	Cp->state = WAIT_EVENT;
+	BLOCK_HOOK(Cp, Cp->request);
+	err = NO_ERR;
+}
+
+static void Kernel_Signal_Event(void)
+{
+	EVENT_TYPE* e = findEventByEventID(Cp->request_arg);
+	PD *e_owner;
+	
+	if(e == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Signal_Event: Error finding requested event!\n");
+		#endif
+		return;
+	}
+	
+	//Increment the event counter if needed 
+	Spin_Lock(e->lock);
+	if(MAX_EVENT_SIG_MISS == 0 || e->count < MAX_EVENT_SIG_MISS)
+		e->count++;
+	Spin_Unlock(e->lock);
+	
+	//If the event is unowned, return. Only the kernel makes an event owned, so it stays unowned
+	if(e->owner == 0)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Signal_Event: *WARNING* The requested event is not being waited by anyone!\n");
+		#endif
+		err = SIGNAL_UNOWNED_EVENT_ERR;
+		return;
+	}
+	
+	//Fetch the owner's PD and ensure it's still valid
+	e_owner = findProcessByPID(e->owner);
+	if(e_owner == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Signal_Event: Event owner's PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	//A protothread runner claimed the event for one of its protothreads. It consumes the event once it looks at them again
+	if(e_owner->state == WAIT_PT || (e_owner->state == SUSPENDED && e_owner->last_state == WAIT_PT))
+	{
+		Kernel_Wake_Runner(e_owner);
+		return;
+	}
+	
+	//Wake up the owner of the event by setting its state to READY if it's active. The event is "consumed"
+	//A suspended owner gets the event too, and becomes READY once it's resumed
+	if(e_owner->state == WAIT_EVENT || (e_owner->state == SUSPENDED && e_owner->last_state == WAIT_EVENT))
+	{
+		Spin_Lock(e->lock);
+		e->owner = 0;
+		e->count = 0;
+		e->id = 0;
+		Spin_Unlock(e->lock);
+		Count_Add(Event_Count, -1);
+		Kernel_Ready_Task(e_owner);
+	}
+}
+
+#ifdef HOST_SMP
+/*Consumes an event that was signalled already without entering the kernel, taking only the event's own lock. Returns 0 if
+  the caller has to ask the kernel, e.g. to wait for it. Basic tasks always do, they aren't allowed to wait at all*/
+int Kernel_Wait_Event_Fast(EVENT id)
+{
+	EVENT_TYPE *e = findEventByEventID(id);
+	int done = 0;
+	
+	if(e == NULL || Cp->code == Basic_Task)
+		return 0;
+	
+	//The event is gone once it's consumed, and its slot may be reused by the time we have the lock
+	Spin_Lock(e->lock);
+	if(e->id == id && e->owner == 0 && e->count > 0)
+	{
+		e->count = 0;
+		e->id = 0;
+		done = 1;
+	}
+	Spin_Unlock(e->lock);
+	
+	if(!done)
+		return 0;
+	
+	Count_Add(Event_Count, -1);
+	Enable_Interrupt();		//Interrupts are only taken where they're enabled on the host
+	return 1;
+}
+#endif
+
+/************************************************************************/
+/*               EVENT GROUP RELATED KERNEL FUNCTIONS                   */
+/************************************************************************/
+
+EVENT_GROUP Kernel_Create_Event_Group(void)
+{
+	int i;
+	
+	//Make sure the system's event groups are not at max
+	if(Event_Group_Count >= MAXEVENTGROUP)
+	{
+		#ifdef DEBUG
+		printf("EventGroup_Init: Failed to create event group. The system is at its max event group threshold.\n");
+		#endif
+		err = MAX_EVENT_GROUP_ERR;
+		return 0;
+	}
+	
+	//Find an uninitialized event group slot
+	for(i=0; i<MAXEVENTGROUP; i++)
+		if(EventGroup[i].id == 0) break;
+	
+	//Assign a new unique ID to the event group. Note that the smallest valid ID is 1.
+	EventGroup[i].id = ++Last_EventGroupID;
+	EventGroup[i].bits = 0;
+	EventGroup[i].waiters = 0;
+	EventGroup[i].pt_runners = 0;
+	++Event_Group_Count;
+	err = NO_ERR;
+	
+	return EventGroup[i].id;
+}
+
+/*Is a wait on an event group satisfied by its current flags?*/
+static int Event_Group_Satisfied(EVENT_BITS bits, EVENT_GROUP_WAIT *w)
+{
+	if(w->options & EG_WAIT_ALL)
+		return (bits & w->mask) == w->mask;
+	
+	return (bits & w->mask) != 0;
+}
+
+static void Kernel_Wait_Event_Group(void)
+{
+	EVENT_GROUP_WAIT *w = Cp->request_ptr;
+	EVENT_GROUP_TYPE *g = findEventGroupByID(w->group);
+	
+	if(g == NULL || w->mask == 0)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Wait_Event_Group: Error finding requested event group!\n");
+		#endif
+		if(g != NULL) err = INVALID_ARG_ERR;
+		w->result = 0;
+		return;
+	}
+	
+	//Already satisfied? Keep running without blocking
+	if(Event_Group_Satisfied(g->bits, w))
+	{
+		w->result = g->bits & w->mask;
+		if(w->options & EG_CLEAR_ON_EXIT)
+			g->bits &= ~w->mask;
+		err = NO_ERR;
+		return;
+	}
+	
+	//Block until enough bits are set, or the timeout (in request_arg) expires
+	g->waiters |= (THREAD_MASK)1 << (Cp - Process);
+	Cp->wait_ticks = Cp->request_arg;
+	Cp->state = WAIT_EVENT_GROUP;
+	BLOCK_HOOK(Cp, Cp->request);
+	err = NO_ERR;
+}
+
+/*Sets flags in an event group and wakes every waiter that is now satisfied. Shared by tasks and ISRs*/
+static void Kernel_Set_Event_Group(EVENT_GROUP_TYPE *g, EVENT_BITS bits)
+{
+	THREAD_MASK waiters;
+	EVENT_BITS clear = 0;
+	EVENT_GROUP_WAIT *w;
+	unsigned int i;
+	
+	//Waiters only need to be evaluated if any bits actually changed
+	if((g->bits | bits) == g->bits)
+		return;
+	g->bits |= bits;
+	
+	for(i=0, waiters = g->waiters; waiters != 0; i++, waiters >>= 1)
+	{
+		if(!(waiters & 1))
+			continue;
+		
+		w = Process[i].request_ptr;
+		if(!Event_Group_Satisfied(g->bits, w))
+			continue;
+		
+		//Everyone woken by this update sees the same flags, the clear-on-exit bits are only cleared afterwards
+		w->result = g->bits & w->mask;
+		if(w->options & EG_CLEAR_ON_EXIT)
+			clear |= w->mask;
+		
+		g->waiters &= ~((THREAD_MASK)1 << i);
+		Kernel_Ready_Task(&Process[i]);
+	}
+	g->bits &= ~clear;
+	
+	//Protothread runners check the new bits for themselves
+	for(i=0, waiters = g->pt_runners; waiters != 0; i++, waiters >>= 1)
+	{
+		if(waiters & 1)
+			Kernel_Wake_Runner(&Process[i]);
+	}
+	g->pt_runners = 0;
+}
+
+void Kernel_Set_Event_Group_FromISR(EVENT_GROUP g, EVENT_BITS bits)
+{
+	Kernel_Defer(DEFER_SET_EG, g, bits, 0, NULL);
+	Kernel_ISR_Preempt();
+}
+
+static void Kernel_Update_Event_Group(void)
+{
+	EVENT_GROUP_WAIT *w = Cp->request_ptr;
+	EVENT_GROUP_TYPE *g = findEventGroupByID(w->group);
+	
+	if(g == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Update_Event_Group: Error finding requested event group!\n");
+		#endif
+		return;
+	}
+	
+	if(Cp->request == SET_EG)
+		Kernel_Set_Event_Group(g, w->mask);
+	else
+		g->bits &= ~w->mask;
+	err = NO_ERR;
+}
+
+/************************************************************************/
+/*                  TIMER RELATED KERNEL FUNCTIONS                      */
+/************************************************************************/
+
+/*Inserts a timer into the active delta list, to expire ticks from the current head's reference point. Equal expiries stay in FIFO order*/
+static void Timer_Insert(TIMER_TYPE *t, TICK ticks)
+{
+	signed char *link = (signed char *)&Timer_Active;
+	
+	while(*link != -1 && Timer[(int)*link].delta <= ticks)
+	{
+		ticks -= Timer[(int)*link].delta;
+		link = (signed char *)&Timer[(int)*link].next;
+	}
+	
+	//The timer after us now expires relative to us
+	if(*link != -1)
+		Timer[(int)*link].delta -= ticks;
+	
+	t->delta = ticks;
+	t->next = *link;
+	t->active = 1;
+	*link = t - Timer;
+}
+
+/*Takes a timer out of the active delta list*/
+static void Timer_Remove(TIMER_TYPE *t)
+{
+	signed char *link = (signed char *)&Timer_Active;
+	
+	while(*link != -1 && &Timer[(int)*link] != t)
+		link = (signed char *)&Timer[(int)*link].next;
+	
+	if(*link == -1)
+		return;
+	
+	//Hand our remaining delta to the timer after us
+	if(t->next != -1)
+		Timer[(int)t->next].delta += t->delta;
+	*link = t->next;
+	t->active = 0;
+}
+
+/*Hands an expired timer's callback to the timer task, or queues it if the task is still busy with earlier ones*/
+static void Timer_Fire(TIMER_TYPE *t)
+{
+	TIMER_PARAMS *out;
+	
+	if(Timer_Daemon != NULL && Timer_Daemon->state == WAIT_TIMER)
+	{
+		out = Timer_Daemon->request_ptr;
+		out->callback = t->callback;
+		out->arg = t->arg;
+		Kernel_Ready_Task(Timer_Daemon);
+		return;
+	}
+	
+	//Already queued for an earlier expiry? Just run the callback once more
+	if(t->fired++ > 0)
+		return;
+	
+	t->fire_next = -1;
+	if(Timer_Fired_Head == -1)
+		Timer_Fired_Head = t - Timer;
+	else
+		Timer[(int)Timer_Fired_Tail].fire_next = t - Timer;
+	Timer_Fired_Tail = t - Timer;
+}
+
+/*Takes a timer whose callbacks haven't run yet off the list of expired timers*/
+static void Timer_Unfire(TIMER_TYPE *t)
+{
+	signed char prev = -1;
+	signed char i = Timer_Fired_Head;
+	
+	while(i != -1 && &Timer[(int)i] != t)
+	{
+		prev = i;
+		i = Timer[(int)i].fire_next;
+	}
+	
+	if(i == -1)
+		return;
+	
+	if(prev == -1)
+		Timer_Fired_Head = t->fire_next;
+	else
+		Timer[(int)prev].fire_next = t->fire_next;
+	if(Timer_Fired_Tail == i)
+		Timer_Fired_Tail = prev;
+	t->fired = 0;
+}
+
+/*Advances the active timers by a number of ticks. Only the head of the delta list is touched unless timers expire*/
+static void Kernel_Timer_Tick(unsigned int ticks)
+{
+	TIMER_TYPE *t;
+	
+	while(Timer_Active != -1)
+	{
+		t = &Timer[(int)Timer_Active];
+		if(t->delta > ticks)
+		{
+			t->delta -= ticks;
+			return;
+		}
+		
+		//The head expired. Timers after it are relative to this moment, and so is an auto-reloaded one
+		ticks -= t->delta;
+		Timer_Active = t->next;
+		t->active = 0;
+		if(t->auto_reload)
+			Timer_Insert(t, t->period);
+		
+		Timer_Fire(t);
+	}
+}
+
+TIMER Kernel_Create_Timer(TIMER_PARAMS *params)
+{
+	TASK_PARAMS daemon;
+	PID pid;
+	int i;
+	
+	//Make sure the system's timers are not at max
+	if(Timer_Count >= MAXTIMER)
+	{
+		#ifdef DEBUG
+		printf("Timer_Create: Failed to create timer. The system is at its max timer threshold.\n");
+		#endif
+		err = MAX_TIMER_ERR;
+		return 0;
+	}
+	
+	//The timer task is only created once a timer exists
+	if(Timer_Daemon == NULL)
+	{
+		daemon.code = Timer_Task;
+		daemon.pri = TIMER_TASK_PRIORITY;
+		daemon.arg = 0;
+		daemon.sched = SCHED_FIXED;
+		daemon.period = 0;
+		daemon.deadline = 0;
+		daemon.wcet = 0;
+		pid = Kernel_Create_Task(&daemon);
+		if(pid == 0)
+			return 0;
+		Timer_Daemon = findProcessByPID(pid);
+	}
+	
+	//Find an uninitialized timer slot
+	for(i=0; i<MAXTIMER; i++)
+		if(Timer[i].id == 0) break;
+	
+	//Assign a new unique ID to the timer. Note that the smallest valid ID is 1.
+	Timer[i].id = ++Last_TimerID;
+	Timer[i].callback = params->callback;
+	Timer[i].arg = params->arg;
+	Timer[i].period = params->period;
+	Timer[i].auto_reload = params->auto_reload;
+	Timer[i].active = 0;
+	Timer[i].fired = 0;
+	Timer[i].next = -1;
+	++Timer_Count;
+	err = NO_ERR;
+	
+	return Timer[i].id;
+}
+
+/*Starts (or restarts) and stops timers*/
+static void Kernel_Start_Stop_Timer(void)
+{
+	TIMER_TYPE *t = findTimerByID(Cp->request_arg);
+	
+	if(t == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Start_Stop_Timer: Error finding requested timer!\n");
+		#endif
+		return;
+	}
+	
+	if(t->active)
+		Timer_Remove(t);
+	
+	//Callbacks of a stopped timer that haven't run yet are dropped as well
+	if(t->fired > 0)
+		Timer_Unfire(t);
+	
+	if(Cp->request == START_TMR)
+		Timer_Insert(t, t->period);
+	err = NO_ERR;
+}
+
+/*Gives the timer task the next expired timer's callback, or blocks it until one expires*/
+static void Kernel_Wait_Timer(void)
+{
+	TIMER_PARAMS *out = Cp->request_ptr;
+	TIMER_TYPE *t;
+	
+	if(Timer_Fired_Head != -1)
+	{
+		t = &Timer[(int)Timer_Fired_Head];
+		out->callback = t->callback;
+		out->arg = t->arg;
+		
+		//Timers run once per expiry, and leave the list when they have no more
+		if(--t->fired == 0)
+			Timer_Fired_Head = t->fire_next;
+		return;
+	}
+	
+	Cp->state = WAIT_TIMER;
+	BLOCK_HOOK(Cp, Cp->request);
+}
+
+/************************************************************************/
+/*                   POOL RELATED KERNEL FUNCTIONS                      */
+/************************************************************************/
+
+POOL Kernel_Create_Pool(POOL_PARAMS *params)
+{
+	unsigned char *block;
+	unsigned int i;
+	
+	//Make sure the system's pools are not at max
+	if(Pool_Count >= MAXPOOL)
+	{
+		#ifdef DEBUG
+		printf("Pool_Create: Failed to create pool. The system is at its max pool threshold.\n");
+		#endif
+		err = MAX_POOL_ERR;
+		return 0;
+	}
+	
+	//Find an uninitialized pool slot
+	for(i=0; i<MAXPOOL; i++)
+		if(Pool[i].id == 0) break;
+	
+	Pool[i].storage = params->storage;
+	Pool[i].block_size = params->block_size;
+	Pool[i].count = params->count;
+	Pool[i].used = 0;
+	Pool[i].high_water = 0;
+	Pool[i].waiters = 0;
+	
+	//Thread the free list through all blocks, in address order
+	Pool[i].free_list = NULL;
+	block = Pool[i].storage + params->count * params->block_size;
+	while(block != Pool[i].storage)
+	{
+		block -= params->block_size;
+		*(void **)block = Pool[i].free_list;
+		Pool[i].free_list = block;
+	}
+	
+	//Assign a new unique ID to the pool. Note that the smallest valid ID is 1.
+	Pool[i].id = ++Last_PoolID;
+	++Pool_Count;
+	err = NO_ERR;
+	
+	return Pool[i].id;
+}
+
+/*Pops a block off a pool's free list. O(1). ISRs take blocks too, so this can't be interrupted*/
+static void* Pool_Pop(POOL_TYPE *p)
+{
+	unsigned char sreg = SREG;
+	void *block;
+	
+	Disable_Interrupt();
+	block = p->free_list;
+	if(block != NULL)
+	{
+		p->free_list = *(void **)block;
+		if(++p->used > p->high_water)
+			p->high_water = p->used;
+	}
+	Restore_Interrupt(sreg);
+	
+	return block;
+}
+
+/*Returns a block to its pool. If someone is waiting for one, it's handed straight to the highest priority waiter. O(1) without waiters*/
+static void Pool_Push(POOL_TYPE *p, void *block)
+{
+	unsigned int offset = (unsigned char *)block - p->storage;
+	unsigned char sreg;
+	PD *waiter;
+	
+	//Ignore anything that isn't the start of one of this pool's blocks
+	if((unsigned char *)block < p->storage || offset >= p->count * p->block_size || offset % p->block_size != 0)
+	{
+		#ifdef DEBUG
+		printf("Pool_Free: Block %p doesn't belong to pool %d!\n", block, p->id);
+		#endif
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	waiter = Highest_Priority_Waiter(p->waiters);
+	if(waiter != NULL)
+	{
+		((POOL_WAIT *)waiter->request_ptr)->block = block;
+		p->waiters &= ~((THREAD_MASK)1 << (waiter - Process));
+		Kernel_Ready_Task(waiter);
+	}
+	else
+	{
+		sreg = SREG;
+		Disable_Interrupt();
+		*(void **)block = p->free_list;
+		p->free_list = block;
+		--p->used;
+		Restore_Interrupt(sreg);
+	}
+	err = NO_ERR;
+}
+
+/*Non-blocking allocation by a task. Doesn't need the kernel, since it only disables interrupts for the pop itself*/
+void* Kernel_Pool_Take(POOL p)
+{
+	POOL_TYPE *p1 = findPoolByID(p);
+	void *block = NULL;
+	
+	if(p1 != NULL)
+	{
+		block = Pool_Pop(p1);
+		err = (block == NULL) ? POOL_EMPTY_ERR : NO_ERR;
+	}
+	
+	return block;
+}
+
+/*Non-blocking allocation by an ISR. The kernel may be in the middle of a request it interrupted, so err is left alone*/
+void* Kernel_Pool_Take_FromISR(POOL p)
+{
+	int i;
+	
+	for(i=0; i<MAXPOOL; i++)
+	{
+		if(p > 0 && Pool[i].id == p)
+			return Pool_Pop(&Pool[i]);
+	}
+	
+	return NULL;
+}
+
+void Kernel_Pool_Free_FromISR(POOL p, void *block)
+{
+	Kernel_Defer(DEFER_FREE_POOL, p, 0, 0, block);
+	Kernel_ISR_Preempt();
+}
+
+/*Blocking allocation. Waits for a free block until the timeout expires*/
+static void Kernel_Alloc_Pool(void)
+{
+	POOL_WAIT *w = Cp->request_ptr;
+	POOL_TYPE *p = findPoolByID(Cp->request_arg);
+	
+	if(p == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Alloc_Pool: Error finding requested pool!\n");
+		#endif
+		w->block = NULL;
+		return;
+	}
+	
+	w->block = Pool_Pop(p);
+	if(w->block != NULL)
+	{
+		err = NO_ERR;
+		return;
+	}
+	
+	//Pool_Push() hands us a block directly once one is freed
+	p->waiters |= (THREAD_MASK)1 << (Cp - Process);
+	Cp->wait_ticks = w->timeout;
+	Cp->state = WAIT_POOL;
+	BLOCK_HOOK(Cp, Cp->request);
+	err = NO_ERR;
+}
+
+static void Kernel_Free_Pool(void)
+{
+	POOL_TYPE *p = findPoolByID(Cp->request_arg);
+	
+	if(p == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Free_Pool: Error finding requested pool!\n");
+		#endif
+		return;
+	}
+	
+	Pool_Push(p, Cp->request_ptr);
+}
+
+/************************************************************************/
+/*                TASK-LOCAL STORAGE RELATED KERNEL FUNCTIONS           */
+/************************************************************************/
+
+/*Creates a task-local storage key. Tasks get and set their own slot of it through Cp, without entering the kernel*/
+TLS_KEY Kernel_Create_TLS(tlsdestructor *d)
+{
+	if(Last_TLSKey >= MAXTLS)
+	{
+		#ifdef DEBUG
+		printf("TLS_Create: Failed to create key. All task-local storage slots are in use.\n");
+		#endif
+		err = MAX_TLS_ERR;
+		return 0;
+	}
+	
+	TLS_Destructor[Last_TLSKey] = *d;
+	++Last_TLSKey;
+	err = NO_ERR;
+	
+	return Last_TLSKey;
+}
+
+/*Hands the values a terminating task left in its task-local storage to their keys' destructors*/
+static void Kernel_Destroy_TLS(void)
+{
+	unsigned int i;
+	void *value;
+	
+	for(i = 0; i < Last_TLSKey; i++)
+	{
+		value = Cp->tls[i];
+		Cp->tls[i] = NULL;
+		if(value != NULL && TLS_Destructor[i] != NULL)
+			TLS_Destructor[i](value);
+	}
+}
+
+/************************************************************************/
+/*                  PROTOTHREAD RELATED KERNEL FUNCTIONS                */
+/************************************************************************/
+
+/*Creates the task running the protothreads or basic tasks of a priority, which gets the priority as its arg*/
+static PD *Kernel_Create_Runner(voidfuncptr code, PRIORITY py)
+{
+	TASK_PARAMS runner;
+	PID pid;
+	
+	runner.code = code;
+	runner.pri = py;
+	runner.arg = py;
+	runner.sched = SCHED_FIXED;
+	runner.period = 0;
+	runner.deadline = 0;
+	runner.wcet = 0;
+	pid = Kernel_Create_Task(&runner);
+	if(pid == 0)
+		return NULL;
+	
+	return findProcessByPID(pid);
+}
+
+/*Finds the link pointing to a protothread in any priority's list. NULL if it isn't linked*/
+static PT** Find_PT_Link(PT *pt)
+{
+	PT **link;
+	int i;
+	
+	for(i=0; i<=LOWEST_PRIORITY; i++)
+	{
+		for(link = (PT **)&PT_List[i]; *link != NULL; link = &(*link)->next)
+			if(*link == pt)
+				return link;
+	}
+	return NULL;
+}
+
+/*Links a new protothread into the list of its priority. The priority's runner task is created along with its first one*/
+void Kernel_Create_PT(PT_PARAMS *params)
+{
+	PT *pt = params->pt;
+	PRIORITY py = params->pri;
+	PT **link;
+	
+	if(py > LOWEST_PRIORITY)
+	{
+		err = INVALID_ARG_ERR;
+		return;
 	}
 	
-	//Ensure the task is currently in the SUSPENDED state
-	if(p->state != SUSPENDED)
+	//A protothread can only be in one list once. One that's done but not unlinked by its runner yet is unlinked now
+	link = Find_PT_Link(pt);
+	if(link != NULL)
+	{
+		if(pt->wait != PT_DONE)
+		{
+			#ifdef DEBUG
+			printf("Kernel_Create_PT: The protothread is still running!\n");
+			#endif
+			err = INVALID_ARG_ERR;
+			return;
+		}
+		*link = pt->next;
+	}
+	
+	if(PT_Runner[py] == NULL)
+	{
+		PT_Runner[py] = Kernel_Create_Runner(PT_Task, py);
+		if(PT_Runner[py] == NULL)
+			return;
+	}
+	
+	pt->f = params->f;
+	pt->lc = 0;
+	pt->wait = PT_RUN;
+	pt->next = PT_List[py];
+	PT_List[py] = pt;
+	
+	Kernel_Wake_Runner(PT_Runner[py]);
+	err = NO_ERR;
+}
+
+/*Called by a runner between its passes over its protothreads. Unlinks the ones that are done and lets the ones whose wait
+ *is over run again. The list goes back through request_ptr if any can run, otherwise the runner blocks until the earliest
+ *sleeper is due or a claimed event is signalled, and gets NULL to come back here once it's woken*/
+static void Kernel_Run_PT(void)
+{
+	PT **link = (PT **)&PT_List[Cp->arg];
+	PT *pt;
+	EVENT_TYPE *e;
+	EVENT_GROUP_TYPE *g;
+	TICK timeout = 0;
+	unsigned char ready = 0;
+	
+	while((pt = *link) != NULL)
+	{
+		switch(pt->wait)
+		{
+			case PT_DONE:
+			*link = pt->next;
+			continue;
+			
+			case PT_SLEEP_FOR:
+			pt->until += Sys_Ticks;
+			pt->wait = PT_SLEEP_UNTIL;
+			//Fall through
+			
+			case PT_SLEEP_UNTIL:
+			if((int)(Sys_Ticks - pt->until) >= 0)
+				pt->wait = PT_RUN;
+			else if(timeout == 0 || pt->until - Sys_Ticks < timeout)
+				timeout = pt->until - Sys_Ticks;
+			break;
+			
+			case PT_ON_EVENT:
+			e = findEventByEventID(pt->until);
+			if(e == NULL || (e->owner != 0 && e->owner != Cp->pid))
+				pt->wait = PT_RUN;				//Gone, or a task waits on it. Like Event_Wait(), don't wait then
+			else
+			{
+				Spin_Lock(e->lock);
+				if(e->count > 0)
+				{
+					e->owner = 0;
+					e->count = 0;
+					e->id = 0;
+					Spin_Unlock(e->lock);
+					Count_Add(Event_Count, -1);
+					pt->wait = PT_RUN;
+				}
+				else
+				{
+					e->owner = Cp->pid;			//Claim it so Event_Signal() wakes us
+					Spin_Unlock(e->lock);
+				}
+			}
+			break;
+			
+			case PT_ON_GROUP:
+			g = findEventGroupByID(pt->until);
+			if(g == NULL)
+			{
+				pt->mask = 0;
+				pt->wait = PT_RUN;
+			}
+			else if(g->bits & pt->mask)
+			{
+				pt->mask &= g->bits;
+				pt->wait = PT_RUN;
+			}
+			else
+				g->pt_runners |= (THREAD_MASK)1 << (Cp - Process);	//Kernel_Set_Event_Group() wakes us
+			break;
+			
+			//Protothreads share the runner's notification word, each takes the bits it waits for. Kernel_Notify() wakes us
+			case PT_ON_NOTIFY:
+			if(Cp->notify_value & pt->mask)
+			{
+				pt->mask &= Cp->notify_value;
+				Cp->notify_value &= ~pt->mask;
+				pt->wait = PT_RUN;
+			}
+			break;
+		}
+		
+		if(pt->wait == PT_RUN)
+			ready = 1;
+		link = &pt->next;
+	}
+	
+	if(ready)
+	{
+		*(PT **)Cp->request_ptr = (PT *)PT_List[Cp->arg];
+		return;
+	}
+	
+	*(PT **)Cp->request_ptr = NULL;
+	Cp->wait_ticks = timeout;
+	Cp->state = WAIT_PT;
+	BLOCK_HOOK(Cp, Cp->request);
+}
+
+/************************************************************************/
+/*                  BASIC TASK RELATED KERNEL FUNCTIONS                 */
+/************************************************************************/
+
+BASIC Kernel_Create_Basic(BASIC_PARAMS *params)
+{
+	BASIC_TYPE *b;
+	
+	if(params->pri > LOWEST_PRIORITY)
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	//Make sure the system's basic tasks are not at max
+	if(Last_BasicID >= MAXBASIC)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Resume_Task: Trying to resume a task that's not SUSPENDED!\n");
-		printf("CURRENT STATE: %d\n", p->state);
+		printf("Task_Create_Basic: Failed to create basic task. The system is at its max basic task threshold.\n");
 		#endif
-		err = RESUME_NONSUSPENDED_TASK_ERR;
+		err = MAX_BASIC_ERR;
+		return 0;
+	}
+	
+	if(Basic_Runner[params->pri] == NULL)
+	{
+		Basic_Runner[params->pri] = Kernel_Create_Runner(Basic_Task, params->pri);
+		if(Basic_Runner[params->pri] == NULL)
+			return 0;
+	}
+	
+	//Basic tasks are never deleted, so the next slot is always free. Note that the smallest valid ID is 1.
+	b = &Basic[Last_BasicID++];
+	b->code = params->code;
+	b->arg = params->arg;
+	b->pri = params->pri;
+	b->pending = 0;
+	b->next = -1;
+	err = NO_ERR;
+	
+	return Last_BasicID;
+}
+
+/*Puts a basic task at the end of its priority's queue*/
+static void Basic_Queue(BASIC_TYPE *b)
+{
+	b->next = -1;
+	if(Basic_Head[b->pri] == -1)
+		Basic_Head[b->pri] = b - Basic;
+	else
+		Basic[(int)Basic_Tail[b->pri]].next = b - Basic;
+	Basic_Tail[b->pri] = b - Basic;
+}
+
+/*Hands the next activation of a priority to its runner. Returns 0 if there's none*/
+static int Basic_Next(PRIORITY py, BASIC_PARAMS *out)
+{
+	BASIC_TYPE *b;
+	
+	if(Basic_Head[py] == -1)
+		return 0;
+	
+	b = &Basic[(int)Basic_Head[py]];
+	out->code = b->code;
+	out->arg = b->arg;
+	
+	//More activations wait behind the other basic tasks of the priority
+	Basic_Head[py] = b->next;
+	if(--b->pending > 0)
+		Basic_Queue(b);
+	return 1;
+}
+
+/*Activates a basic task. Shared by tasks and ISRs. A runner waiting for work gets it right away*/
+static void Kernel_Activate_Basic(BASIC id)
+{
+	BASIC_TYPE *b;
+	PD *runner;
+	
+	if(id == 0 || id > Last_BasicID)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Activate_Basic: Error finding requested basic task!\n");
+		#endif
+		err = BASIC_NOT_FOUND_ERR;
+		return;
+	}
+	b = &Basic[id - 1];
+	err = NO_ERR;
+	
+	//Up to 255 activations are counted, more are dropped
+	if(b->pending == 255)
+		return;
+	if(b->pending++ == 0)
+		Basic_Queue(b);
+	
+	//The runner may be gone if replacing one whose basic task terminated failed. The next Task_Create_Basic() at its priority
+	//brings it back, and it starts with the activations queued meanwhile
+	runner = Basic_Runner[b->pri];
+	if(runner == NULL)
+		return;
+	if(runner->state == WAIT_BASIC || (runner->state == SUSPENDED && runner->last_state == WAIT_BASIC))
+	{
+		Basic_Next(b->pri, runner->request_ptr);
+		Kernel_Ready_Task(runner);
+	}
+}
+
+void Kernel_Activate_Basic_FromISR(BASIC b)
+{
+	Kernel_Defer(DEFER_ACTIVATE, b, 0, 0, NULL);
+	Kernel_ISR_Preempt();
+}
+
+/*Is Cp a basic task runner making a request that may block? Its basic tasks have to run to completion*/
+static int Basic_Would_Block(void)
+{
+	MUTEX_TYPE *m;
+	
+	if(Cp->code != Basic_Task)
+		return 0;
+	
+	switch(Cp->request)
+	{
+		//A mutex nobody else holds is taken right away
+		case LOCK_M:
+		m = findMutexByMutexID(Cp->request_arg);
+		return m != NULL && m->owner != 0 && m->owner != Cp->pid;
+		
+		case SLEEP:
+		case NEXT_PERIOD:
+		case WAIT_E:
+		case WAIT_EG:
+		case ALLOC_POOL:
+		case WAIT_NOTIFY_T:
+		case JOIN_T:
+		case WAIT_CV:
+		case READ_LOCK_RW:
+		case WRITE_LOCK_RW:
+		return 1;
+		
+		case SUSPEND:
+		return Cp->request_arg == Cp->pid;
+		
+		default:
+		return 0;
+	}
+}
+
+/*Called by a runner once it's done with an activation. Hands it the next one, or blocks it until there is one*/
+static void Kernel_Run_Basic(void)
+{
+	//An activation must unlock the mutexes it locked before it returns. Any it didn't are released, so they can't hold up other tasks
+	int handed = Kernel_Release_Mutexes(Cp);
+	
+	if(!Basic_Next(Cp->arg, Cp->request_ptr))
+	{
+		Cp->state = WAIT_BASIC;
+		BLOCK_HOOK(Cp, Cp->request);
+	}
+	else if(handed)
+		Kernel_Ready_Task(Cp);		//A task that got a mutex may have a higher priority
+}
+
+/************************************************************************/
+/*               READER-WRITER LOCK RELATED KERNEL FUNCTIONS            */
+/************************************************************************/
+
+RWLOCK Kernel_Create_RWLock(void)
+{
+	int i;
+	
+	//Make sure the system's locks are not at max
+	if(RWLock_Count >= MAXRWLOCK)
+	{
+		#ifdef DEBUG
+		printf("RWLock_Init: Failed to create lock. The system is at its max lock threshold.\n");
+		#endif
+		err = MAX_RWLOCK_ERR;
+		return 0;
+	}
+	
+	//Find an uninitialized lock slot
+	for(i=0; i<MAXRWLOCK; i++)
+		if(RWLock[i].id == 0) break;
+	
+	//Assign a new unique ID to the lock. Note that the smallest valid ID is 1.
+	RWLock[i].id = ++Last_RWLockID;
+	RWLock[i].writer = 0;
+	RWLock[i].readers = 0;
+	RWLock[i].read_waiters = 0;
+	RWLock[i].write_waiters = 0;
+	++RWLock_Count;
+	err = NO_ERR;
+	
+	return RWLock[i].id;
+}
+
+/*Brings the priority of everyone holding the lock up to date with its waiters*/
+static void RWLock_Inherit(RWLOCK_TYPE *l)
+{
+	THREAD_MASK readers;
+	unsigned int i;
+	
+	if(l == NULL)
+		return;
+	
+	Kernel_Update_Priority(findProcessByPID(l->writer));
+	
+	//A blocked writer may be waiting on several readers. All of them have to get out of its way
+	for(i=0, readers = l->readers; readers != 0; i++, readers >>= 1)
+	{
+		if(readers & 1)
+			Kernel_Update_Priority(&Process[i]);
+	}
+}
+
+/*Gives task p the lock*/
+static void RWLock_Grant(RWLOCK_TYPE *l, PD *p, unsigned char write)
+{
+	unsigned int slot = p - Process;
+	
+	if(write)
+		l->writer = p->pid;
+	else
+		l->readers |= (THREAD_MASK)1 << slot;
+}
+
+/*Drops task p's hold on the lock and hands it over to waiters once it's free. Returns 0 if p didn't hold the lock*/
+static int RWLock_Release(RWLOCK_TYPE *l, PD *p)
+{
+	THREAD_MASK bit = (THREAD_MASK)1 << (p - Process);
+	PD *waiter;
+	unsigned int i;
+	
+	if(l->writer == p->pid)
+		l->writer = 0;
+	else if(l->readers & bit)
+		l->readers &= ~bit;
+	else
+		return 0;
+	
+	Kernel_Update_Priority(p);		//Undo any priority inherited through this lock
+	
+	if(l->writer != 0 || l->readers != 0)
+		return 1;
+	
+	//Writers go first, highest priority first
+	waiter = Highest_Priority_Waiter(l->write_waiters);
+	if(waiter != NULL)
+	{
+		l->write_waiters &= ~((THREAD_MASK)1 << (waiter - Process));
+		RWLock_Grant(l, waiter, 1);
+		Kernel_Ready_Task(waiter);
+	}
+	else
+	{
+		//No writers left, so every waiting reader gets in at once
+		for(i=0; l->read_waiters != 0; i++)
+		{
+			bit = (THREAD_MASK)1 << i;
+			if(!(l->read_waiters & bit))
+				continue;
+			
+			l->read_waiters &= ~bit;
+			RWLock_Grant(l, &Process[i], 0);
+			Kernel_Ready_Task(&Process[i]);
+		}
+	}
+	
+	//The new holders inherit from whoever is still waiting
+	RWLock_Inherit(l);
+	return 1;
+}
+
+static void Kernel_Lock_RWLock(void)
+{
+	RWLOCK_TYPE *l = findRWLockByID(Cp->request_arg);
+	unsigned char write = (Cp->request == WRITE_LOCK_RW);
+	
+	if(l == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Lock_RWLock: Error finding requested lock!\n");
+		#endif
+		return;
+	}
+	
+	err = NO_ERR;
+	
+	//Readers get in as long as no writer holds the lock or is waiting for it
+	if(l->writer == 0 && (write ? l->readers == 0 : l->write_waiters == 0))
+	{
+		RWLock_Grant(l, Cp, write);
+		return;
+	}
+	
+	//RWLock_Release() grants us the lock directly once it's our turn
+	if(write)
+		l->write_waiters |= (THREAD_MASK)1 << (Cp - Process);
+	else
+		l->read_waiters |= (THREAD_MASK)1 << (Cp - Process);
+	Cp->state = WAIT_RWLOCK;
+	BLOCK_HOOK(Cp, Cp->request);
+	RWLock_Inherit(l);
+}
+
+static void Kernel_Unlock_RWLock(void)
+{
+	RWLOCK_TYPE *l = findRWLockByID(Cp->request_arg);
+	
+	if(l == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Unlock_RWLock: Error finding requested lock!\n");
+		#endif
+		return;
+	}
+	
+	if(!RWLock_Release(l, Cp))
+	{
+		#ifdef DEBUG
+		printf("Kernel_Unlock_RWLock: The current process doesn't hold the lock\n");
+		#endif
+		err = RWLOCK_NOT_HELD_ERR;
+		return;
+	}
+	err = NO_ERR;
+}
+
+/************************************************************************/
+/*               NOTIFICATION RELATED KERNEL FUNCTIONS                  */
+/************************************************************************/
+
+/*Updates a task's notification word and wakes it if it's waiting for any of the bits now set. Shared by tasks and ISRs*/
+static void Kernel_Notify(PD *p, unsigned int bits, unsigned char action)
+{
+	NOTIFY_PARAMS *w;
+	
+	if(action == NOTIFY_INCREMENT)
+		++p->notify_value;
+	else if(action == NOTIFY_OVERWRITE)
+		p->notify_value = bits;
+	else
+		p->notify_value |= bits;
+	
+	//A protothread runner checks if any of its protothreads waits for the bits
+	Kernel_Wake_Runner(p);
+	
+	//A suspended waiter gets the bits too, and becomes READY once it's resumed
+	if(p->state != WAIT_NOTIFY && !(p->state == SUSPENDED && p->last_state == WAIT_NOTIFY))
+		return;
+	
+	w = p->request_ptr;
+	if(p->notify_value & w->bits)
+	{
+		w->result = p->notify_value & w->bits;
+		p->notify_value &= ~w->bits;
+		Kernel_Ready_Task(p);
+	}
+}
+
+void Kernel_Notify_FromISR(PID p, unsigned int bits, unsigned char action)
+{
+	Kernel_Defer(DEFER_NOTIFY, p, bits, action, NULL);
+	Kernel_ISR_Preempt();
+}
+
+/*Takes the masked notification bits of the running task if any are set, without entering the kernel*/
+unsigned int Kernel_Take_Notification(unsigned int mask)
+{
+	unsigned int bits;
+	
+	Disable_Interrupt();
+	bits = Cp->notify_value & mask;
+	Cp->notify_value &= ~mask;
+	Enable_Interrupt();
+	
+	return bits;
+}
+
+static void Kernel_Send_Notification(void)
+{
+	NOTIFY_PARAMS *n = Cp->request_ptr;
+	PD *p = findProcessByPID(Cp->request_arg);
+	
+	if(p == NULL || p->state == DEAD)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Send_Notification: PID not found in global process list!\n");
+		#endif
+		err = PID_NOT_FOUND_ERR;
+		return;
+	}
+	
+	Kernel_Notify(p, n->bits, n->action);
+	err = NO_ERR;
+}
+
+static void Kernel_Wait_Notification(void)
+{
+	NOTIFY_PARAMS *w = Cp->request_ptr;
+	
+	err = NO_ERR;
+	
+	//Bits may have arrived between the fast path check and entering the kernel
+	w->result = Cp->notify_value & w->bits;
+	if(w->result != 0)
+	{
+		Cp->notify_value &= ~w->bits;
+		return;
+	}
+	
+	Cp->wait_ticks = w->timeout;
+	Cp->state = WAIT_NOTIFY;
+	BLOCK_HOOK(Cp, Cp->request);
+}
+
+/************************************************************************/
+/*                    TIMED WAIT RELATED FUNCTIONS                      */
+/************************************************************************/
+
+/*Takes a task whose timed wait expired off the object it was waiting for and makes it READY again*/
+static void Kernel_Wait_Timeout(PD *p)
+{
+	EVENT_GROUP_WAIT *w;
+	EVENT_GROUP_TYPE *g;
+	POOL_TYPE *pool;
+	PD *target;
+	
+	switch(p->state)
+	{
+		case WAIT_NOTIFY:
+		((NOTIFY_PARAMS *)p->request_ptr)->result = 0;
+		break;
+		
+		case WAIT_EVENT_GROUP:
+		w = p->request_ptr;
+		g = findEventGroupByID(w->group);
+		if(g != NULL)
+			g->waiters &= ~((THREAD_MASK)1 << (p - Process));
+		w->result = 0;
+		break;
+		
+		case WAIT_POOL:
+		pool = findPoolByID(p->request_arg);
+		if(pool != NULL)
+			pool->waiters &= ~((THREAD_MASK)1 << (p - Process));
+		((POOL_WAIT *)p->request_ptr)->block = NULL;
+		break;
+		
+		case WAIT_JOIN:
+		target = findProcessByPID(p->request_arg);
+		if(target != NULL)
+			target->joiners &= ~((THREAD_MASK)1 << (p - Process));
+		((JOIN_WAIT *)p->request_ptr)->joined = 0;
+		break;
+		
+		//A protothread runner's earliest sleeper is due. Kernel_Run_PT() sorts out which
+		case WAIT_PT:
+		break;
+		
+		//Other waits can't time out
+		default:
 		return;
 	}
-	
-	//Restore the previous state of the task
-	p->state = p->last_state;
-	p->last_state = SUSPENDED;			
-	err = NO_ERR;
+	Kernel_Ready_Task(p);
 }
 
 /************************************************************************/
-/*                  EVENT RELATED KERNEL FUNCTIONS                      */
+/*                  MUTEX RELATED KERNEL FUNCTIONS                      */
 /************************************************************************/
 
-void Kernel_Create_Event(void)
+MUTEX Kernel_Create_Mutex(void)
 {
 	int i;
 	
-	//Make sure the system's events are not at max
-	if(Event_Count >= MAXEVENT)
+	//Make sure the system's mutexes are not at max
+	if(Mutex_Count >= MAXMUTEX)
 	{
 		#ifdef DEBUG
-		printf("Event_Init: Failed to create Event. The system is at its max event threshold.\n");
+		printf("Kernel_Create_Mutex: Failed to create Mutex. The system is at its max mutex threshold.\n");
 		#endif
-		err = MAX_EVENT_ERR;
-		return;
+		err = MAX_MUTEX_ERR;
+		return 0;
 	}
 	
-	//Find an uninitialized Event slot
-	for(i=0; i<MAXEVENT; i++)
-		if(Event[i].id == 0) break;
+	//Find an uninitialized Mutex slot
+	for(i=0; i<MAXMUTEX; i++)
+		if(Mutex[i].id == 0) break;
 	
-	//Assign a new unique ID to the event. Note that the smallest valid Event ID is 1.
-	Event[i].id = ++Last_EventID;
-	Event[i].owner = 0;
-	++Event_Count;
+	//Assign a new unique ID to the mutex. Note that the smallest valid mutex ID is 1.
+	Mutex[i].id = ++Last_MutexID;
+	Mutex[i].owner = 0;		// note when mutex's owner is 0, it is free
+	// init priority stack
+	for (int j=0; j<MAXTHREAD; j++) {
+		Mutex[i].priority_stack[j] = LOWEST_PRIORITY+1;
+		Mutex[i].blocked_stack[j] = -1;
+		Mutex[i].order[j] = 0;
+	}
+	Mutex[i].num_of_process = 0;
+	Mutex[i].total_num = 0;
+	Mutex[i].contended = 0;
+	++Mutex_Count;
 	err = NO_ERR;
 	
 	#ifdef DEBUG
-	printf("Event_Init: Created Event %d!\n", Last_EventID);
+	printf("Kernel_Create_Mutex: Created Mutex %d!\n", Last_MutexID);
 	#endif
+	
+	return Mutex[i].id;
 }
 
-static void Kernel_Wait_Event(void)
+static void Dispatch();
+
+/*Puts task p in the mutex's wait queue and lends its priority to the owner if it's higher*/
+static void Mutex_Enqueue(MUTEX_TYPE *m, PD *p)
 {
-	EVENT_TYPE* e = findEventByEventID(Cp->request_arg);
+	PD *m_owner = findProcessByPID(m->owner);
+	int i;
 	
-	if(e == NULL)
-	{
-		#ifdef DEBUG
-		printf("Kernel_Wait_Event: Error finding requested event!\n");
-		#endif
-		return;
+	//A task coming back from Cond_Wait() has been blocked all along, it waits for the mutex now. A suspended one keeps its suspension
+	if(p->state != WAIT_COND && p->state != SUSPENDED)
+		BLOCK_HOOK(p, p->request);
+	if(p->state == SUSPENDED)
+		p->last_state = WAIT_MUTEX;
+	else
+		p->state = WAIT_MUTEX;
+	++(m->num_of_process);
+	++(m->total_num);
+	++(m->contended);
+	for (i=0; i<MAXTHREAD; i++) {
+		if (m->blocked_stack[i] == -1){
+			m->blocked_stack[i] = p->pid;
+			m->order[i] = m->total_num;
+			m->priority_stack[i] = p->pri;
+			break;
+		}
 	}
 	
-	//Ensure no one else is waiting for this same event
-	if(e->owner > 0 && e->owner != Cp->pid)
-	{
-		#ifdef DEBUG
-			printf("Kernel_Wait_Event: The requested event is already being waited by PID %d\n", e->owner);
-		#endif
-		err = EVENT_NOT_FOUND_ERR;
-		return;
+	//if p's priority is higher than the owner, the owner gets it
+	Kernel_Update_Priority(m_owner);
+}
+
+/*Releases a mutex held by p, dropping any priority p inherited through it. Returns 1 if the mutex was handed to a waiting task*/
+static int Mutex_Release(MUTEX_TYPE *m, PD *p)
+{
+	PID p_dequeue = 0;
+	unsigned int temp_order = m->total_num + 1;
+	PRIORITY temp_pri = LOWEST_PRIORITY + 1;
+	int i, index = -1;
+	PD *target_p;
+	
+	if (m->num_of_process == 0) {
+		Spin_Lock(m->lock);
+		m->count = 0;
+		m->owner = 0;
+		Spin_Unlock(m->lock);
+		Kernel_Update_Priority(p);
+		return 0;
 	}
 	
-	//Has this event been signaled already? If yes, "consume" event and keep executing the same task
-	if(e->count > 0)
-	{
-		e->owner = 0;
-		e->count = 0;
-		e->id = 0;
-		--Event_Count;	
-		return;
+	// deque the task with highest priority, first come first served among equals
+	for (i=0; i<MAXTHREAD; i++) {
+		if (m->priority_stack[i] < temp_pri || (m->priority_stack[i] == temp_pri && m->order[i] < temp_order)) {
+			temp_pri = m->priority_stack[i];
+			temp_order = m->order[i];
+			p_dequeue = m->blocked_stack[i];
+			index = i;
+		}
 	}
+	m->blocked_stack[index] = -1;
+	m->priority_stack[index] = LOWEST_PRIORITY+1;
+	m->order[index] = 0;
+	--(m->num_of_process);
 	
-	//Set the owner of the requested event to the current task and put it into the WAIT EVENT state
-	e->owner = Cp->pid;
-	Cp->state = WAIT_EVENT;
-	err = NO_ERR;
+	target_p = findProcessByPID(p_dequeue);
+	m->owner = p_dequeue;
+	
+	//A task coming back from Cond_Wait() gets back the lock count it had before waiting
+	m->count = (target_p->request == WAIT_CV) ? ((COND_WAIT *)target_p->request_ptr)->count : 1;
+	
+	Kernel_Ready_Task(target_p);
+	
+	//p loses what it inherited from the waiters, and the new owner inherits from whoever is still waiting
+	Kernel_Update_Priority(p);
+	Kernel_Update_Priority(target_p);
+	return 1;
 }
 
-static void Kernel_Signal_Event(void)
+/*Goes through all mutexes, and hands over the ones p owns to their waiters. Returns how many went to a waiting task*/
+static int Kernel_Release_Mutexes(PD *p)
 {
-	EVENT_TYPE* e = findEventByEventID(Cp->request_arg);
-	PD *e_owner;
+	int index, handed = 0;
 	
-	if(e == NULL)
+	for (index=0; index<MAXMUTEX; index++) {
+		if (Mutex[index].owner == p->pid) {
+			#ifdef DEBUG
+			printf("Kernel_Release_Mutexes: PID %d still holds mutex %d!\n", p->pid, Mutex[index].id);
+			#endif
+			Mutex[index].count = 1;
+			handed += Mutex_Release(&Mutex[index], p);
+		}
+	}
+	
+	return handed;
+}
+
+/************************************************************************/
+/*              CONDITION VARIABLE RELATED KERNEL FUNCTIONS             */
+/************************************************************************/
+
+COND Kernel_Create_Cond(void)
+{
+	int i;
+	
+	//Make sure the system's condition variables are not at max
+	if(Cond_Count >= MAXCOND)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Signal_Event: Error finding requested event!\n");
+		printf("Cond_Init: Failed to create condition variable. The system is at its max condition variable threshold.\n");
 		#endif
-		return;
+		err = MAX_COND_ERR;
+		return 0;
 	}
 	
-	//Increment the event counter if needed 
-	if(MAX_EVENT_SIG_MISS == 0 || e->count < MAX_EVENT_SIG_MISS)
-		e->count++;
+	//Find an uninitialized condition variable slot
+	for(i=0; i<MAXCOND; i++)
+		if(Cond[i].id == 0) break;
 	
-	//If the event is unowned, return
-	if(e->owner == 0)
+	//Assign a new unique ID to the condition variable. Note that the smallest valid ID is 1.
+	Cond[i].id = ++Last_CondID;
+	Cond[i].waiters = 0;
+	++Cond_Count;
+	err = NO_ERR;
+	
+	return Cond[i].id;
+}
+
+/*Releases the mutex and blocks on the condition variable in one step, so no signal can slip in between*/
+static void Kernel_Wait_Cond(void)
+{
+	COND_WAIT *w = Cp->request_ptr;
+	MUTEX_TYPE *m = findMutexByMutexID(Cp->request_arg);
+	COND_TYPE *c = findCondByID(w->cond);
+	
+	if(m == NULL || c == NULL)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Signal_Event: *WARNING* The requested event is not being waited by anyone!\n");
+		printf("Kernel_Wait_Cond: Error finding requested mutex or condition variable!\n");
 		#endif
-		err = SIGNAL_UNOWNED_EVENT_ERR;
 		return;
 	}
 	
-	//Fetch the owner's PD and ensure it's still valid
-	e_owner = findProcessByPID(e->owner);
-	if(e_owner == NULL)
+	if(m->owner != Cp->pid)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Signal_Event: Event owner's PID not found in global process list!\n");
+		printf("Kernel_Wait_Cond: The mutex isn't held by the current process\n");
 		#endif
-		err = PID_NOT_FOUND_ERR;
+		err = MUTEX_NOT_OWNED_ERR;
 		return;
 	}
 	
-	//Wake up the owner of the event by setting its state to READY if it's active. The event is "consumed"
-	if(e_owner->state == WAIT_EVENT)
+	//The mutex is released completely however often it was locked. Mutex_Release() restores the count later
+	w->count = m->count;
+	c->waiters |= (THREAD_MASK)1 << (Cp - Process);
+	Cp->state = WAIT_COND;
+	BLOCK_HOOK(Cp, Cp->request);
+	Mutex_Release(m, Cp);
+	err = NO_ERR;
+}
+
+/*Moves a task waiting on a condition variable over to the mutex it has to relock*/
+static void Cond_Wake(COND_TYPE *c, PD *p)
+{
+	MUTEX_TYPE *m = findMutexByMutexID(p->request_arg);
+	
+	c->waiters &= ~((THREAD_MASK)1 << (p - Process));
+	
+	Spin_Lock(m->lock);
+	if(m->owner == 0)
 	{
-		e->owner = 0;
-		e->count = 0;
-		e->id = 0;
-		--Event_Count;
-		e_owner->state = READY;
+		m->owner = p->pid;
+		m->count = ((COND_WAIT *)p->request_ptr)->count;
+		Spin_Unlock(m->lock);
+		Kernel_Ready_Task(p);
+	}
+	else
+	{
+		Mutex_Enqueue(m, p);		//Inherits priority like any other Mutex_Lock()
+		Spin_Unlock(m->lock);
 	}
 }
 
-/************************************************************************/
-/*                  MUTEX RELATED KERNEL FUNCTIONS                      */
-/************************************************************************/
-
-void Kernel_Create_Mutex(void)
+/*Wakes the highest priority waiter, or all of them for a broadcast*/
+static void Kernel_Signal_Cond(void)
 {
-	int i;
+	COND_TYPE *c = findCondByID(Cp->request_arg);
+	PD *p;
 	
-	//Make sure the system's mutexes are not at max
-	if(Mutex_Count >= MAXMUTEX)
+	if(c == NULL)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Create_Mutex: Failed to create Mutex. The system is at its max mutex threshold.\n");
+		printf("Kernel_Signal_Cond: Error finding requested condition variable!\n");
 		#endif
-		err = MAX_MUTEX_ERR;
 		return;
 	}
 	
-	//Find an uninitialized Mutex slot
-	for(i=0; i<MAXMUTEX; i++)
-		if(Mutex[i].id == 0) break;
+	do {
+		p = Highest_Priority_Waiter(c->waiters);
+		if(p == NULL)
+			break;
+		Cond_Wake(c, p);
+	} while(Cp->request == BROADCAST_CV);
 	
-	//Assign a new unique ID to the mutex. Note that the smallest valid mutex ID is 1.
-	Mutex[i].id = ++Last_MutexID;
-	Mutex[i].owner = 0;		// note when mutex's owner is 0, it is free
-	// init priority stack
-	for (int j=0; j<MAXTHREAD; j++) {
-		Mutex[i].priority_stack[j] = LOWEST_PRIORITY+1;
-		Mutex[i].blocked_stack[j] = -1;
-		Mutex[i].order[j] = 0;
-	}
-	Mutex[i].num_of_process = 0;
-	Mutex[i].total_num = 0;
-	++Mutex_Count;
 	err = NO_ERR;
+}
+
+#ifdef DEBUG
+/*Prints every task blocked on a mutex, the mutex, and who holds it*/
+static void Kernel_Dump_Wait_For_Graph(void)
+{
+	MUTEX_TYPE *m;
+	int i;
 	
-	#ifdef DEBUG
-	printf("Kernel_Create_Mutex: Created Mutex %d!\n", Last_MutexID);
-	#endif
+	printf("Wait-for graph:\n");
+	for(i=0; i<MAXTHREAD; i++)
+	{
+		if(Process[i].state != WAIT_MUTEX)
+			continue;
+		
+		m = findMutexByMutexID(Process[i].request_arg);
+		printf("  PID %d -> mutex %d -> PID %d\n", Process[i].pid, Process[i].request_arg, (m == NULL) ? 0 : m->owner);
+	}
 }
+#endif
 
-static void Dispatch();
+/*Follows the owner -> blocked-on chain starting at the owner of m. Returns 1 if it leads back to the running task*/
+static int Kernel_Would_Deadlock(MUTEX_TYPE *m)
+{
+	PD *p = findProcessByPID(m->owner);
+	int i;
+	
+	//A chain can't be longer than the number of tasks, so this also stops on a cycle not involving Cp
+	for(i=0; i<MAXTHREAD && p != NULL; i++)
+	{
+		if(p == Cp)
+			return 1;
+		
+		//A suspended task still waits for its mutex, and gets it handed over while suspended
+		if(p->state != WAIT_MUTEX && !(p->state == SUSPENDED && p->last_state == WAIT_MUTEX))
+			return 0;
+		
+		//A task blocked in WAIT_MUTEX still has the mutex it asked for in request_arg
+		m = findMutexByMutexID(p->request_arg);
+		if(m == NULL)
+			return 0;
+		p = findProcessByPID(m->owner);
+	}
+	
+	return 0;
+}
 
 static void Kernel_Lock_Mutex(void)
 {
 	MUTEX_TYPE* m = findMutexByMutexID(Cp->request_arg);
-	PD *m_owner = findProcessByPID(m->owner);
 	
 	if(m == NULL)
 	{
@@ -510,204 +3271,437 @@ static void Kernel_Lock_Mutex(void)
 		return;
 	}
 	
+	err = NO_ERR;
+	
+	//The owner may be about to unlock it without the kernel, it can't once we're queued
+	Spin_Lock(m->lock);
+	
 	// if mutex is free
 	if(m->owner == 0)
 	{
 		m->owner = Cp->pid;
 		m->count = 1;
-		m->own_pri = Cp->pri;				// keep track of the original priority of the owner
+		Spin_Unlock(m->lock);
 		return;
 	} else if (m->owner == Cp->pid) {
 		// if it has locked by the current process
 		++(m->count);
+		Spin_Unlock(m->lock);
+		return;
+	} else if (Kernel_Would_Deadlock(m)) {
+		Spin_Unlock(m->lock);
+		//Blocking would never end. Refuse the lock and let the caller back out
+		#ifdef DEBUG
+		printf("Kernel_Lock_Mutex: PID %d locking mutex %d would deadlock!\n", Cp->pid, m->id);
+		Kernel_Dump_Wait_For_Graph();
+		#endif
+		err = DEADLOCK_ERR;
+		DEADLOCK_HOOK(Cp->pid, m->id);
 		return;
 	} else {
-		Cp->state = WAIT_MUTEX;								//put cp into state wait mutex
-		//enqueue cp to stack
-		++(m->num_of_process);
-		++(m->total_num);
-		for (int i=0; i<MAXTHREAD; i++) {
-			if (m->blocked_stack[i] == -1){
-				m->blocked_stack[i] = Cp->pid;
-				m->order[i] = m->total_num;
-				m->priority_stack[i] = Cp->pri;
-				break;	
-			}
-		}
-		// end of enqueue
-		
-		//if cp's priority is higher than the owner
-		if (Cp->pri < m_owner->pri) {
-			m_owner->pri = Cp->pri;				// the owner gets cp's priority
-		}
+		Mutex_Enqueue(m, Cp);
+		Spin_Unlock(m->lock);
+		Dispatch();
+	}
+}
+
+static void Kernel_Unlock_Mutex(void)
+{
+	MUTEX_TYPE* m = findMutexByMutexID(Cp->request_arg);
+	
+	if(m == NULL)
+	{
+		#ifdef DEBUG
+		printf("Kernel_Unlock_Mutex: Error finding requested mutex!\n");
+		#endif
+		return;
+	}
+	
+	if(m->owner != Cp->pid){
+		#ifdef DEBUG
+		printf("Kernel_Unlock_Mutex: The owner is not the current process\n");
+		#endif
+		return;
+	} else if (m->count > 1) {
+		// M is locked more than once
+		--(m->count);
+	} else if (Mutex_Release(m, Cp)) {
+		// the mutex went to a waiting task, which may have a higher priority
+		Kernel_Ready_Task(Cp);
 		Dispatch();
 	}
 }
 
-static void Kernel_Unlock_Mutex(void)
+#ifdef HOST_SMP
+/*Locks a mutex that's free, or held by the caller already, without entering the kernel. Only the mutex's own lock is taken,
+  which leaves the kernel lock to the other virtual CPUs. Returns 0 if the caller has to ask the kernel, e.g. to wait*/
+int Kernel_Lock_Mutex_Fast(MUTEX id)
+{
+	MUTEX_TYPE *m = findMutexByMutexID(id);
+	int done = 0;
+	
+	if(m == NULL)
+		return 0;
+	
+	Spin_Lock(m->lock);
+	if(m->owner == Cp->pid)
+	{
+		++(m->count);
+		done = 1;
+	}
+	else if(m->owner == 0)
+	{
+		//Task_Suspend() on another CPU refuses to suspend a mutex owner. Back off if it suspended us before it could see we are one
+		m->owner = Cp->pid;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(Cp->state == RUNNING)
+		{
+			m->count = 1;
+			done = 1;
+		}
+		else
+			m->owner = 0;
+	}
+	Spin_Unlock(m->lock);
+	
+	if(!done)
+		return 0;
+	
+	//Interrupts are only taken where they're enabled on the host. Give them their chance, like the syscall would have
+	err = NO_ERR;
+	Enable_Interrupt();
+	return 1;
+}
+
+/*Unlocks a mutex without entering the kernel, if no task waits for it or the caller locked it more than once. No waiter
+  means the caller didn't inherit any priority through it. Returns 0 if the caller has to ask the kernel*/
+int Kernel_Unlock_Mutex_Fast(MUTEX id)
+{
+	MUTEX_TYPE *m = findMutexByMutexID(id);
+	int done = 0;
+	
+	if(m == NULL)
+		return 0;
+	
+	Spin_Lock(m->lock);
+	if(m->owner == Cp->pid && m->count > 1)
+	{
+		--(m->count);
+		done = 1;
+	}
+	else if(m->owner == Cp->pid && m->num_of_process == 0)
+	{
+		m->count = 0;
+		m->owner = 0;
+		done = 1;
+	}
+	Spin_Unlock(m->lock);
+	
+	if(done)
+		Enable_Interrupt();
+	return done;
+}
+#endif
+
+/************************************************************************/
+/*                     TASK TERMINATE FUNCTION                         */
+/************************************************************************/
+
+/*Waits for another task to terminate and collects its exit code*/
+static void Kernel_Join_Task(void)
 {
-	MUTEX_TYPE* m = findMutexByMutexID(Cp->request_arg);
-	PD *m_owner = findProcessByPID(m->owner);
+	JOIN_WAIT *w = Cp->request_ptr;
+	PD *p = findProcessByPID(Cp->request_arg);
 	
-	if(m == NULL)
+	w->joined = 0;
+	
+	if(p == NULL || p == Cp)
 	{
 		#ifdef DEBUG
-		printf("Kernel_Unlock_Mutex: Error finding requested mutex!\n");
+		printf("Kernel_Join_Task: Can't join PID %d!\n", Cp->request_arg);
 		#endif
+		err = (p == NULL) ? PID_NOT_FOUND_ERR : INVALID_ARG_ERR;
 		return;
 	}
 	
-	if(m->owner != Cp->pid){
-		#ifdef DEBUG
-		printf("Kernel_Unlock_Mutex: The owner is not the current process\n");
-		#endif
-		return;
-	} else if (m->count > 1) {
-		// M is locked more than once
-		--(m->count);
-	} else if (m->num_of_process > 0) {
-		// there are tasks waiting on the mutex
-		// deque the task with highest priority
-		PID p_dequeue = 0;
-		unsigned int temp_order = m->total_num + 1;
-		PRIORITY temp_pri = LOWEST_PRIORITY + 1;
-		int i;
-		for (i=0; i<MAXTHREAD; i++) {
-			if (m->priority_stack[i] < temp_pri) {
-				// found a task with higher priority
-				temp_pri = m->priority_stack[i];
-				temp_order = m->order[i];
-				p_dequeue = m->blocked_stack[i];
-			} else if (m->priority_stack[i] == temp_pri && temp_order < m->order[i]) {
-				// same priority and came into the queue earlier
-				temp_order = m->order[i];
-				p_dequeue = m->blocked_stack[i];
-			}
-		}
-		//dequeue index i
-		m->blocked_stack[i] = -1;
-		m->priority_stack[i] = LOWEST_PRIORITY+1;
-		m->order[i] = 0;
-		--(m->num_of_process);
-		PD* target_p = findProcessByPID(p_dequeue);
-		m_owner->pri = m->own_pri;		//reset owner's priority
-		m->owner = p_dequeue;
-		m->own_pri = temp_pri;			//keep track of new owner's priority;
-		target_p->state = READY;
-		Cp->state = READY;
-		Dispatch();
-		return;
-	} else {
-		m->owner = 0;
-		m->count = 0;
-		m_owner->pri = m->own_pri;		//reset owner's priority
+	//Already terminated? Its exit code stays around until the slot is reused
+	if(p->state == DEAD)
+	{
+		w->exit_code = p->exit_code;
+		w->joined = 1;
+		err = NO_ERR;
 		return;
 	}
+	
+	//The terminate path wakes us up directly
+	p->joiners |= (THREAD_MASK)1 << (Cp - Process);
+	Cp->wait_ticks = w->timeout;
+	Cp->state = WAIT_JOIN;
+	BLOCK_HOOK(Cp, Cp->request);
+	err = NO_ERR;
 }
 
-/************************************************************************/
-/*                     TASK TERMINATE FUNCTION                         */
-/************************************************************************/
+/*Hands the exit code of the terminating task to everyone joining it*/
+static void Kernel_Wake_Joiners(void)
+{
+	THREAD_MASK joiners = Cp->joiners;
+	JOIN_WAIT *w;
+	unsigned int i;
+	
+	for(i=0; joiners != 0; i++, joiners >>= 1)
+	{
+		if(!(joiners & 1))
+			continue;
+		
+		w = Process[i].request_ptr;
+		w->exit_code = Cp->exit_code;
+		w->joined = 1;
+		Kernel_Ready_Task(&Process[i]);
+	}
+	Cp->joiners = 0;
+}
 
 static void Kernel_Terminate_Task(void)
 {
-	MUTEX_TYPE* m;
-	// go through all mutex check if it owns a mutex
 	int index;
-	for (index=0; index<MAXMUTEX; index++) {
-		if (Mutex[index].owner == Cp->pid) {
-			// it owns a mutex unlock the mutex
-			if (Mutex[index].num_of_process > 0) {
-				printf("something is waiting\n");
-				// if there are other process waiting on the mutex
-				PID p_dequeue = 0;
-				unsigned int temp_order = Mutex[index].total_num + 1;
-				PRIORITY temp_pri = LOWEST_PRIORITY + 1;
-				int i;
-				for (i=0; i<MAXTHREAD; i++) {
-					if (Mutex[index].priority_stack[i] < temp_pri) {
-						// found a task with higher priority
-						temp_pri = Mutex[index].priority_stack[i];
-						temp_order = Mutex[index].order[i];
-						p_dequeue = Mutex[index].blocked_stack[i];
-						} else if (Mutex[index].priority_stack[i] == temp_pri && temp_order < Mutex[index].order[i]) {
-						// same priority and came into the queue earlier
-						temp_order = Mutex[index].order[i];
-						p_dequeue = Mutex[index].blocked_stack[i];
-					}
-				}
-				//dequeue index i
-				Mutex[index].blocked_stack[i] = -1;
-				Mutex[index].priority_stack[i] = LOWEST_PRIORITY+1;
-				Mutex[index].order[i] = 0;
-				--(Mutex[index].num_of_process);
-				PD* target_p = findProcessByPID(p_dequeue);
-				Mutex[index].owner = p_dequeue;
-				Mutex[index].own_pri = temp_pri;			//keep track of new owner's priority;
-				target_p->state = READY;
-				printf("target p is readd\n");
-			} else {
-				Mutex[index].owner = 0;
-				Mutex[index].count = 0;
-			}
-		}
+	
+	TASK_TERMINATE_HOOK(Cp, Cp->request);
+	
+	//Destructors get to clean up while the task still holds its locks
+	Kernel_Destroy_TLS();
+	
+	//Hand the mutexes it owns over to their waiters
+	Kernel_Release_Mutexes(Cp);
+	
+	//Let go of any reader-writer locks too
+	for (index=0; index<MAXRWLOCK; index++) {
+		if (RWLock[index].id != 0)
+			RWLock_Release(&RWLock[index], Cp);
 	}
+	
+	Cp->exit_code = Cp->request_arg;
+	Kernel_Wake_Joiners();
+	
 	Cp->state = DEAD;			//Mark the task as DEAD so its resources will be recycled later when new tasks are created
 	--Task_Count;
+	
+	//A basic task that terminates only ends its activation. Its priority gets a new runner for the ones after it
+	if(Cp->code == Basic_Task)
+		Basic_Runner[Cp->arg] = Kernel_Create_Runner(Basic_Task, Cp->arg);
 }
 
 /************************************************************************/
-/*                     KERNEL SCHEDULING FUNCTIONS                      */
+/*                        DEFERRED ISR WORK                             */
 /************************************************************************/
 
-/* This internal kernel function is a part of the "scheduler". It chooses the next task to run, i.e., Cp. */
-static void Dispatch()
+/*Does the work ISRs queued for the kernel. Interrupts are only disabled to take each piece of work off the queue*/
+static void Kernel_Do_Deferred(void)
 {
-	unsigned int i = 0;
-	int highest_pri = LOWEST_PRIORITY + 1;
-	int highest_pri_index = -1;
+	DEFERRED_WORK w;
+	ERROR_TYPE e = err;			//The work isn't part of the current request, which keeps its own error
+	EVENT_GROUP_TYPE *g;
+	POOL_TYPE *pool;
+	PD *p;
 	
-	//Find the next READY task with the highest priority by iterating through the process list ONCE
-	for(i=0; i<MAXTHREAD; i++)
+	while(1)
 	{
-		//Increment process index
-		NextP = (NextP + 1) % MAXTHREAD;
+		Disable_Interrupt();
+		if(Deferred_Head == Deferred_Tail)
+			break;
+		w = Deferred[Deferred_Head];
+		Deferred_Head = (Deferred_Head + 1) % DEFERRED_SIZE;
+		Enable_Interrupt();
 		
-		//Select the READY process with the highest priority
-		if(Process[NextP].state == READY && Process[NextP].pri < highest_pri)
+		switch(w.type)
 		{
-			highest_pri = Process[NextP].pri;
-			highest_pri_index = NextP;
+			case DEFER_SET_EG:
+			g = findEventGroupByID(w.id);
+			if(g != NULL)
+				Kernel_Set_Event_Group(g, w.bits);
+			break;
+			
+			case DEFER_FREE_POOL:
+			pool = findPoolByID(w.id);
+			if(pool != NULL)
+				Pool_Push(pool, w.block);
+			break;
+			
+			case DEFER_NOTIFY:
+			p = findProcessByPID(w.id);
+			if(p != NULL && p->state != DEAD)
+				Kernel_Notify(p, w.bits, w.action);
+			break;
+			
+			case DEFER_ACTIVATE:
+			Kernel_Activate_Basic(w.id);
+			break;
 		}
 	}
-		
-	//When none of the tasks in the process list is ready
-	if(highest_pri_index == -1)
+	Enable_Interrupt();
+	
+	err = e;
+}
+
+/*Checks if the most important task woken since Woken_Pri was reset should run instead of Cp. Within the EDF band, a woken task
+  preempts Cp if its deadline is earlier*/
+static int Kernel_Woken_Preempts(void)
+{
+	PD *edf;
+	int preempts = Woken_Pri < Cp->pri;
+	#ifdef HOST_SMP
+	int i;
+	#endif
+	
+	if(!preempts && Woken_Pri == EDF_PRIORITY && In_EDF_Band(Cp))
+	{
+		edf = EDF_Heap_Peek();
+		preempts = edf != NULL && (int)(edf->abs_deadline - Cp->abs_deadline) < 0;
+	}
+	
+	#ifdef HOST_SMP
+	//Tasks made READY on other virtual CPUs don't show in Woken_Pri, but interrupt this CPU to have it look at all run queues.
+	//What's woken here may have been stolen meanwhile
+	if(preempts || Resched_Due)
+	{
+		Resched_Due = 0;
+		i = Kernel_SMP_Pick();
+		preempts = i >= 0 && Kernel_SMP_Before(&Process[i], Cp);
+	}
+	#endif
+	return preempts;
+}
+
+/*Called before the kernel switches to Cp. Does the work ISRs queued meanwhile and processes the ticks that came in, and runs
+  whatever that or the ticks processed on kernel entry (woken) woke instead of Cp if that's more important. Returns with
+  interrupts disabled, so nothing new can come in until the task runs*/
+static void Kernel_Run_Deferred(PRIORITY woken)
+{
+	while(1)
 	{
-		//We'll temporarily re-enable interrupt in case if one or more task is waiting on events/interrupts or sleeping
+		Woken_Pri = woken;
+		woken = LOWEST_PRIORITY + 1;
+		Kernel_Tick_Handler();
+		Kernel_Do_Deferred();
+		
+		if(Kernel_Woken_Preempts())
+		{
+			Kernel_Ready_Task(Cp);
+			Dispatch();
+		}
+		
+		Disable_Interrupt();
+		if(Deferred_Head == Deferred_Tail && Tick_Count == 0)
+			return;
 		Enable_Interrupt();
+	}
+}
+
+/************************************************************************/
+/*                     KERNEL SCHEDULING FUNCTIONS                      */
+/************************************************************************/
+
+/* This internal kernel function is a part of the "scheduler". It chooses the next task to run, i.e., Cp. */
+static void Dispatch()
+{
+	int highest_pri_index = -1;
+	#ifndef HOST_SMP
+	unsigned int i = 0;
+	int highest_pri;
+	PD *edf;
+	#endif
+	
+	#ifdef HOST_SMP
+	//Cp is off this virtual CPU now, whether it blocked or waits to run again. Another CPU may steal it once it's READY
+	if(Cp != NULL && Cp->on_cpu == Host_CPU)
+		Cp->on_cpu = -1;
+	#endif
+	
+	while(1)
+	{
+		#ifdef HOST_SMP
+		//Each virtual CPU has its own run queue. See Kernel_SMP_Pick()
+		highest_pri_index = Kernel_SMP_Pick();
+		#else
+		highest_pri = LOWEST_PRIORITY + 1;
 		
-		//Looping through the process list until any process becomes ready
-		while(Process[NextP].state != READY)
+		//Find the next READY task with the highest priority by iterating through the process list ONCE
+		for(i=0; i<MAXTHREAD; i++)
 		{
 			//Increment process index
 			NextP = (NextP + 1) % MAXTHREAD;
 			
-			//Check if any timer ticks came in
-			Kernel_Tick_Handler();	
+			//EDF tasks in their band are picked from the deadline heap instead
+			if(In_EDF_Band(&Process[NextP]))
+				continue;
+			
+			//Select the READY process with the highest priority
+			if(Process[NextP].state == READY && Process[NextP].pri < highest_pri)
+			{
+				highest_pri = Process[NextP].pri;
+				highest_pri_index = NextP;
+			}
 		}
 		
-		//Now that we have a ready task, interrupts must be disabled for the kernel to function properly again.
-		Disable_Interrupt();
+		//The EDF band runs the task with the earliest deadline, unless a fixed priority task outranks the band
+		edf = EDF_Heap_Peek();
+		if(edf != NULL && EDF_PRIORITY <= highest_pri)
+			highest_pri_index = edf - Process;
+		#endif
+		
+		if(highest_pri_index != -1)
+			break;
+		
+		//When none of the tasks in the process list is ready, wait for an interrupt to tick or queue some work that wakes one
+		KernelIdle = 1;
+		Wait_For_Interrupt();
+		KernelIdle = 0;
+		
+		//Check if any timer ticks or deferred work came in
+		Kernel_Tick_Handler();
+		Kernel_Do_Deferred();
 	}
-	else
-		NextP = highest_pri_index;
+	NextP = highest_pri_index;
 
 	//Load the next selected task's process descriptor into Cp
 	Cp = &(Process[NextP]);
 	CurrentSp = Cp->sp;
 	Cp->state = RUNNING;
+	
+	#ifdef HOST_SMP
+	if(Cp->cpu != Host_CPU)
+	{
+		Cp->cpu = Host_CPU;		//Stolen, it's on this CPU's run queue from now on
+		++Steals;
+	}
+	Cp->on_cpu = Host_CPU;
+	#endif
+	
+	//A running task is never kept in the EDF heap, so its deadline can change freely
+	if(Cp->heap_pos >= 0)
+		EDF_Heap_Remove(Cp->heap_pos);
+	
+	//Everything woken so far has been considered
+	Woken_Pri = LOWEST_PRIORITY + 1;
+	#ifdef HOST_SMP
+	Resched_Due = 0;
+	#endif
+}
+
+#ifdef HOST_SMP
+/*Suspends the caller now that its request is done. Another virtual CPU suspended it while it was still running here*/
+static void Kernel_SMP_Suspend(PD *p)
+{
+	if(p->state == DEAD || p->state == SUSPENDED)
+		return;
+	
+	p->last_state = (p->state == RUNNING) ? READY : p->state;
+	p->state = SUSPENDED;
+	if(p->heap_pos >= 0)
+		EDF_Heap_Remove(p->heap_pos);
+	if(p == Cp)
+		Dispatch();
 }
+#endif
 
 /**
   * This internal kernel function is the "main" driving loop of this full-served
@@ -719,32 +3713,80 @@ static void Dispatch()
   */
 static void Next_Kernel_Request() 
 {
+	PD *caller = NULL;		//The task whose request is being handled. Dispatch() may change Cp before it's done
+	PRIORITY woken = LOWEST_PRIORITY + 1;	//Highest priority the ticks processed on kernel entry woke
+	#ifdef HOST_SMP
+	int suspended;			//Did another virtual CPU suspend the caller while it ran here?
+	#endif
+	
+	//The kernel runs with interrupts enabled, ISRs queue anything they need from it
+	Enable_Interrupt();
 	Dispatch();	//Select an initial task to run
 
 	//After OS initialization, THIS WILL BE KERNEL'S MAIN LOOP!
 	//NOTE: When another task makes a syscall and enters the loop, it's still in the RUNNING state!
 	while(1) 
 	{
+		Kernel_Run_Deferred(woken);
+		
+		//The switch hooks only see real switches, not a task going back to what it was doing
+		if(Cp != caller)
+		{
+			if(caller != NULL)
+				SWITCH_OUT_HOOK(caller, caller->request);
+			SWITCH_IN_HOOK(Cp, Cp->request);
+		}
+		
 		//Clears the process' request fields
 		Cp->request = NONE;
 		//Cp->request_arg is not reset, because task_sleep uses it to keep track of remaining ticks
 
-		//Load the current task's stack pointer and switch to its context
+		//Load the current task's stack pointer and error, and switch to its context
 		CurrentSp = Cp->sp;
+		err = Cp->err;
+		InKernel = 0;
+		#ifdef CLI_TIMING
+		Kernel_CLI_End();		//The reti of Exit_Kernel() enables interrupts
+		#endif
+		#ifdef HOST_SMP
+		Cpu_Running[Host_CPU] = (PD *)Cp;
+		#endif
 		Exit_Kernel();
 
 		/* if this task makes a system call, it will return to here! */
+		InKernel = 1;
+		#ifdef ISR_TRACE
+		++Kernel_Entries;
+		#endif
+		#ifdef HOST_SMP
+		Cpu_Running[Host_CPU] = NULL;
+		
+		//Another virtual CPU may have suspended the caller, or resumed it again, while it ran here. It only finds out through
+		//Kernel_Resched_ISR(), before it can make another request, and is RUNNING until that's handled
+		suspended = (Cp->state == SUSPENDED);
+		Cp->state = RUNNING;
+		if(Cp->heap_pos >= 0)
+			EDF_Heap_Remove(Cp->heap_pos);
+		#endif
 
 		//Save the current task's stack pointer and proceed to handle its request
 		Cp->sp = CurrentSp;
+		caller = Cp;
+		Enable_Interrupt();
 		
-		//Check if any timer ticks came in
+		//Check if any timer ticks came in. A task they wake preempts the caller once its request is done
+		Woken_Pri = LOWEST_PRIORITY + 1;
 		Kernel_Tick_Handler();
+		woken = Woken_Pri;
 
-		switch(Cp->request)
+		SYSCALL_ENTER_HOOK(caller, caller->request);
+		if(Basic_Would_Block())
+			err = BASIC_BLOCKING_ERR;
+		else switch(Cp->request)
 		{
+			//Objects are created with their ID in the caller's request_arg, which no other task can overwrite before it reads it
 			case CREATE_T:
-			Kernel_Create_Task(Cp->code, Cp->pri, Cp->arg);
+			Cp->request_arg = Kernel_Create_Task(Cp->request_ptr);
 			break;
 			
 			case TERMINATE:
@@ -752,6 +3794,22 @@ static void Next_Kernel_Request()
 			Dispatch();					//Dispatch is only needed if the syscall requires running a different task  after it's done
 			break;
 		   
+			case NOTIFY_T:
+			Kernel_Send_Notification();
+			Kernel_Ready_Task(Cp);		//Let the notified task run first if it has a higher priority
+			Dispatch();
+			break;
+			
+			case WAIT_NOTIFY_T:
+			Kernel_Wait_Notification();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case JOIN_T:
+			Kernel_Join_Task();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
 			case SUSPEND:
 			Kernel_Suspend_Task();
 			if(Cp->state != RUNNING) Dispatch();
@@ -759,6 +3817,7 @@ static void Next_Kernel_Request()
 			
 			case RESUME:
 			Kernel_Resume_Task();
+			Kernel_Ready_Task(Cp);		//Let a higher priority task we resumed run first
 			Dispatch();
 			break;
 			
@@ -767,8 +3826,55 @@ static void Next_Kernel_Request()
 			Dispatch();					
 			break;
 			
+			case NEXT_PERIOD:
+			Kernel_Next_Period();
+			if(Cp->state != RUNNING) Dispatch();	//A task that isn't periodic keeps running with the error
+			break;
+			
+			case SET_BUDGET:
+			Kernel_Set_Budget();
+			Kernel_Ready_Task(Cp);		//Let a task we lifted the throttling of run first if it has a higher priority
+			Dispatch();
+			break;
+			
+			case SET_PRI_T:
+			Kernel_Set_Priority();
+			Kernel_Ready_Task(Cp);		//Let a task we raised run first, or another one if we lowered ourselves
+			Dispatch();
+			break;
+			
+			case CREATE_TLS:
+			Cp->request_arg = Kernel_Create_TLS(Cp->request_ptr);
+			break;
+			
+			case CREATE_PT:
+			Kernel_Create_PT(Cp->request_ptr);
+			break;
+			
+			case RUN_PT:
+			Kernel_Run_PT();
+			if(Cp->state == RUNNING)
+				Kernel_Ready_Task(Cp);	//Let the other tasks of the same priority have a turn between passes
+			Dispatch();
+			break;
+			
+			case CREATE_BT:
+			Cp->request_arg = Kernel_Create_Basic(Cp->request_ptr);
+			break;
+			
+			case ACTIVATE_BT:
+			Kernel_Activate_Basic(Cp->request_arg);
+			Kernel_Ready_Task(Cp);		//A basic task of a higher priority runs right away
+			Dispatch();
+			break;
+			
+			case RUN_BT:
+			Kernel_Run_Basic();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
 			case CREATE_E:
-			Kernel_Create_Event();
+			Cp->request_arg = Kernel_Create_Event();
 			break;
 			
 			case WAIT_E:
@@ -778,11 +3884,57 @@ static void Next_Kernel_Request()
 			
 			case SIGNAL_E:
 			Kernel_Signal_Event();
+			Kernel_Ready_Task(Cp);		//Let a higher priority task we woke up run first
 			Dispatch();
 			break;
 			
 			case CREATE_M:
-			Kernel_Create_Mutex();
+			Cp->request_arg = Kernel_Create_Mutex();
+			break;
+			
+			case CREATE_EG:
+			Cp->request_arg = Kernel_Create_Event_Group();
+			break;
+			
+			case WAIT_EG:
+			Kernel_Wait_Event_Group();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case CREATE_TMR:
+			Cp->request_arg = Kernel_Create_Timer(Cp->request_ptr);
+			break;
+			
+			case START_TMR:
+			case STOP_TMR:
+			Kernel_Start_Stop_Timer();
+			break;
+			
+			case WAIT_TMR:
+			Kernel_Wait_Timer();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case CREATE_POOL:
+			Cp->request_arg = Kernel_Create_Pool(Cp->request_ptr);
+			break;
+			
+			case ALLOC_POOL:
+			Kernel_Alloc_Pool();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case FREE_POOL:
+			Kernel_Free_Pool();
+			Kernel_Ready_Task(Cp);		//Let a higher priority task we handed the block to run first
+			Dispatch();
+			break;
+			
+			case SET_EG:
+			case CLEAR_EG:
+			Kernel_Update_Event_Group();
+			Kernel_Ready_Task(Cp);		//Let any higher priority task we woke up run first
+			Dispatch();
 			break;
 			
 			case LOCK_M:
@@ -795,9 +3947,47 @@ static void Next_Kernel_Request()
 			//Does this need dispatch under any circumstances?
 			break;
 		   
+			case CREATE_CV:
+			Cp->request_arg = Kernel_Create_Cond();
+			break;
+			
+			case WAIT_CV:
+			Kernel_Wait_Cond();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case SIGNAL_CV:
+			case BROADCAST_CV:
+			Kernel_Signal_Cond();
+			Kernel_Ready_Task(Cp);		//Let a higher priority task we woke up run first
+			Dispatch();
+			break;
+			
+			case CREATE_RW:
+			Cp->request_arg = Kernel_Create_RWLock();
+			break;
+			
+			case READ_LOCK_RW:
+			case WRITE_LOCK_RW:
+			Kernel_Lock_RWLock();
+			if(Cp->state != RUNNING) Dispatch();
+			break;
+			
+			case UNLOCK_RW:
+			Kernel_Unlock_RWLock();
+			Kernel_Ready_Task(Cp);		//Our priority may have dropped, or a higher priority waiter got the lock
+			Dispatch();
+			break;
+		   
 			case YIELD:
-			case NONE:					// NONE could be caused by a timer interrupt
-			Cp->state = READY;
+			case NONE:					// NONE could be caused by a timer interrupt, or an ISR that queued work for the kernel
+			//An empty budget on an unthrottled task means the tick ISR preempted it for overrunning
+			if(Cp->budget > 0 && Cp->budget_left == 0 && !Cp->throttled)
+				Kernel_Throttle_Task();
+			else if(Cp->request == NONE)
+				break;					//Kernel_Run_Deferred() decides if the work woke something that should run instead
+			if(Cp->state == RUNNING)
+				Kernel_Ready_Task(Cp);
 			Dispatch();
 			break;
        
@@ -806,9 +3996,29 @@ static void Next_Kernel_Request()
 				err = INVALID_KERNET_REQUEST_ERR;
 			break;
        }
+	   
+		SYSCALL_EXIT_HOOK(caller, caller->request);
+		
+		//The error belongs to the caller, a task that runs before it gets to read it has its own
+		caller->err = err;
+		
+		#ifdef HOST_SMP
+		if(suspended)
+			Kernel_SMP_Suspend(caller);
+		#endif
     } 
 }
 
+#ifdef HOST_SMP
+/*Runs the kernel on a virtual CPU other than the one that called OS_Start(). Called by its thread with the kernel lock held*/
+void Kernel_Run_CPU()
+{
+	InKernel = 1;
+	Woken_Pri = LOWEST_PRIORITY + 1;
+	Next_Kernel_Request();
+}
+#endif
+
 	
 /************************************************************************/
 /* KERNEL BOOT                                                          */
@@ -836,6 +4046,31 @@ void Timer_init()
 	#endif
 }
 
+#ifdef PROFILER
+/*Sets up Timer3 to take profiler samples*/
+void Profiler_init()
+{
+	//Use CTC mode (mode 4) with prescaler = 8
+	TCCR3A = 0;
+	TCCR3B = (1<<WGM32)|(1<<CS31);
+	
+	OCR3A = PROFILE_LENG;
+	TCNT3 = 0;
+	TIMSK3 |= (1<<OCIE3A);
+}
+#endif
+
+#ifdef CLI_TIMING
+/*Sets up Timer4 to count freely every 0.5us, for timing stretches with interrupts disabled*/
+void CLI_Timer_init()
+{
+	//Use normal mode with prescaler = 8, no interrupts
+	TCCR4A = 0;
+	TCCR4B = (1<<CS41);
+	TCNT4 = 0;
+}
+#endif
+
 /*This function initializes the RTOS and must be called before any othersystem calls.*/
 void OS_Init()
 {
@@ -843,14 +4078,94 @@ void OS_Init()
 	
 	Task_Count = 0;
 	Event_Count = 0;
+	Mutex_Count = 0;
+	Event_Group_Count = 0;
+	Timer_Count = 0;
+	Timer_Active = -1;
+	Timer_Fired_Head = -1;
+	Timer_Daemon = NULL;
+	memset(PT_List, 0, sizeof(PT_List));
+	memset(PT_Runner, 0, sizeof(PT_Runner));
+	memset(Basic_Head, -1, sizeof(Basic_Head));
+	memset(Basic_Runner, 0, sizeof(Basic_Runner));
+	Pool_Count = 0;
+	Cond_Count = 0;
+	RWLock_Count = 0;
 	KernelActive = 0;
 	Tick_Count = 0;
+	Sys_Ticks = 0;
+	InKernel = 1;
+	Woken_Pri = LOWEST_PRIORITY + 1;
+	Deferred_Head = 0;
+	Deferred_Tail = 0;
+	Deferred_Overflows = 0;
+	EDF_Heap_Size = 0;
+	#ifdef PROFILER
+	memset(Profile, 0, sizeof(Profile));
+	Profile_Samples = 0;
+	Profile_Dropped = 0;
+	#endif
+	#ifdef ISR_TRACE
+	Trace_Count = 0;
+	Trace_Dropped = 0;
+	Kernel_Entries = 0;
+	#endif
+	#ifdef CLI_TIMING
+	CLI_Open = 0;
+	CLI_Longest.length = 0;
+	CLI_Longest.file = NULL;
+	CLI_Longest.line = 0;
+	#endif
+	Total_Deadline_Misses = 0;
 	NextP = 0;
 	Last_PID = 0;
 	Last_EventID = 0;
 	Last_MutexID = 0;
+	Last_EventGroupID = 0;
+	Last_TimerID = 0;
+	Last_PoolID = 0;
+	Last_CondID = 0;
+	Last_RWLockID = 0;
+	Last_TLSKey = 0;
+	Last_BasicID = 0;
 	err = NO_ERR;
 	
+	#ifdef STATIC_OBJECTS
+	//The object tables were laid out at compile time. Just account for what was declared and patch in the code addresses and arguments
+	for (x = 0; x < MAXTHREAD; x++) {
+		if (Process[x].state == DEAD)
+			continue;
+		Kernel_Init_Return_Addresses(&Process[x]);
+		Kernel_Init_Arg(&Process[x]);
+		++Task_Count;
+		if (Process[x].pid > Last_PID)
+			Last_PID = Process[x].pid;
+		#ifdef HOST_SMP
+		Kernel_SMP_Place(&Process[x]);
+		#endif
+	}
+	for (x = 0; x < MAXEVENT; x++) {
+		if (Event[x].id == 0)
+			continue;
+		++Event_Count;
+		if (Event[x].id > Last_EventID)
+			Last_EventID = Event[x].id;
+	}
+	for (x = 0; x < MAXMUTEX; x++) {
+		if (Mutex[x].id == 0)
+			continue;
+		++Mutex_Count;
+		if (Mutex[x].id > Last_MutexID)
+			Last_MutexID = Mutex[x].id;
+	}
+	for (x = 0; x < MAXEVENTGROUP; x++) {
+		if (EventGroup[x].id == 0)
+			continue;
+		++Event_Group_Count;
+		if (EventGroup[x].id > Last_EventGroupID)
+			Last_EventGroupID = EventGroup[x].id;
+	}
+	#else
 	//Clear and initialize the memory used for tasks
 	memset(Process, 0, MAXTHREAD*sizeof(PD));
 	for (x = 0; x < MAXTHREAD; x++) {
@@ -866,9 +4181,25 @@ void OS_Init()
 	//Clear and initialize the memory used for Mutex
 	memset(Mutex, 0, MAXMUTEX*sizeof(MUTEX_TYPE));
 	for (x = 0; x < MAXMUTEX; x++) {
-		Event[x].id = 0;
+		Mutex[x].id = 0;
 	}
 	
+	//Clear and initialize the memory used for event groups
+	memset(EventGroup, 0, MAXEVENTGROUP*sizeof(EVENT_GROUP_TYPE));
+	#endif
+	
+	//Clear and initialize the memory used for timers
+	memset(Timer, 0, MAXTIMER*sizeof(TIMER_TYPE));
+	
+	//Clear and initialize the memory used for pools
+	memset(Pool, 0, MAXPOOL*sizeof(POOL_TYPE));
+	
+	//Clear and initialize the memory used for condition variables
+	memset(Cond, 0, MAXCOND*sizeof(COND_TYPE));
+	
+	//Clear and initialize the memory used for reader-writer locks
+	memset(RWLock, 0, MAXRWLOCK*sizeof(RWLOCK_TYPE));
+	
 	#ifdef DEBUG
 	printf("OS initialized!\n");
 	#endif
@@ -887,11 +4218,20 @@ void OS_Start()
 		
 		/*Initialize and start Timer needed for sleep*/
 		Timer_init();
+		#ifdef PROFILER
+		Profiler_init();
+		#endif
+		#ifdef CLI_TIMING
+		CLI_Timer_init();
+		#endif
 		
 		#ifdef DEBUG
 		printf("OS begins!\n");
 		#endif
 		
+		#ifdef HOST_SMP
+		Host_Start_CPUs();		//They wait for the kernel lock until this CPU is done booting
+		#endif
 		Next_Kernel_Request();
 		/* NEVER RETURNS!!! */
 	}
@@ -9,7 +9,9 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <stdint.h>
 #include "os.h"
+#include "sched_analysis.h"
 
 #ifdef DEBUG
 #include "uart/uart.h"
@@ -20,10 +22,106 @@
 #define TICK_LENG 625			//The length of a tick = 10ms, using 16Mhz clock and /256 prescsaler
 #define MAX_EVENT_SIG_MISS 1	//The maximum number of missed signals to record for an event. 0 = unlimited
 #define LOWEST_PRIORITY 10		//The largest number to represent the lowest task priority. 0 will always be the highest priority.
+#define BACKGROUND_PRIORITY LOWEST_PRIORITY	//Priority a task is demoted to after using up its CPU budget
+#define DEFERRED_SIZE 8			//Work ISRs can queue up for the kernel. Anything past that is dropped and counted
+//#define STATIC_OBJECTS			//Tasks, events and mutexes are declared at compile time with the OS_STATIC_* macros below
+//#define ADMISSION_CONTROL		//Reject periodic tasks whose creation would make the periodic task set unschedulable
+#define ADMISSION_CS_US 0		//Longest a periodic task holds a mutex or reader-writer lock in microseconds. Admission control counts it as blocking
+//#define ISR_TRACE				//Record the arrival of traced interrupts, so their timing can be replayed on the host port
+#define TRACE_SIZE 64			//Interrupt arrivals kept by ISR_TRACE. Recording stops once the buffer is full
+//#define PROFILER				//Sample the code Timer3 interrupts and count the samples per task and address. Not for the host port
+#define PROFILE_LENG 1982		//Time between samples = ~1ms, using 16Mhz clock and /8 prescaler. Kept off multiples of the tick so the two don't alias
+#define PROFILE_SIZE 64			//Distinct (task, address) pairs PROFILER can count
+#define PROFILE_SKID 32			//Timer3 counts a sample may be late by before it's blamed on code that had interrupts disabled
+//#define CLI_TIMING			//Time every stretch with interrupts disabled on Timer4 and keep the longest, with where it began. Not for the host port
+
+//Called by the kernel with the caller's PID and the mutex when a Mutex_Lock() would deadlock. Redefine before this point to log, halt or reset.
+#ifndef DEADLOCK_HOOK
+#define DEADLOCK_HOOK(pid, mutex)
+#endif
+
+//Instrumentation hooks, called by the kernel with interrupts disabled. Each gets the task's PD and a request: the syscall it made,
+//NONE if an interrupt preempted it. Like DEADLOCK_HOOK they're empty unless defined before this point, and then cost nothing.
+#ifndef SWITCH_OUT_HOOK
+#define SWITCH_OUT_HOOK(p, request)			//p entered the kernel with request, and a different task runs next
+#endif
+#ifndef SYSCALL_ENTER_HOOK
+#define SYSCALL_ENTER_HOOK(p, request)		//The kernel starts handling p's request
+#endif
+#ifndef SYSCALL_EXIT_HOOK
+#define SYSCALL_EXIT_HOOK(p, request)		//The kernel is done with p's request. p may have blocked, or been preempted by a task it woke
+#endif
+#ifndef SWITCH_IN_HOOK
+#define SWITCH_IN_HOOK(p, request)			//p is about to run in place of a different task, returning from request
+#endif
+#ifndef TASK_CREATE_HOOK
+#define TASK_CREATE_HOOK(p, request)		//p was created, request is CREATE_T
+#endif
+#ifndef TASK_TERMINATE_HOOK
+#define TASK_TERMINATE_HOOK(p, request)		//p is terminating, with TERMINATE or through Task_Exit()
+#endif
+#ifndef BLOCK_HOOK
+#define BLOCK_HOOK(p, request)				//p blocked on a kernel object, request being the syscall that waits for it, e.g. LOCK_M
+#endif
+#ifndef UNBLOCK_HOOK
+#define UNBLOCK_HOOK(p, request)			//p got what it was blocked on, or its wait timed out. Also if p is suspended meanwhile
+#endif
+
+//Put TRACE_ISR(vector) first in an ISR to record its arrival when ISR_TRACE is defined, e.g. TRACE_ISR(INT0_vect_num)
+#ifdef ISR_TRACE
+#define TRACE_ISR(vector)		Kernel_Trace_ISR(vector)
+#else
+#define TRACE_ISR(vector)
+#endif
+
+//Put CLI_ISR_BEGIN() first and CLI_ISR_END() last in an ISR to time it as a stretch with interrupts disabled when CLI_TIMING is defined
+#ifdef CLI_TIMING
+#define CLI_ISR_BEGIN()			Kernel_CLI_Begin(__FILE__, __LINE__)
+#define CLI_ISR_END()			Kernel_CLI_End()
+#else
+#define CLI_ISR_BEGIN()
+#define CLI_ISR_END()
+#endif
+
+//Variables each virtual CPU of the SMP host port keeps its own copy of. There's only ever one CPU otherwise
+#ifdef HOST_SMP
+#ifndef HOST_PORT
+#error "HOST_SMP runs the kernel on threads of a PC, it needs HOST_PORT"
+#endif
+#define PER_CPU __thread
+#define Spin_Lock(l)			while(__atomic_exchange_n(&(l), 1, __ATOMIC_ACQUIRE)) ;
+#define Spin_Unlock(l)			__atomic_store_n(&(l), 0, __ATOMIC_RELEASE)
+#define Count_Add(c, n)			__atomic_add_fetch(&(c), (n), __ATOMIC_SEQ_CST)
+#else
+#define PER_CPU
+#define Spin_Lock(l)			//Objects only need their own lock where tasks touch them outside of the kernel
+#define Spin_Unlock(l)
+#define Count_Add(c, n)			((c) += (n))
+#endif
 
 //Misc macros
+#ifdef HOST_PORT
+#include "host_port.h"			//Running on a PC, see host/port/host_port.c
+#define Disable_Interrupt()		Host_Disable_Interrupt()
+#define Enable_Interrupt()		Host_Enable_Interrupt()
+#ifdef HOST_SMP
+#define Restore_Interrupt(sreg)	Host_Restore_Interrupt(sreg)	//Also gives back the kernel lock Disable_Interrupt() took
+#else
+#define Restore_Interrupt(sreg)	SREG = (sreg)
+#endif
+#define Wait_For_Interrupt()	Host_Wait_For_Interrupt()
+#elif defined(CLI_TIMING)
+//Only a change from enabled to disabled starts a stretch, so nested sections are timed from the outermost one
+#define Disable_Interrupt()		do { unsigned char _sreg = SREG; asm volatile ("cli"::); if(_sreg & (1<<SREG_I)) Kernel_CLI_Begin(__FILE__, __LINE__); } while(0)
+#define Enable_Interrupt()		do { Kernel_CLI_End(); asm volatile ("sei"::); } while(0)
+#define Restore_Interrupt(sreg)	do { if((sreg) & (1<<SREG_I)) Kernel_CLI_End(); SREG = (sreg); } while(0)
+#define Wait_For_Interrupt()	asm volatile ("nop"::)
+#else
 #define Disable_Interrupt()		asm volatile ("cli"::)
 #define Enable_Interrupt()		asm volatile ("sei"::)
+#define Restore_Interrupt(sreg)	SREG = (sreg)			//Puts back the interrupt flag saved from SREG before a Disable_Interrupt()
+#define Wait_For_Interrupt()	asm volatile ("nop"::)		//The idle kernel runs with interrupts enabled, so they're taken as they come
+#endif
 
   
 //Definitions for potential errors the RTOS may come across
@@ -42,7 +140,27 @@ typedef enum error_codes
 	EVENT_ALREADY_OWNED_ERR,
 	SIGNAL_UNOWNED_EVENT_ERR,
 	MAX_MUTEX_ERR,
-	MUTEX_NOT_FOUND_ERR
+	MUTEX_NOT_FOUND_ERR,
+	UNSCHEDULABLE_ERR,
+	MAX_EVENT_GROUP_ERR,
+	EVENT_GROUP_NOT_FOUND_ERR,
+	TIMEOUT_ERR,
+	MAX_TIMER_ERR,
+	TIMER_NOT_FOUND_ERR,
+	MAX_POOL_ERR,
+	POOL_NOT_FOUND_ERR,
+	POOL_EMPTY_ERR,
+	DEADLOCK_ERR,
+	MAX_RWLOCK_ERR,
+	RWLOCK_NOT_FOUND_ERR,
+	RWLOCK_NOT_HELD_ERR,
+	MAX_COND_ERR,
+	COND_NOT_FOUND_ERR,
+	MUTEX_NOT_OWNED_ERR,
+	MAX_TLS_ERR,
+	MAX_BASIC_ERR,
+	BASIC_NOT_FOUND_ERR,
+	BASIC_BLOCKING_ERR
 } ERROR_TYPE;
 
   
@@ -54,9 +172,25 @@ typedef enum process_states
    SUSPENDED,
    SLEEPING,
    WAIT_EVENT,
-   WAIT_MUTEX 
+   WAIT_MUTEX,
+   THROTTLED,								//Used up its CPU budget, waiting for replenishment
+   WAIT_EVENT_GROUP,
+   WAIT_TIMER,								//The timer task waiting for timers to expire
+   WAIT_POOL,
+   WAIT_JOIN,
+   WAIT_NOTIFY,
+   WAIT_RWLOCK,
+   WAIT_COND,
+   WAIT_PT,									//A protothread runner waiting for one of its protothreads to be able to go on
+   WAIT_BASIC								//A basic task runner waiting for an activation
 } PROCESS_STATES;
 
+typedef enum sched_class
+{
+	SCHED_FIXED = 0,						//Scheduled by its fixed priority (default)
+	SCHED_EDF								//Scheduled by its absolute deadline within the EDF_PRIORITY band
+} SCHED_CLASS;
+
 
 typedef enum kernel_request_type 
 {
@@ -72,23 +206,241 @@ typedef enum kernel_request_type
    SIGNAL_E,
    CREATE_M,							//Initialize a mutex object
    LOCK_M,
-   UNLOCK_M	
+   UNLOCK_M,
+   NEXT_PERIOD,							//Wait for the next release of a periodic task
+   SET_BUDGET,							//Set the CPU budget of a task
+   CREATE_EG,							//Initialize an event group object
+   WAIT_EG,
+   SET_EG,
+   CLEAR_EG,
+   CREATE_TMR,							//Initialize a software timer
+   START_TMR,
+   STOP_TMR,
+   WAIT_TMR,							//Used by the timer task to fetch the next expired timer
+   CREATE_POOL,							//Initialize a memory pool
+   ALLOC_POOL,
+   FREE_POOL,
+   JOIN_T,								//Wait for another task to terminate
+   NOTIFY_T,							//Notify a task directly
+   WAIT_NOTIFY_T,
+   CREATE_RW,							//Initialize a reader-writer lock
+   READ_LOCK_RW,
+   WRITE_LOCK_RW,
+   UNLOCK_RW,
+   CREATE_CV,							//Initialize a condition variable
+   WAIT_CV,
+   SIGNAL_CV,
+   BROADCAST_CV,
+   SET_PRI_T,							//Change the base priority of a task
+   CREATE_TLS,							//Create a task-local storage key
+   CREATE_PT,							//Start a protothread
+   RUN_PT,								//Used by protothread runners to fetch their protothreads once one can go on
+   CREATE_BT,							//Create a basic task
+   ACTIVATE_BT,
+   RUN_BT								//Used by basic task runners to fetch the next activation
 } KERNEL_REQUEST_TYPE;
 
+//Set of tasks, one bit per slot in the process list
+#if MAXTHREAD <= 16
+typedef unsigned int THREAD_MASK;
+#else
+typedef unsigned long THREAD_MASK;
+#endif
+
+/*Parameters for creating a new task. Passed to the kernel through request_ptr*/
+typedef struct task_params
+{
+	voidfuncptr code;						//The function to be executed by the new task.
+	PRIORITY pri;							//Priority of the new task. Ignored for EDF tasks.
+	intptr_t arg;							//Initial argument of the new task, an int or a context pointer.
+	SCHED_CLASS sched;						//Scheduling class of the new task.
+	TICK period;							//Period in ticks of a periodic task, 0 = aperiodic
+	TICK deadline;							//Relative deadline in ticks of a periodic task
+	unsigned long wcet;						//Worst case execution time of one job in microseconds, used by admission control
+} TASK_PARAMS;
+
+/*Parameters for setting the CPU budget of a task. Passed to the kernel through request_ptr*/
+typedef struct budget_params
+{
+	PID pid;								//Which task's budget to set
+	TICK budget;							//Ticks the task may run per replenishment period, 0 = unlimited
+	TICK period;							//Replenishment period in ticks
+	unsigned char action;					//BUDGET_DEMOTE or BUDGET_SUSPEND
+} BUDGET_PARAMS;
+
+/*Parameters for changing the priority of a task. Passed to the kernel through request_ptr*/
+typedef struct priority_params
+{
+	PID pid;								//Task to change
+	PRIORITY pri;							//Its new base priority
+} PRIORITY_PARAMS;
+
+/*Parameters for waiting on an event group. Passed to the kernel through request_ptr*/
+typedef struct event_group_wait
+{
+	EVENT_GROUP group;						//Which group to wait on (or set/clear for SET_EG/CLEAR_EG)
+	EVENT_BITS mask;						//Which bits to wait for (or set/clear)
+	unsigned char options;					//EG_WAIT_ANY/EG_WAIT_ALL, optionally with EG_CLEAR_ON_EXIT
+	EVENT_BITS result;						//Bits of the group that satisfied the wait, 0 on timeout
+} EVENT_GROUP_WAIT;
+
+/*Parameters for creating a software timer, and what the timer task gets back for each expiry. Passed through request_ptr*/
+typedef struct timer_params
+{
+	timerfuncptr callback;					//Function to call on expiry
+	int arg;								//Argument passed to the callback
+	TICK period;							//Ticks until expiry (and between expiries of an auto-reload timer)
+	unsigned char auto_reload;				//Restart automatically after each expiry?
+} TIMER_PARAMS;
+
+/*Parameters for starting a protothread. Passed to the kernel through request_ptr*/
+typedef struct pt_params
+{
+	PT *pt;
+	ptfuncptr f;
+	PRIORITY pri;							//Priority of its runner
+} PT_PARAMS;
+
+/*Parameters for creating a basic task, and what its runner gets back for each activation. Passed through request_ptr*/
+typedef struct basic_params
+{
+	basicfuncptr code;						//Function run to completion on each activation
+	int arg;								//Argument passed to it
+	PRIORITY pri;							//Priority of its runner
+} BASIC_PARAMS;
+
+/*Parameters for creating a memory pool. Passed to the kernel through request_ptr*/
+typedef struct pool_params
+{
+	void *storage;							//Memory holding the blocks
+	unsigned int block_size;				//Bytes per block
+	unsigned int count;						//Number of blocks
+} POOL_PARAMS;
+
+/*Blocking allocation from a memory pool. Passed to the kernel through request_ptr*/
+typedef struct pool_wait
+{
+	void *block;							//The allocated block, NULL on timeout
+	TICK timeout;							//Ticks to wait for a free block, 0 = forever
+} POOL_WAIT;
+
+/*Waiting for a task to terminate. Passed to the kernel through request_ptr*/
+typedef struct join_wait
+{
+	TICK timeout;							//Ticks to wait for the task to terminate, 0 = forever
+	int exit_code;							//Exit code of the joined task
+	unsigned char joined;					//Did the task terminate before the timeout?
+} JOIN_WAIT;
+
+/*Waiting on a condition variable. The mutex goes in request_arg*/
+typedef struct cond_wait
+{
+	COND cond;								//Condition variable to wait on
+	unsigned int count;						//How many times the mutex was locked, restored when it's relocked
+} COND_WAIT;
+
+/*Kernel work queued by an ISR. The kernel runs with interrupts enabled, so ISRs leave everything but the queue alone*/
+typedef enum deferred_type
+{
+	DEFER_SET_EG = 1,						//Set bits in an event group
+	DEFER_FREE_POOL,						//Return a block to a pool
+	DEFER_NOTIFY,							//Notify a task
+	DEFER_ACTIVATE							//Activate a basic task
+} DEFERRED_TYPE;
+
+typedef struct deferred_work
+{
+	unsigned char type;						//DEFERRED_TYPE
+	unsigned char action;					//NOTIFY_* action of DEFER_NOTIFY
+	unsigned int id;						//Event group, pool or PID the work is for
+	unsigned int bits;						//Bits to set or send
+	void *block;							//Block to free
+} DEFERRED_WORK;
+
+/*Sending or waiting for a direct-to-task notification. Passed to the kernel through request_ptr*/
+typedef struct notify_params
+{
+	unsigned int bits;						//Bits to send, or the mask to wait for
+	unsigned char action;					//NOTIFY_SET_BITS, NOTIFY_INCREMENT or NOTIFY_OVERWRITE when sending
+	TICK timeout;							//Ticks to wait, 0 = forever
+	unsigned int result;					//Masked bits that woke the waiter, 0 on timeout
+} NOTIFY_PARAMS;
+
+
+/*The arrival of one interrupt, recorded by ISR_TRACE. Replaying these at the same kernel entries reproduces a run*/
+typedef struct trace_record
+{
+	unsigned long entry;					//Kernel entries made before the interrupt arrived
+	TICK tick;								//Ticks counted when it arrived
+	unsigned int tcnt;						//TCNT1 when it arrived
+	unsigned char vector;					//Interrupt vector number, e.g. TIMER1_COMPA_vect_num
+	unsigned char where;					//TRACE_WHERE it arrived
+} TRACE_RECORD;
+
+/*What was running when a traced interrupt arrived*/
+typedef enum trace_where
+{
+	TRACE_TASK = 0,							//A task
+	TRACE_KERNEL,							//The kernel, handling a request
+	TRACE_IDLE								//The kernel, waiting for an interrupt because no task is ready
+} TRACE_WHERE;
+
+/*Samples PROFILER took of one task at one code address*/
+typedef struct profile_entry
+{
+	unsigned int pc;						//Word address of the interrupted instruction, as in the return address
+	PID pid;								//Task that was running, 0 = the kernel or code running with interrupts disabled
+	unsigned int count;						//Samples taken there, 0 = unused entry
+} PROFILE_ENTRY;
+
+/*A stretch of time with interrupts disabled, timed by CLI_TIMING*/
+typedef struct cli_window
+{
+	unsigned int length;					//Timer4 counts of 0.5us it lasted
+	const char *file;						//Where interrupts were disabled, NULL if no stretch was timed yet
+	unsigned int line;
+} CLI_WINDOW;
 
 /*Process descriptor for a task*/
 typedef struct ProcessDescriptor 
 {
    PID pid;									//An unique process ID for this task.
-   PRIORITY pri;							//The priority of this task, from 0 (highest) to 10 (lowest).
+   PRIORITY pri;							//The priority this task runs at, from 0 (highest) to 10 (lowest). See Kernel_Effective_Priority()
+   PRIORITY base_pri;						//The priority it was given, by Task_Create() or Task_SetPriority(). EDF_PRIORITY for EDF tasks
    PROCESS_STATES state;					//What's the current state of this task?
    PROCESS_STATES last_state;				//What's the PREVIOUS state of this task? Used for task suspension/resume.
    KERNEL_REQUEST_TYPE request;				//What the task want the kernel to do (when needed).
    int request_arg;							//What value is needed for the specified kernel request.
-   int arg;									//Initial argument for the task (if specified).
+   void *request_ptr;						//Extra arguments for requests needing more than request_arg. Points into the caller's stack.
+   intptr_t arg;							//Initial argument for the task (if specified). Also passed in r24:r25 of its initial frame
    unsigned char *sp;						//stack pointer into the "workSpace".
    unsigned char workSpace[WORKSPACE];		//Data memory allocated to this process.
    voidfuncptr  code;						//The function to be executed when this process is running.
+   SCHED_CLASS sched;						//Fixed priority or EDF scheduling
+   TICK period;								//Release period in ticks, 0 = aperiodic
+   TICK rel_deadline;						//Deadline relative to each release, in ticks
+   TICK release;							//Tick of the current job's release
+   TICK abs_deadline;						//Tick by which the current job must finish
+   unsigned long wcet;						//Declared worst case execution time of one job, in microseconds
+   unsigned int deadline_misses;			//How many jobs of this task have missed their deadline?
+   unsigned char missed;					//Has the current job already been counted as a miss?
+   signed char heap_pos;					//Index of this task in the EDF ready heap, -1 if not queued
+   TICK budget;								//Ticks this task may run per replenishment period, 0 = unlimited
+   TICK budget_left;						//Ticks left in the current replenishment period
+   TICK budget_period;						//Replenishment period in ticks
+   int replenish_in;						//Ticks until the budget is replenished
+   unsigned char budget_action;				//What happens when the budget runs out: BUDGET_DEMOTE or BUDGET_SUSPEND
+   unsigned char throttled;					//Has this task used up its budget for the current period?
+   TICK wait_ticks;							//Ticks left before a timed wait gives up, 0 = wait forever
+   int exit_code;							//Exit code passed to Task_Exit(). Kept after the task is DEAD until its slot is reused
+   THREAD_MASK joiners;						//Tasks blocked in Task_Join() on this task
+   unsigned int notify_value;				//Notification word written by Task_Notify()
+   void *tls[MAXTLS];						//Task-local storage, indexed by TLS_KEY - 1. Cleared when the task is created
+   ERROR_TYPE err;							//err as this task last saw it. Swapped in and out of err along with the task
+#ifdef HOST_SMP
+   signed char cpu;							//The virtual CPU whose run queue it's on. Changes when another CPU steals it
+   signed char on_cpu;						//The virtual CPU running it right now, -1 if none
+#endif
 } PD;
 
 
@@ -98,6 +450,9 @@ typedef struct event_type
 	EVENT id;								//An unique identifier for this event. 0 = uninitialized
 	PID owner;								//Who's currently waiting for this event this?
 	unsigned int count;						//How many unhandled events has been collected?
+#ifdef HOST_SMP
+	unsigned char lock;						//Taken along with any change, so Event_Wait() can consume it without the kernel
+#endif
 } EVENT_TYPE;
 
 //For the ease of manageability, we're making a new mutex data type. The old MUTEX type defined in OS.h will simply serve as an identifier.
@@ -107,32 +462,210 @@ typedef struct mutex_type
 	PID owner;								//the current owner of the event, 0 = free
 	unsigned int count;						//mutex can be recursively locked
 	PID blocked_stack [MAXTHREAD];			//stack for blocked
-	PRIORITY priority_stack [MAXTHREAD];	//priority of the processes
+	PRIORITY priority_stack [MAXTHREAD];	//priority of the processes, kept up to date as it changes
 	unsigned int order[MAXTHREAD];			//order of task came into the stack
 	unsigned int num_of_process;			//number of processes waiting on the mutex
 	unsigned int total_num;					//total number of process has waitted on this mutex
-	PRIORITY own_pri;						//original priority of the owner
+	unsigned int contended;					//number of times a task had to wait for this mutex
+#ifdef HOST_SMP
+	unsigned char lock;						//Taken to change the owner, so Mutex_Lock() and Mutex_Unlock() can skip the kernel
+#endif
 } MUTEX_TYPE;
 
+//Event groups hold 16 flags that any number of tasks can wait on, for any or all of a mask
+typedef struct event_group_type
+{
+	EVENT_GROUP id;							//unique id for this event group, 0 = uninitialized
+	EVENT_BITS bits;						//Flags currently set
+	THREAD_MASK waiters;					//Tasks blocked on this group
+	THREAD_MASK pt_runners;					//Protothread runners with a protothread waiting for bits of this group
+} EVENT_GROUP_TYPE;
+
+//Software timers are kept in a delta list ordered by expiry, so a tick only ever looks at the head of it
+typedef struct timer_type
+{
+	TIMER id;								//unique id for this timer, 0 = uninitialized
+	timerfuncptr callback;					//Function run by the timer task on expiry
+	int arg;								//Argument passed to the callback
+	TICK period;							//Ticks between start and expiry, and between auto-reloads
+	TICK delta;								//Ticks after the expiry of the previous timer in the active list
+	unsigned char auto_reload;				//Restart automatically after each expiry?
+	unsigned char active;					//Is this timer in the active list?
+	unsigned char fired;					//Expiries whose callback hasn't run yet
+	signed char next;						//Next timer in the active list, -1 = end
+	signed char fire_next;					//Next timer in the expired list, -1 = end
+} TIMER_TYPE;
+
+//Basic tasks have no PD. Activations are queued per priority for the runner task of that priority, which runs them in turn
+typedef struct basic_type
+{
+	basicfuncptr code;						//Function run on each activation, NULL = uninitialized. The BASIC is the slot + 1
+	int arg;								//Argument passed to it
+	PRIORITY pri;							//Priority of its runner
+	unsigned char pending;					//Activations not run yet. It's in its priority's queue while this is > 0
+	signed char next;						//Next basic task in the queue, -1 = end
+} BASIC_TYPE;
+
+//Memory pools hand out fixed size blocks from a free list threaded through the free blocks themselves
+typedef struct pool_type
+{
+	POOL id;								//unique id for this pool, 0 = uninitialized
+	unsigned char *storage;					//First block
+	unsigned int block_size;				//Bytes per block
+	unsigned int count;						//Number of blocks
+	void *free_list;						//First free block. Each free block starts with a pointer to the next one
+	unsigned int used;						//Blocks currently allocated
+	unsigned int high_water;				//Most blocks ever allocated at once
+	THREAD_MASK waiters;					//Tasks blocked waiting for a free block
+} POOL_TYPE;
+
+//Condition variables only keep track of who's waiting. The mutex each waiter has to relock is in its request_arg
+typedef struct cond_type
+{
+	COND id;								//unique id for this condition variable, 0 = uninitialized
+	THREAD_MASK waiters;					//Tasks blocked in Cond_Wait()
+} COND_TYPE;
+
+//Reader-writer locks are held by one writer or a set of readers. Waiting writers are preferred over new readers
+typedef struct rwlock_type
+{
+	RWLOCK id;								//unique id for this lock, 0 = uninitialized
+	PID writer;								//Task holding the write lock, 0 = none
+	THREAD_MASK readers;					//Tasks holding a read lock
+	THREAD_MASK read_waiters;				//Tasks blocked waiting to read
+	THREAD_MASK write_waiters;				//Tasks blocked waiting to write
+} RWLOCK_TYPE;
+
+
+/*Static object declarations. With STATIC_OBJECTS defined, the application must declare the kernel's object tables exactly once, e.g.:
+ *
+ *   OS_STATIC_TASKS(STATIC_TASK(0, Task_P1, 1, 0), STATIC_TASK(1, Task_P2, 2, 0));
+ *   OS_STATIC_EVENTS(STATIC_EVENT(0));
+ *   OS_STATIC_EVENT_GROUPS();
+ *   OS_STATIC_MUTEXES();
+ *
+ * Each task's descriptor and initial context frame are laid out in .data by the compiler, so OS_Init() doesn't allocate
+ * or clear anything. Only the code addresses and the argument in each frame are patched at boot, since avr-gcc can't split a function
+ * address into bytes in a static initializer. Objects are referred to by STATIC_ID(slot). More objects can still be
+ * created at runtime in the remaining slots.
+ */
+#define FRAME_SIZE 40												//Bytes in a task's initial frame: 2 code addresses (3 bytes each) + 34 saved registers
+#define STATIC_ID(slot) ((slot) + 1)								//PID/EVENT/MUTEX of the object declared in slot
+
+#define OS_STATIC_TASKS(...)	volatile PD Process[MAXTHREAD] = { __VA_ARGS__ }
+#define STATIC_TASK(slot, f, py, a)	[slot] = {						\
+	.pid = STATIC_ID(slot),											\
+	.pri = (py),													\
+	.base_pri = (py),												\
+	.state = READY,													\
+	.arg = (a),														\
+	.code = (f),													\
+	.sp = (unsigned char *)&Process[slot].workSpace[WORKSPACE-1-FRAME_SIZE],	\
+	.heap_pos = -1 }
+
+#define OS_STATIC_EVENTS(...)	volatile EVENT_TYPE Event[MAXEVENT] = { __VA_ARGS__ }
+#define STATIC_EVENT(slot)		[slot] = { .id = STATIC_ID(slot) }
+
+#define OS_STATIC_EVENT_GROUPS(...)	volatile EVENT_GROUP_TYPE EventGroup[MAXEVENTGROUP] = { __VA_ARGS__ }
+#define STATIC_EVENT_GROUP(slot)	[slot] = { .id = STATIC_ID(slot) }
+
+#define OS_STATIC_MUTEXES(...)	volatile MUTEX_TYPE Mutex[MAXMUTEX] = { __VA_ARGS__ }
+#define STATIC_MUTEX(slot)	[slot] = {								\
+	.id = STATIC_ID(slot),											\
+	.blocked_stack = { [0 ... MAXTHREAD-1] = -1 },					\
+	.priority_stack = { [0 ... MAXTHREAD-1] = LOWEST_PRIORITY+1 } }
+
 
 /*Kernel functions accessible by the OS*/
 void OS_Init();
 void OS_Start();
-void Kernel_Create_Task(voidfuncptr f, PRIORITY py, int arg);
-void Kernel_Create_Event();
-void Kernel_Create_Mutex();
+PID Kernel_Create_Task(TASK_PARAMS *params);
+EVENT Kernel_Create_Event();
+MUTEX Kernel_Create_Mutex();
+EVENT_GROUP Kernel_Create_Event_Group();
+void Kernel_Set_Event_Group_FromISR(EVENT_GROUP g, EVENT_BITS bits);
+TIMER Kernel_Create_Timer(TIMER_PARAMS *params);
+POOL Kernel_Create_Pool(POOL_PARAMS *params);
+COND Kernel_Create_Cond();
+RWLOCK Kernel_Create_RWLock();
+TLS_KEY Kernel_Create_TLS(tlsdestructor *d);
+void Kernel_Create_PT(PT_PARAMS *params);
+BASIC Kernel_Create_Basic(BASIC_PARAMS *params);
+void Kernel_Activate_Basic_FromISR(BASIC b);
+void* Kernel_Pool_Take(POOL p);
+void* Kernel_Pool_Take_FromISR(POOL p);
+void Kernel_Pool_Free_FromISR(POOL p, void *block);
+void Kernel_Notify_FromISR(PID p, unsigned int bits, unsigned char action);
+unsigned int Kernel_Take_Notification(unsigned int mask);
+unsigned int getPoolUsed(POOL p);
+unsigned int getMutexContention(MUTEX m);
+unsigned int getDeferredOverflows();
+unsigned int getPoolHighWater(POOL p);
+EVENT_BITS getEventGroupBits(EVENT_GROUP g);
 int findPIDByFuncPtr(voidfuncptr f);
 int getEventCount(EVENT e);
+unsigned int getDeadlineMisses(PID p);
+PRIORITY getTaskPriority(PID p, unsigned char effective);
+PID getPTRunner(PRIORITY py);
+#ifdef HOST_SMP
+void Kernel_Run_CPU();
+void Kernel_Resched_ISR();
+int Kernel_Lock_Mutex_Fast(MUTEX m);
+int Kernel_Unlock_Mutex_Fast(MUTEX m);
+int Kernel_Wait_Event_Fast(EVENT e);
+unsigned long getSteals();
+#endif
+#if defined(PROFILER) && defined(DEBUG)
+void Kernel_Dump_Profile();
+#endif
+#ifdef ISR_TRACE
+void Kernel_Trace_ISR(unsigned char vector);
+#ifdef DEBUG
+void Kernel_Dump_Trace();
+#endif
+#endif
+#ifdef CLI_TIMING
+void Kernel_CLI_Begin(const char *file, unsigned int line);
+void Kernel_CLI_End();
+CLI_WINDOW getLongestCLI();
+void resetLongestCLI();
+#ifdef DEBUG
+void Kernel_Dump_CLI();
+#endif
+#endif
 
 /*Kernel variables accessible by the OS*/
-extern volatile PD* Cp;
-extern volatile unsigned char *KernelSp;
-extern volatile unsigned char *CurrentSp;
+extern PER_CPU volatile PD* Cp;
+extern PER_CPU volatile unsigned char *KernelSp;
+extern PER_CPU volatile unsigned char *CurrentSp;
 extern volatile unsigned int KernelActive;
-extern volatile ERROR_TYPE err;
+extern PER_CPU volatile ERROR_TYPE err;
 extern volatile unsigned int Last_PID;
 extern volatile unsigned int Last_EventID;
 extern volatile unsigned int Last_MutexID;
+extern volatile unsigned int Last_EventGroupID;
+extern volatile unsigned int Last_TimerID;
+extern volatile unsigned int Last_PoolID;
+extern volatile unsigned int Last_CondID;
+extern volatile unsigned int Last_RWLockID;
+extern volatile unsigned int Last_TLSKey;
+extern volatile unsigned int Last_BasicID;
+#ifdef PROFILER
+extern volatile PROFILE_ENTRY Profile[PROFILE_SIZE];
+extern volatile unsigned long Profile_Samples;
+extern volatile unsigned int Profile_Dropped;
+#endif
+#ifdef ISR_TRACE
+extern volatile TRACE_RECORD Trace_Buffer[TRACE_SIZE];
+extern volatile unsigned int Trace_Count;
+extern volatile unsigned int Trace_Dropped;
+#endif
+
+/*OS functions the kernel refers to*/
+void Timer_Task(void);
+void PT_Task(void);
+void Basic_Task(void);
+extern volatile unsigned int Total_Deadline_Misses;
 
 
 #endif /* KERNEL_H_ */
\ No newline at end of file
@@ -11,39 +11,120 @@ extern void a_main();					//External entry point for application once kernel and
 /*						   RTOS API FUNCTIONS                           */
 /************************************************************************/
 
-/* OS call to create a new task */
-PID Task_Create(voidfuncptr f, PRIORITY py, int arg)
+/*Creates a task described by params, either through the kernel or directly if it hasn't started yet*/
+static PID Create_Task_With(TASK_PARAMS *params)
 {
+   PID p;
+   
    //Run the task creation through kernel if it's running already
    if (KernelActive) 
    {
      Disable_Interrupt();
 	 
-	 //Fill in the parameters for the new task into CP
-	 Cp->pri = py;
-	 Cp->arg = arg;
+	 //Pass the parameters for the new task to the kernel through CP. The caller's own pri/code are left untouched
      Cp->request = CREATE_T;
-     Cp->code = f;
+     Cp->request_ptr = params;
 
      Enter_Kernel();
+     p = Cp->request_arg;		//The kernel hands the PID back in our own PD
    } 
    else 
-	   Kernel_Create_Task(f,py,arg);		//If kernel hasn't started yet, manually create the task
-   
-   //Return zero as PID if the task creation process gave errors. Note that the smallest valid PID is 1
-   if (err == MAX_PROCESS_ERR)
-		return 0;
+	   p = Kernel_Create_Task(params);		//If kernel hasn't started yet, manually create the task
    
+   //The PID is zero if the task creation process gave errors. Note that the smallest valid PID is 1
    #ifdef DEBUG
-	printf("Created PID: %d\n", Last_PID);
+	printf("Created PID: %d\n", p);
    #endif
    
-   return Last_PID;
+   return p;
+}
+
+/* OS call to create a new task */
+PID Task_Create(voidfuncptr f, PRIORITY py, int arg)
+{
+	TASK_PARAMS params;
+	
+	params.code = f;
+	params.pri = py;
+	params.arg = arg;
+	params.sched = SCHED_FIXED;
+	params.period = 0;
+	params.deadline = 0;
+	params.wcet = 0;
+	
+	return Create_Task_With(&params);
+}
+
+/* OS call to create a task that is passed a pointer instead of an int, e.g. to the state of the one channel it serves */
+PID Task_Create_Ctx(ctxfuncptr f, PRIORITY py, void *ctx)
+{
+	TASK_PARAMS params;
+	
+	params.code = (voidfuncptr)f;
+	params.pri = py;
+	params.arg = (intptr_t)ctx;
+	params.sched = SCHED_FIXED;
+	params.period = 0;
+	params.deadline = 0;
+	params.wcet = 0;
+	
+	return Create_Task_With(&params);
+}
+
+/* OS call to create a periodic task with a fixed priority. Its deadline is the end of its period */
+PID Task_Create_Periodic(voidfuncptr f, PRIORITY py, int arg, TICK period, unsigned long wcet)
+{
+	TASK_PARAMS params;
+	
+	if(period == 0)
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	params.code = f;
+	params.pri = py;
+	params.arg = arg;
+	params.sched = SCHED_FIXED;
+	params.period = period;
+	params.deadline = period;
+	params.wcet = wcet;
+	
+	return Create_Task_With(&params);
+}
+
+/* OS call to create a periodic task scheduled by earliest deadline first. Its first job is released immediately */
+PID Task_Create_EDF(voidfuncptr f, int arg, TICK period, TICK deadline, unsigned long wcet)
+{
+	TASK_PARAMS params;
+	
+	//A periodic task needs a period, and a deadline no later than its next release
+	if(period == 0 || deadline == 0 || deadline > period)
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	params.code = f;
+	params.pri = EDF_PRIORITY;
+	params.arg = arg;
+	params.sched = SCHED_EDF;
+	params.period = period;
+	params.deadline = deadline;
+	params.wcet = wcet;
+	
+	return Create_Task_With(&params);
 }
 
 /* The calling task terminates itself. */
 /*TODO: CLEAN UP EVENTS AND MUTEXES*/
 void Task_Terminate()
+{
+	Task_Exit(0);
+}
+
+/* The calling task terminates itself, handing code to any task joining it. */
+void Task_Exit(int code)
 {
 	if(!KernelActive){
 		err = KERNEL_INACTIVE_ERR;
@@ -51,9 +132,40 @@ void Task_Terminate()
 	}
 	Disable_Interrupt();
 	Cp -> request = TERMINATE;
+	Cp -> request_arg = code;
 	Enter_Kernel();			
 }
 
+/* Blocks until task p terminates, or until timeout ticks have passed. Returns p's exit code */
+int Task_Join(PID p, TICK timeout)
+{
+	JOIN_WAIT w;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return 0;
+	}
+	
+	w.timeout = timeout;
+	w.exit_code = 0;
+	w.joined = 0;
+	
+	Disable_Interrupt();
+	Cp->request = JOIN_T;
+	Cp->request_arg = p;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+	
+	if(!w.joined)
+	{
+		if(err == NO_ERR)
+			err = TIMEOUT_ERR;
+		return 0;
+	}
+	
+	return w.exit_code;
+}
+
 /* The calling task gives up its share of the processor voluntarily. Previously Task_Next() */
 void Task_Yield() 
 {
@@ -70,11 +182,20 @@ void Task_Yield()
 int Task_GetArg()
 {
 	if (KernelActive) 
-		return Cp->arg;
+		return (int)Cp->arg;
 	else
 		return -1;
 }
 
+/* The context pointer given to Task_Create_Ctx(). Tasks get it as their parameter, this is for the functions they call */
+void *Task_GetCtx()
+{
+	if (KernelActive) 
+		return (void *)Cp->arg;
+	else
+		return NULL;
+}
+
 void Task_Suspend(PID p)
 {
 	if(!KernelActive){
@@ -120,28 +241,274 @@ void Task_Sleep(TICK t)
 	Enter_Kernel();
 }
 
+/*The calling periodic task is done with its current job and sleeps until its next release*/
+void Task_WaitPeriod()
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = NEXT_PERIOD;
+	Enter_Kernel();
+}
+
+/*Limits task p to running budget ticks per period ticks. action decides what happens to it once the budget runs out*/
+void Task_SetBudget(PID p, TICK budget, TICK period, unsigned char action)
+{
+	BUDGET_PARAMS params;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	params.pid = p;
+	params.budget = budget;
+	params.period = period;
+	params.action = action;
+	
+	Disable_Interrupt();
+	Cp->request = SET_BUDGET;
+	Cp->request_ptr = &params;
+	Enter_Kernel();
+}
+
+unsigned int Task_GetDeadlineMisses(PID p)
+{
+	return getDeadlineMisses(p);
+}
+
+/*Changes the base priority of task p. It may still run at a higher priority inherited through a mutex or lock it holds*/
+void Task_SetPriority(PID p, PRIORITY py)
+{
+	PRIORITY_PARAMS params;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	params.pid = p;
+	params.pri = py;
+	
+	Disable_Interrupt();
+	Cp->request = SET_PRI_T;
+	Cp->request_ptr = &params;
+	Enter_Kernel();
+}
+
+PRIORITY Task_GetPriority(PID p)
+{
+	return getTaskPriority(p, 0);
+}
+
+PRIORITY Task_GetEffectivePriority(PID p)
+{
+	return getTaskPriority(p, 1);
+}
+
+/*Sends a notification to task p. action decides how bits are combined into its notification word*/
+void Task_Notify(PID p, unsigned int bits, unsigned char action)
+{
+	NOTIFY_PARAMS n;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	n.bits = bits;
+	n.action = action;
+	
+	Disable_Interrupt();
+	Cp->request = NOTIFY_T;
+	Cp->request_arg = p;
+	Cp->request_ptr = &n;
+	Enter_Kernel();
+}
+
+/*Sends a notification from an interrupt handler. Queued for the kernel, which does it before any task runs again*/
+void Task_Notify_FromISR(PID p, unsigned int bits, unsigned char action)
+{
+	Kernel_Notify_FromISR(p, bits, action);
+}
+
+/*Waits until any bit of mask is set in the calling task's notification word, then returns and clears those bits*/
+unsigned int Task_NotifyWait(unsigned int mask, TICK timeout)
+{
+	NOTIFY_PARAMS w;
+	unsigned int bits;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return 0;
+	}
+	
+	//Already notified? Then there's no need to enter the kernel at all
+	bits = Kernel_Take_Notification(mask);
+	if(bits != 0)
+		return bits;
+	
+	w.bits = mask;
+	w.timeout = timeout;
+	w.result = 0;
+	
+	Disable_Interrupt();
+	Cp->request = WAIT_NOTIFY_T;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+	
+	if(w.result == 0 && err == NO_ERR)
+		err = TIMEOUT_ERR;
+	
+	return w.result;
+}
+
+/*Initialize a condition variable object*/
+COND Cond_Init(void)
+{
+	COND c;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_CV;
+		Enter_Kernel();
+		c = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		c = Kernel_Create_Cond();	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return c;
+}
+
+/*Releases m and waits for c to be signalled, then relocks m before returning*/
+void Cond_Wait(COND c, MUTEX m)
+{
+	COND_WAIT w;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	w.cond = c;
+	
+	Disable_Interrupt();
+	Cp->request = WAIT_CV;
+	Cp->request_arg = m;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+}
+
+void Cond_Signal(COND c)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = SIGNAL_CV;
+	Cp->request_arg = c;
+	Enter_Kernel();
+}
+
+void Cond_Broadcast(COND c)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = BROADCAST_CV;
+	Cp->request_arg = c;
+	Enter_Kernel();
+}
+
+/*Initialize a reader-writer lock object*/
+RWLOCK RWLock_Init(void)
+{
+	RWLOCK l;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_RW;
+		Enter_Kernel();
+		l = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		l = Kernel_Create_RWLock();	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return l;
+}
+
+void RWLock_ReadLock(RWLOCK l)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = READ_LOCK_RW;
+	Cp->request_arg = l;
+	Enter_Kernel();
+}
+
+void RWLock_WriteLock(RWLOCK l)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = WRITE_LOCK_RW;
+	Cp->request_arg = l;
+	Enter_Kernel();
+}
+
+void RWLock_Unlock(RWLOCK l)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = UNLOCK_RW;
+	Cp->request_arg = l;
+	Enter_Kernel();
+}
+
 /*Initialize an event object*/
 EVENT Event_Init(void)
 {
+	EVENT e;
+	
 	if(KernelActive)
 	{
 		Disable_Interrupt();
 		Cp->request = CREATE_E;
 		Enter_Kernel();
+		e = Cp->request_arg;		//The kernel hands the ID back in our own PD
 	}
 	else
-		Kernel_Create_Event();	//Call the kernel function directly if kernel has not started yet.
-	
-	
-	//Return zero as Event ID if the event creation process gave errors. Note that the smallest valid event ID is 1
-	if (err == MAX_EVENT_ERR)
-		return 0;
+		e = Kernel_Create_Event();	//Call the kernel function directly if kernel has not started yet.
 	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
 	#ifdef DEBUG
-	printf("Created Event: %d\n", Last_EventID);
+	printf("Created Event: %d\n", e);
 	#endif
 	
-	return Last_EventID;
+	return e;
 }
 
 void Event_Wait(EVENT e)
@@ -150,6 +517,11 @@ void Event_Wait(EVENT e)
 		err = KERNEL_INACTIVE_ERR;
 		return;
 	}
+	#ifdef HOST_SMP
+	//An event that was signalled already is consumed without the kernel lock, which the other virtual CPUs may need meanwhile
+	if(Kernel_Wait_Event_Fast(e))
+		return;
+	#endif
 	Disable_Interrupt();
 	
 	Cp->request = WAIT_E;
@@ -173,25 +545,24 @@ void Event_Signal(EVENT e)
 
 MUTEX Mutex_Init(void)
 {
+	MUTEX m;
+	
 	if(KernelActive)
 	{
 		Disable_Interrupt();
 		Cp->request = CREATE_M;
 		Enter_Kernel();
+		m = Cp->request_arg;		//The kernel hands the ID back in our own PD
 	}
 	else
-		Kernel_Create_Mutex();	//Call the kernel function directly if OS hasn't start yet
-	
-	
-	//Return zero as Mutex ID if the mutex creation process gave errors. Note that the smallest valid mutex ID is 1
-	if (err == MAX_MUTEX_ERR)
-	return 0;
+		m = Kernel_Create_Mutex();	//Call the kernel function directly if OS hasn't start yet
 	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
 	#ifdef DEBUG
-	printf("Created Mutex: %d\n", Last_MutexID);
+	printf("Created Mutex: %d\n", m);
 	#endif
 	
-	return Last_MutexID;
+	return m;
 }
 
 void Mutex_Lock(MUTEX m)
@@ -200,6 +571,11 @@ void Mutex_Lock(MUTEX m)
 		err = KERNEL_INACTIVE_ERR;
 		return;
 	}
+	#ifdef HOST_SMP
+	//A free mutex, or one we hold already, is taken without the kernel. Only the mutex itself is locked
+	if(Kernel_Lock_Mutex_Fast(m))
+		return;
+	#endif
 	Disable_Interrupt();
 	
 	Cp->request = LOCK_M;
@@ -213,6 +589,11 @@ void Mutex_Unlock(MUTEX m)
 		err = KERNEL_INACTIVE_ERR;
 		return;
 	}
+	#ifdef HOST_SMP
+	//The kernel is only needed to hand the mutex to a waiter
+	if(Kernel_Unlock_Mutex_Fast(m))
+		return;
+	#endif
 	Disable_Interrupt();
 	
 	Cp->request = UNLOCK_M;
@@ -220,6 +601,425 @@ void Mutex_Unlock(MUTEX m)
 	Enter_Kernel();
 }
 
+/*Initialize an event group object*/
+EVENT_GROUP EventGroup_Init(void)
+{
+	EVENT_GROUP g;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_EG;
+		Enter_Kernel();
+		g = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		g = Kernel_Create_Event_Group();	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return g;
+}
+
+/*Blocks until any/all bits of mask are set in event group g, or until timeout ticks have passed. Returns the bits that woke us up*/
+EVENT_BITS EventGroup_Wait(EVENT_GROUP g, EVENT_BITS mask, unsigned char options, TICK timeout)
+{
+	EVENT_GROUP_WAIT w;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return 0;
+	}
+	
+	w.group = g;
+	w.mask = mask;
+	w.options = options;
+	w.result = 0;
+	
+	Disable_Interrupt();
+	Cp->request = WAIT_EG;
+	Cp->request_arg = timeout;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+	
+	//The kernel fills in the result when the wait is satisfied, or leaves it 0 on timeout
+	if(w.result == 0 && err == NO_ERR)
+		err = TIMEOUT_ERR;
+	
+	return w.result;
+}
+
+/*Sets or clears bits of an event group through the kernel*/
+static void EventGroup_Update(KERNEL_REQUEST_TYPE request, EVENT_GROUP g, EVENT_BITS bits)
+{
+	EVENT_GROUP_WAIT w;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	w.group = g;
+	w.mask = bits;
+	
+	Disable_Interrupt();
+	Cp->request = request;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+}
+
+void EventGroup_Set(EVENT_GROUP g, EVENT_BITS bits)
+{
+	EventGroup_Update(SET_EG, g, bits);
+}
+
+void EventGroup_Clear(EVENT_GROUP g, EVENT_BITS bits)
+{
+	EventGroup_Update(CLEAR_EG, g, bits);
+}
+
+/*Sets bits of an event group from an interrupt handler. Queued for the kernel, which does it before any task runs again*/
+void EventGroup_Set_FromISR(EVENT_GROUP g, EVENT_BITS bits)
+{
+	Kernel_Set_Event_Group_FromISR(g, bits);
+}
+
+EVENT_BITS EventGroup_Get(EVENT_GROUP g)
+{
+	return getEventGroupBits(g);
+}
+
+/*Initialize a software timer. Its callback runs period ticks after Timer_Start(), and every period ticks after that if auto_reload is set*/
+TIMER Timer_Create(timerfuncptr f, int arg, TICK period, unsigned char auto_reload)
+{
+	TIMER_PARAMS params;
+	TIMER t;
+	
+	if(f == NULL || period == 0)
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	params.callback = f;
+	params.arg = arg;
+	params.period = period;
+	params.auto_reload = auto_reload;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_TMR;
+		Cp->request_ptr = &params;
+		Enter_Kernel();
+		t = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		t = Kernel_Create_Timer(&params);	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return t;
+}
+
+void Timer_Start(TIMER t)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = START_TMR;
+	Cp->request_arg = t;
+	Enter_Kernel();
+}
+
+void Timer_Stop(TIMER t)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = STOP_TMR;
+	Cp->request_arg = t;
+	Enter_Kernel();
+}
+
+/*The timer task. Runs the callback of each expired timer in turn, and sleeps in the kernel while none are pending*/
+void Timer_Task()
+{
+	TIMER_PARAMS expired;
+	
+	for(;;)
+	{
+		expired.callback = NULL;
+		
+		Disable_Interrupt();
+		Cp->request = WAIT_TMR;
+		Cp->request_ptr = &expired;
+		Enter_Kernel();
+		
+		if(expired.callback != NULL)
+			expired.callback(expired.arg);
+	}
+}
+
+/*Starts the protothread f at priority py, using pt to keep track of it*/
+void PT_Create(PT *pt, ptfuncptr f, PRIORITY py)
+{
+	PT_PARAMS params;
+	
+	if(pt == NULL || f == NULL)
+	{
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	params.pt = pt;
+	params.f = f;
+	params.pri = py;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_PT;
+		Cp->request_ptr = &params;
+		Enter_Kernel();
+	}
+	else
+		Kernel_Create_PT(&params);	//Call the kernel function directly if OS hasn't start yet
+}
+
+PID PT_GetRunner(PRIORITY py)
+{
+	return getPTRunner(py);
+}
+
+/*The runner of one priority's protothreads. Calls each one that can go on in turn, and sleeps in the kernel while none can*/
+void PT_Task()
+{
+	PT *pt;
+	
+	for(;;)
+	{
+		Disable_Interrupt();
+		Cp->request = RUN_PT;
+		Cp->request_ptr = &pt;
+		Enter_Kernel();
+		
+		//NULL if we were woken up, the kernel has to see which protothread that was for first
+		for(; pt != NULL; pt = pt->next)
+		{
+			if(pt->wait == PT_RUN && pt->f(pt) >= PT_EXITED)
+				pt->wait = PT_DONE;
+		}
+	}
+}
+
+/*Creates a basic task, which runs f(arg) to completion at priority py each time it's activated*/
+BASIC Task_Create_Basic(basicfuncptr f, PRIORITY py, int arg)
+{
+	BASIC_PARAMS params;
+	BASIC b;
+	
+	if(f == NULL)
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	params.code = f;
+	params.arg = arg;
+	params.pri = py;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_BT;
+		Cp->request_ptr = &params;
+		Enter_Kernel();
+		b = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		b = Kernel_Create_Basic(&params);	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return b;
+}
+
+void Task_Activate(BASIC b)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	Disable_Interrupt();
+	Cp->request = ACTIVATE_BT;
+	Cp->request_arg = b;
+	Enter_Kernel();
+}
+
+void Task_Activate_FromISR(BASIC b)
+{
+	Kernel_Activate_Basic_FromISR(b);
+}
+
+/*The runner of one priority's basic tasks. Runs one activation after the other, and sleeps in the kernel while there are none*/
+void Basic_Task()
+{
+	BASIC_PARAMS next;
+	
+	for(;;)
+	{
+		Disable_Interrupt();
+		Cp->request = RUN_BT;
+		Cp->request_ptr = &next;
+		Enter_Kernel();
+		
+		next.code(next.arg);
+	}
+}
+
+/*Initialize a memory pool of count blocks with block_size bytes each, carved out of storage*/
+POOL Pool_Create(unsigned int block_size, unsigned int count, void *storage)
+{
+	POOL_PARAMS params;
+	POOL pool;
+	
+	//Free blocks have to hold the free list pointer
+	if(storage == NULL || count == 0 || block_size < sizeof(void *))
+	{
+		err = INVALID_ARG_ERR;
+		return 0;
+	}
+	
+	params.storage = storage;
+	params.block_size = block_size;
+	params.count = count;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_POOL;
+		Cp->request_ptr = &params;
+		Enter_Kernel();
+		pool = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		pool = Kernel_Create_Pool(&params);	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return pool;
+}
+
+/*Allocates a block without blocking. Doesn't need to enter the kernel*/
+void *Pool_Alloc(POOL p)
+{
+	return Kernel_Pool_Take(p);
+}
+
+/*Allocates a block from an interrupt handler, or a TLS destructor*/
+void *Pool_Alloc_FromISR(POOL p)
+{
+	return Kernel_Pool_Take_FromISR(p);
+}
+
+void *Pool_Alloc_Wait(POOL p, TICK timeout)
+{
+	POOL_WAIT w;
+	
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return NULL;
+	}
+	
+	w.block = NULL;
+	w.timeout = timeout;
+	
+	Disable_Interrupt();
+	Cp->request = ALLOC_POOL;
+	Cp->request_arg = p;
+	Cp->request_ptr = &w;
+	Enter_Kernel();
+	
+	return w.block;
+}
+
+void Pool_Free(POOL p, void *block)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	Disable_Interrupt();
+	
+	Cp->request = FREE_POOL;
+	Cp->request_arg = p;
+	Cp->request_ptr = block;
+	Enter_Kernel();
+}
+
+/*Returns a block from an interrupt handler, handing it to a waiting task if there is one*/
+void Pool_Free_FromISR(POOL p, void *block)
+{
+	Kernel_Pool_Free_FromISR(p, block);
+}
+
+unsigned int Pool_GetUsed(POOL p)
+{
+	return getPoolUsed(p);
+}
+
+unsigned int Pool_GetHighWater(POOL p)
+{
+	return getPoolHighWater(p);
+}
+
+TLS_KEY TLS_Create(tlsdestructor d)
+{
+	TLS_KEY k;
+	
+	if(KernelActive)
+	{
+		Disable_Interrupt();
+		Cp->request = CREATE_TLS;
+		Cp->request_ptr = &d;
+		Enter_Kernel();
+		k = Cp->request_arg;		//The kernel hands the ID back in our own PD
+	}
+	else
+		k = Kernel_Create_TLS(&d);	//Call the kernel function directly if OS hasn't start yet
+	
+	//The ID is zero if the creation gave errors. Note that the smallest valid ID is 1
+	return k;
+}
+
+/*Stores a value in the calling task's slot of a key. Only the task itself touches its slots, so no need to enter the kernel*/
+void TLS_Set(TLS_KEY k, void *value)
+{
+	if(!KernelActive){
+		err = KERNEL_INACTIVE_ERR;
+		return;
+	}
+	
+	if(k == 0 || k > Last_TLSKey){
+		err = INVALID_ARG_ERR;
+		return;
+	}
+	
+	Cp->tls[k - 1] = value;
+}
+
+void *TLS_Get(TLS_KEY k)
+{
+	if(!KernelActive || k == 0 || k > Last_TLSKey)
+		return NULL;
+	
+	return Cp->tls[k - 1];
+}
+
 /*Don't use main function for application code. Any mandatory kernel initialization should be done here*/
 void main() 
 {
@@ -11,10 +11,22 @@
 #define WORKSPACE     256   // in bytes, per THREAD
 #define MAXMUTEX      8 
 #define MAXEVENT      8      
+#define MAXEVENTGROUP 4
+#define MAXTIMER      16
+#define MAXPOOL       4
+#define MAXRWLOCK     4
+#define MAXCOND       4
+#define MAXTLS        4    // task-local storage slots in every task
+#define MAXBASIC      16   // basic (run-to-completion) tasks
+#define TIMER_TASK_PRIORITY 0   // priority of the task running software timer callbacks
 #define MSECPERTICK   10   // resolution of a system tick in milliseconds
 #define MINPRIORITY   10   // 0 is the highest priority, 10 the lowest
 
-typedef void (*voidfuncptr) (void);      /* pointer to void f(void) */
+typedef void (*voidfuncptr) (void);      /* pointer to void f(void), or to void f(int arg) which gets the task's arg */
+typedef void (*ctxfuncptr) (void *);     /* pointer to a task void f(void *ctx) */
+typedef void (*timerfuncptr) (int);      /* pointer to a timer callback void f(int arg) */
+typedef void (*tlsdestructor) (void *);  /* pointer to a destructor void f(void *value) of a task-local storage slot */
+typedef void (*basicfuncptr) (int);      /* pointer to a basic task void f(int arg) */
 
 #ifndef NULL
 	#define NULL          0   /* undefined */
@@ -25,26 +37,163 @@ typedef unsigned int MUTEX;      // always non-zero if it is valid
 typedef unsigned char PRIORITY;
 typedef unsigned int EVENT;      // always non-zero if it is valid
 typedef unsigned int TICK;
+typedef unsigned int EVENT_GROUP;  // always non-zero if it is valid
+typedef unsigned int EVENT_BITS;   // 16 event flags per group
+typedef unsigned int TIMER;        // always non-zero if it is valid
+typedef unsigned int POOL;         // always non-zero if it is valid
+typedef unsigned int RWLOCK;       // always non-zero if it is valid
+typedef unsigned int COND;         // always non-zero if it is valid
+typedef unsigned int TLS_KEY;      // always non-zero if it is valid
+typedef unsigned int BASIC;        // always non-zero if it is valid
+
+#define EG_WAIT_ANY       0x00   // wake up when any bit of the mask is set
+#define EG_WAIT_ALL       0x01   // wake up when all bits of the mask are set
+#define EG_CLEAR_ON_EXIT  0x02   // clear the bits of the mask that woke us up
 
 // void OS_Init(void);      redefined as main()
 void OS_Abort(void);
 
 //PID  Task_Create( void (*f)(void), PRIORITY py, int arg);
 PID  Task_Create(voidfuncptr f, PRIORITY py, int arg);
+PID  Task_Create_Ctx(ctxfuncptr f, PRIORITY py, void *ctx);   // like Task_Create(), but f gets a pointer, e.g. to its channel's state
 void Task_Terminate(void);
+void Task_Exit(int code);              // terminates the calling task with an exit code for Task_Join()
+int  Task_Join(PID p, TICK timeout);   // waits for task p to terminate and returns its exit code, timeout 0 = forever
 void Task_Yield(void);
 int  Task_GetArg(void);
+void *Task_GetCtx(void);
 void Task_Suspend( PID p );          
 void Task_Resume( PID p );
 
 void Task_Sleep(TICK t);  // sleep time is at least t*MSECPERTICK
 
+// Direct-to-task notifications: a notification word in each task, no kernel object needed
+#define NOTIFY_SET_BITS   0   // value |= bits
+#define NOTIFY_INCREMENT  1   // value += 1, the bits are ignored
+#define NOTIFY_OVERWRITE  2   // value = bits
+void Task_Notify(PID p, unsigned int bits, unsigned char action);
+void Task_Notify_FromISR(PID p, unsigned int bits, unsigned char action);
+unsigned int Task_NotifyWait(unsigned int mask, TICK timeout);  // returns and clears the masked bits once any is set, 0 on timeout
+
+PID  Task_Create_Periodic(voidfuncptr f, PRIORITY py, int arg, TICK period, unsigned long wcet);
+PID  Task_Create_EDF(voidfuncptr f, int arg, TICK period, TICK deadline, unsigned long wcet);  // wcet in microseconds
+void Task_WaitPeriod(void);  // the calling periodic task finishes its current job
+unsigned int Task_GetDeadlineMisses(PID p);
+
+// Budgets are charged by sampling: each tick is charged in full to whichever task is running when it fires. A task that
+// often blocks or is preempted between ticks is charged more or less than it ran, so leave a tick of slack per switch.
+#define BUDGET_DEMOTE   0   // an overrunning task keeps running at the background priority
+#define BUDGET_SUSPEND  1   // an overrunning task doesn't run at all until replenished
+void Task_SetBudget(PID p, TICK budget, TICK period, unsigned char action);  // budget 0 = unlimited, lifts any throttling
+
+// Basic tasks run to completion once per activation. All basic tasks of a priority are run one after the other by one
+// runner task, so they share its stack and only cost a few bytes each. They can't block: Event_Wait(), Task_Sleep() and
+// the other calls that may wait return right away with BASIC_BLOCKING_ERR, and so does Mutex_Lock() if another task holds
+// the mutex. A free one is locked, and has to be unlocked before the activation returns. Any that aren't are released
+// then. Task_Terminate() ends the current activation, and the runner is replaced for the ones after it. Activations that
+// come while one is pending or running queue up.
+// A timer activates one with Timer_Create((timerfuncptr)Task_Activate, b, period, 1)
+BASIC Task_Create_Basic(basicfuncptr f, PRIORITY py, int arg);
+void Task_Activate(BASIC b);           // b runs as soon as its priority gets to, a higher one preempts the caller
+void Task_Activate_FromISR(BASIC b);
+
+void Task_SetPriority(PID p, PRIORITY py);          // sets the base priority, INVALID_ARG_ERR for EDF tasks, UNSCHEDULABLE_ERR
+                                                    // under ADMISSION_CONTROL if a periodic p would make the task set miss deadlines
+PRIORITY Task_GetPriority(PID p);                   // the base priority, LOWEST_PRIORITY+1 if p doesn't exist
+PRIORITY Task_GetEffectivePriority(PID p);          // the priority p runs at, including inheritance and budget demotion
+
 MUTEX Mutex_Init(void);
-void Mutex_Lock(MUTEX m);
+void Mutex_Lock(MUTEX m);     // sets err to DEADLOCK_ERR and returns without the lock if waiting would deadlock
 void Mutex_Unlock(MUTEX m);
 
+// Condition variables. The mutex must be held by the caller of Cond_Wait(), and is held again when it returns
+COND Cond_Init(void);
+void Cond_Wait(COND c, MUTEX m);
+void Cond_Signal(COND c);       // wakes the highest priority waiter
+void Cond_Broadcast(COND c);    // wakes every waiter
+
+// Reader-writer locks: any number of readers or one writer. Waiting writers keep new readers out
+RWLOCK RWLock_Init(void);
+void RWLock_ReadLock(RWLOCK l);    // neither lock is recursive, locking again while holding it waits forever
+void RWLock_WriteLock(RWLOCK l);
+void RWLock_Unlock(RWLOCK l);      // releases either kind of lock held by the caller
+
 EVENT Event_Init(void);
 void Event_Wait(EVENT e);
 void Event_Signal(EVENT e);
 
+EVENT_GROUP EventGroup_Init(void);
+EVENT_BITS EventGroup_Wait(EVENT_GROUP g, EVENT_BITS mask, unsigned char options, TICK timeout);  // timeout 0 = forever, returns 0 on timeout
+void EventGroup_Set(EVENT_GROUP g, EVENT_BITS bits);
+void EventGroup_Set_FromISR(EVENT_GROUP g, EVENT_BITS bits);
+void EventGroup_Clear(EVENT_GROUP g, EVENT_BITS bits);
+EVENT_BITS EventGroup_Get(EVENT_GROUP g);
+
+// Software timers. Callbacks run in a single timer task at TIMER_TASK_PRIORITY and must not block
+TIMER Timer_Create(timerfuncptr f, int arg, TICK period, unsigned char auto_reload);
+void Timer_Start(TIMER t);   // first expiry is period ticks from now, restarts a running timer
+void Timer_Stop(TIMER t);
+
+// Fixed-block memory pools. storage must hold count blocks of block_size bytes, block_size >= sizeof(void*)
+POOL  Pool_Create(unsigned int block_size, unsigned int count, void *storage);
+void *Pool_Alloc(POOL p);                     // returns NULL right away if the pool is empty
+void *Pool_Alloc_FromISR(POOL p);             // same for ISRs, without setting err
+void *Pool_Alloc_Wait(POOL p, TICK timeout);  // blocks until a block is free, timeout 0 = forever, returns NULL on timeout
+void  Pool_Free(POOL p, void *block);
+void  Pool_Free_FromISR(POOL p, void *block);
+unsigned int Pool_GetUsed(POOL p);
+unsigned int Pool_GetHighWater(POOL p);     // most blocks ever in use at once
+
+// Task-local storage. A key names the same pointer slot in every task, which starts out NULL. Get and set don't enter the kernel.
+// When a task terminates, the destructor of each key it holds a non-NULL value for is called with the value. Destructors
+// run inside the kernel, so like ISRs they can only use the _FromISR calls
+TLS_KEY TLS_Create(tlsdestructor d);       // d can be NULL
+void  TLS_Set(TLS_KEY k, void *value);
+void *TLS_Get(TLS_KEY k);
+
+// Protothreads: lightweight tasks for simple state machines. A protothread is a function that returns whenever it waits,
+// and is called again to resume where it left off. All protothreads of a priority share one runner task and its stack,
+// so each only costs its PT. Locals don't survive a wait (keep them in a struct holding the PT), a switch can't span a
+// wait, and there can only be one wait per line. They must not make blocking calls, which would stop their whole
+// priority level, but can use the non-blocking ones (Event_Signal(), Pool_Alloc(), Task_Notify(), ...)
+#define PT_WAITING  0   // returned by a protothread that waits
+#define PT_YIELDED  1   // returned by a protothread that lets the others of its priority run first
+#define PT_EXITED   2   // returned by PT_EXIT()
+#define PT_ENDED    3   // returned by PT_END()
+
+#define PT_RUN          0   // what a protothread is waiting for, kept in PT.wait
+#define PT_SLEEP_FOR    1   // PT.until ticks, counted from when the runner next enters the kernel
+#define PT_SLEEP_UNTIL  2   // the kernel's tick count to reach PT.until
+#define PT_ON_EVENT     3   // the EVENT in PT.until
+#define PT_DONE         4   // exited or ended, left out of the runner's list
+#define PT_ON_GROUP     5   // any of the PT.mask bits in the EVENT_GROUP in PT.until
+#define PT_ON_NOTIFY    6   // any of the PT.mask bits in the runner's notification word
+
+typedef struct pt PT;
+typedef char (*ptfuncptr) (PT *pt);      /* pointer to a protothread char f(PT *pt), returning PT_WAITING etc. */
+struct pt
+{
+	unsigned int lc;        // line to resume at, 0 = from the start
+	ptfuncptr f;
+	PT *next;               // next protothread of the same priority
+	unsigned char wait;
+	unsigned int until;
+	unsigned int mask;      // bits PT_WAIT_BITS() and PT_WAIT_NOTIFY() wait for, then the ones that were set
+};
+
+void PT_Create(PT *pt, ptfuncptr f, PRIORITY py);   // pt must stay valid until f ends, it's linked into the runner's list.
+                                                    // INVALID_ARG_ERR if pt is still running, a PT that's done can be started again
+PID  PT_GetRunner(PRIORITY py);   // the runner task of priority py, for Task_Notify(). 0 until the first PT_Create() at py
+
+#define PT_BEGIN(pt)         switch((pt)->lc) { case 0:
+#define PT_END(pt)           } (pt)->lc = 0; return PT_ENDED
+#define PT_EXIT(pt)          do { (pt)->lc = 0; return PT_EXITED; } while(0)
+#define PT_BLOCK(pt, w, u)   do { (pt)->wait = (w); (pt)->until = (u); (pt)->lc = __LINE__; return PT_WAITING; case __LINE__:; } while(0)
+#define PT_YIELD(pt)         do { (pt)->lc = __LINE__; return PT_YIELDED; case __LINE__:; } while(0)
+#define PT_SLEEP(pt, t)      PT_BLOCK(pt, PT_SLEEP_FOR, t)        // at least t ticks
+#define PT_WAIT_EVENT(pt, e) PT_BLOCK(pt, PT_ON_EVENT, e)         // like Event_Wait(), e is gone once it wakes us
+#define PT_WAIT_BITS(pt, g, m)  do { (pt)->mask = (m); PT_BLOCK(pt, PT_ON_GROUP, g); } while(0)   // leaves the bits set
+#define PT_WAIT_NOTIFY(pt, m)   do { (pt)->mask = (m); PT_BLOCK(pt, PT_ON_NOTIFY, 0); } while(0)  // clears the bits it got
+#define PT_WAIT_UNTIL(pt, c) do { while(!(c)) PT_SLEEP(pt, 1); } while(0)   // c is checked once per tick, e.g. EventGroup_Get(g) & m, so it mustn't have side effects
+
 #endif /* _OS_H_ */
@@ -0,0 +1,221 @@
+#include "sched_analysis.h"
+
+/************************************************************************/
+/*                     RESPONSE TIME ANALYSIS                           */
+/************************************************************************/
+
+/*Can task j delay task i? Tasks at a higher priority always can. At the same level, EDF tasks are only delayed by EDF
+  tasks with shorter or equal relative deadlines (EDF dominates deadline monotonic order), everything else is assumed to interfere.*/
+static int Interferes(const SCHED_TASK *j, const SCHED_TASK *i)
+{
+	if(j->pri != i->pri)
+		return j->pri < i->pri;
+	
+	if(j->edf && i->edf)
+		return j->deadline <= i->deadline;
+	
+	return 1;
+}
+
+/*Execution time of one job including the kernel's cost of switching to and away from it*/
+static unsigned long Job_Cost(const SCHED_TASK *t)
+{
+	return t->wcet + 2 * KERNEL_CSWITCH_US;
+}
+
+/*Cost of the timer ticks that can arrive within t microseconds*/
+static unsigned long Tick_Cost(unsigned long t)
+{
+	return ((t + US_PER_TICK - 1) / US_PER_TICK) * KERNEL_TICK_US;
+}
+
+/*Longest task i can wait for less important tasks: one stretch that can't be preempted, plus every critical section of a
+  task that doesn't interfere with it. Priority inheritance lets each of them block i at most once per job.*/
+static unsigned long Blocking(const SCHED_TASK *set, unsigned int n, unsigned int i)
+{
+	unsigned long b = KERNEL_NONPREEMPT_US;
+	unsigned int j;
+	
+	for(j=0; j<n; j++)
+	{
+		if(j != i && !Interferes(&set[j], &set[i]))
+			b += set[j].cs;
+	}
+	return b;
+}
+
+/*Iterates R = B + C + sum(ceil(R/Tj) * Cj) to a fixed point. Returns 0 if R grows past the task's deadline*/
+static unsigned long Response_Time(const SCHED_TASK *set, unsigned int n, unsigned int i)
+{
+	unsigned long b = Blocking(set, n, i);
+	unsigned long r = b + Job_Cost(&set[i]);
+	unsigned long next;
+	unsigned int j;
+	
+	while(1)
+	{
+		//The timer tick behaves like the highest priority periodic task in the system
+		next = b + Job_Cost(&set[i]) + Tick_Cost(r);
+		
+		for(j=0; j<n; j++)
+		{
+			if(j != i && Interferes(&set[j], &set[i]))
+				next += ((r + set[j].period - 1) / set[j].period) * Job_Cost(&set[j]);
+		}
+		
+		if(next > set[i].deadline)
+			return 0;
+		if(next == r)
+			return r;
+		r = next;
+	}
+}
+
+/************************************************************************/
+/*                     EDF PROCESSOR DEMAND TEST                        */
+/************************************************************************/
+
+/*Fixed priority tasks at or above the EDF band preempt EDF tasks. The ones at the band's own level are assumed to.*/
+static int Above_Band(const SCHED_TASK *t)
+{
+	return !t->edf && t->pri <= EDF_PRIORITY;
+}
+
+/*Utilisation of the EDF band, everything above it and the tick, in millionths. Rounded up, so a result under
+  1000000 means they really fit.*/
+static unsigned long Band_Utilisation(const SCHED_TASK *set, unsigned int n)
+{
+	unsigned long u = ((unsigned long long)KERNEL_TICK_US * 1000000UL + US_PER_TICK - 1) / US_PER_TICK;
+	unsigned int j;
+	
+	for(j=0; j<n; j++)
+	{
+		if(set[j].edf || Above_Band(&set[j]))
+			u += ((unsigned long long)Job_Cost(&set[j]) * 1000000UL + set[j].period - 1) / set[j].period;
+	}
+	return u;
+}
+
+/*Most work that has to be done within t microseconds of the band becoming busy: EDF jobs both released and due in it,
+  every request from above the band, the ticks, and the blocking from EDF jobs due later and from tasks below the band*/
+static unsigned long Demand(const SCHED_TASK *set, unsigned int n, unsigned long t)
+{
+	unsigned long demand = KERNEL_NONPREEMPT_US + Tick_Cost(t);
+	unsigned int j;
+	
+	for(j=0; j<n; j++)
+	{
+		if(set[j].edf && set[j].deadline <= t)
+			demand += ((t - set[j].deadline) / set[j].period + 1) * Job_Cost(&set[j]);
+		else if(Above_Band(&set[j]))
+			demand += ((t + set[j].period - 1) / set[j].period) * Job_Cost(&set[j]);
+		else
+			demand += set[j].cs;
+	}
+	return demand;
+}
+
+/*Length of the longest time the band and everything above it can keep the CPU busy, including the blocking that can
+  start it off. Returns 0 if it grows past SCHED_HORIZON_US.*/
+static unsigned long Busy_Period(const SCHED_TASK *set, unsigned int n)
+{
+	unsigned long l = KERNEL_NONPREEMPT_US + KERNEL_TICK_US;
+	unsigned long next;
+	unsigned int j;
+	
+	for(j=0; j<n; j++)
+	{
+		if(set[j].edf || Above_Band(&set[j]))
+			l += Job_Cost(&set[j]);
+		else
+			l += set[j].cs;
+	}
+	
+	while(l <= SCHED_HORIZON_US)
+	{
+		next = KERNEL_NONPREEMPT_US + Tick_Cost(l);
+		for(j=0; j<n; j++)
+		{
+			if(set[j].edf || Above_Band(&set[j]))
+				next += ((l + set[j].period - 1) / set[j].period) * Job_Cost(&set[j]);
+			else
+				next += set[j].cs;
+		}
+		
+		if(next == l)
+			return l;
+		l = next;
+	}
+	return 0;
+}
+
+/*EDF jobs all meet their deadlines if the band fits in the CPU and, at every absolute deadline within a busy period,
+  the demand up to it fits in the time up to it*/
+static int EDF_Feasible(const SCHED_TASK *set, unsigned int n)
+{
+	unsigned long busy, t;
+	unsigned int i;
+	
+	if(Band_Utilisation(set, n) > 1000000UL)
+		return 0;
+	
+	busy = Busy_Period(set, n);
+	if(busy == 0)
+		return 0;
+	
+	//The order the deadlines are checked in doesn't matter, only that all of them are
+	for(i=0; i<n; i++)
+	{
+		if(!set[i].edf)
+			continue;
+		
+		for(t = set[i].deadline; t <= busy; t += set[i].period)
+		{
+			if(Demand(set, n, t) > t)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+int Sched_Analyze(const SCHED_TASK *set, unsigned int n, unsigned long *response)
+{
+	unsigned int i;
+	int failed = -1;
+	int edf_feasible = -1;			//Not analysed yet
+	unsigned long r;
+	
+	//The demand test divides by every period, so a malformed task fails the whole band before anything is analysed
+	for(i=0; i<n; i++)
+	{
+		if(set[i].period == 0 || set[i].deadline == 0)
+			edf_feasible = 0;
+	}
+	
+	for(i=0; i<n; i++)
+	{
+		if(set[i].period == 0 || set[i].deadline == 0)
+			r = 0;
+		else if(set[i].edf)
+		{
+			if(edf_feasible == -1)
+				edf_feasible = EDF_Feasible(set, n);
+			r = edf_feasible ? set[i].deadline : 0;
+		}
+		else
+			r = Response_Time(set, n, i);
+		
+		if(response != NULL)
+			response[i] = r;
+		
+		if(r == 0 && failed == -1)
+		{
+			failed = i;
+			
+			//Without a report to fill in, the first failure is all we need
+			if(response == NULL)
+				break;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,46 @@
+/***********************************************************************
+  sched_analysis.h and sched_analysis.c contain the schedulability analysis used for admission control.
+  They don't depend on any AVR headers, so the exact same analysis is also built into the host side
+  checker in host/sched_check.c.
+  ***********************************************************************/
+
+#ifndef SCHED_ANALYSIS_H_
+#define SCHED_ANALYSIS_H_
+
+#include "os.h"
+
+#define EDF_PRIORITY 5			//The priority band EDF tasks are scheduled in. Fixed priority tasks numerically below it preempt every EDF task.
+
+/*Kernel overheads on the target (ATmega2560 @ 16MHz, -O1). Re-measure them whenever the kernel changes, by flashing a DEBUG build
+  of test_kernel_cost.c and reading its UART output. It times on Timer4 at 0.5us per count, the same way CLI_TIMING does:
+    KERNEL_CSWITCH_US:    "CSWITCH": the longest Task_Yield() handing the CPU between two tasks of the same priority, from the TCNT4
+                          read before the call in one task to the one after it returns in the other.
+    KERNEL_TICK_US:       "TICK": the longest gap a task spinning on TCNT4 sees while every other task sleeps and MAXTIMER timers run,
+                          which is the tick ISR plus Kernel_Tick_Handler().
+    KERNEL_NONPREEMPT_US: "CLI": the longest stretch with interrupts disabled, from a CLI_TIMING build of the same app, plus KERNEL_CSWITCH_US
+                          for the syscall a newly released task may have to wait out.
+  The values below are conservative estimates and haven't been measured that way yet.*/
+#define KERNEL_CSWITCH_US	60		//Worst case cost of a syscall, including one Dispatch() and the context switches in and out of the kernel
+#define KERNEL_TICK_US		40		//Worst case cost of processing one timer tick (ISR + Kernel_Tick_Handler)
+#define KERNEL_NONPREEMPT_US	100		//Longest a released task can be kept from running by code that can't be preempted: the kernel and interrupts disabled
+#define US_PER_TICK			((unsigned long)MSECPERTICK * 1000UL)
+#define SCHED_HORIZON_US	60000000UL	//Busy periods longer than this (60s) are treated as unschedulable instead of being searched
+
+/*Timing description of one periodic task for the analysis*/
+typedef struct sched_task
+{
+	PRIORITY pri;							//Priority level of the task. EDF tasks use the EDF band.
+	unsigned char edf;						//Is this an EDF task?
+	unsigned long period;					//Period in microseconds
+	unsigned long deadline;					//Relative deadline in microseconds
+	unsigned long wcet;						//Worst case execution time of one job in microseconds, excluding kernel overheads
+	unsigned long cs;						//Longest time one job holds a mutex or reader-writer lock in microseconds. More important tasks can be blocked for it
+} SCHED_TASK;
+
+/*Checks if a task set is schedulable. Fixed priority tasks go through response-time analysis, the EDF band through a processor demand
+  test, both with the blocking lower priority tasks can cause. Returns the index of the first task that can miss its deadline, or -1 if all
+  of them are schedulable. If response isn't NULL, the worst case response time of each task is stored in it (0 = unbounded). EDF tasks
+  are only known to finish by their deadline, which is what they report.*/
+int Sched_Analyze(const SCHED_TASK *set, unsigned int n, unsigned long *response);
+
+#endif /* SCHED_ANALYSIS_H_ */
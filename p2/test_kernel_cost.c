@@ -0,0 +1,106 @@
+/*
+ * test_kernel_cost.c
+ *
+ * Measures the kernel overheads sched_analysis.h charges admission control for. Build it with DEBUG
+ * in place of the other test apps and read the results off the UART:
+ *   CSWITCH <counts> <us>   longest Task_Yield() from one task to another of the same priority
+ *   TICK <counts> <us>      longest a spinning task lost the CPU to the tick, with SLEEPERS tasks asleep and MAXTIMER timers running
+ * Both are timed on Timer4 at 0.5us per count, the way CLI_TIMING does. Timer1 wrapping around (it's reset by every tick)
+ * tells the two apart: yields a tick landed in aren't counted. Add CLI_TIMING to the build for the CLI line
+ * KERNEL_NONPREEMPT_US is based on.
+ */
+#include "os.h"
+#include "kernel.h"
+
+#define ROUNDS 1000			//Yields timed in each direction
+#define SPIN_TICKS 200		//Ticks the spinner watches
+#define SLEEPERS 8			//Tasks asleep while the tick is timed, so Kernel_Tick_Handler() has their timeouts to walk
+
+volatile uint16_t Stamp;			//TCNT4 just before the last Task_Yield()
+volatile uint16_t Stamp_Tick;		//TCNT1 at the same time
+volatile uint16_t Longest_Switch;
+volatile uint16_t Longest_Tick;
+volatile unsigned int Yields;
+
+void yield_task()
+{
+	uint16_t gap;
+
+	while(Yields < 2 * ROUNDS)
+	{
+		Stamp_Tick = TCNT1;
+		Stamp = TCNT4;
+		Task_Yield();
+
+		//Back from the other task's Task_Yield(), so the time since its stamp is one switch
+		gap = TCNT4 - Stamp;
+		if(gap > Longest_Switch && TCNT1 >= Stamp_Tick)
+			Longest_Switch = gap;
+		++Yields;
+	}
+	Task_Terminate();
+}
+
+void sleeper()
+{
+	for(;;)
+		Task_Sleep(60000);
+}
+
+void timer_callback(int arg)
+{
+}
+
+void spinner()
+{
+	uint16_t last, now, tick, tick_last;
+	unsigned int ticks = 0;
+	int i;
+
+	//Let the yield tasks finish first
+	while(Yields < 2 * ROUNDS)
+		Task_Yield();
+
+	for(i=0; i<SLEEPERS; i++)
+		Task_Create(sleeper, 3, 0);
+
+	//Running but never expiring during the measurement, so they're walked every tick without waking the timer task
+	for(i=0; i<MAXTIMER; i++)
+		Timer_Start(Timer_Create(timer_callback, i, 60000, 0));
+
+	last = TCNT4;
+	tick_last = TCNT1;
+	while(ticks < SPIN_TICKS)
+	{
+		now = TCNT4;
+		if(now - last > Longest_Tick)
+			Longest_Tick = now - last;
+		last = now;
+
+		tick = TCNT1;
+		if(tick < tick_last)
+			++ticks;
+		tick_last = tick;
+	}
+
+	printf("CSWITCH %u %u\n", Longest_Switch, Longest_Switch / 2);
+	printf("TICK %u %u\n", Longest_Tick, Longest_Tick / 2);
+	#ifdef CLI_TIMING
+	Kernel_Dump_CLI();
+	#endif
+	Task_Terminate();
+}
+
+void a_main()
+{
+	//Timer4 counts at 0.5us, as set up for CLI_TIMING
+	TCCR4A = 0;
+	TCCR4B = (1<<CS41);
+	TCNT4 = 0;
+
+	OS_Init();
+	Task_Create(yield_task, 4, 0);
+	Task_Create(yield_task, 4, 1);
+	Task_Create(spinner, 6, 0);
+	OS_Start();
+}